@@ -0,0 +1,155 @@
+#include "ActionScheduler.h"
+
+#include <exception>
+#include <iostream>
+
+#include "FeatureCache.h"
+
+PtpClock::PtpClock(Arena::IDevice* pDeviceMaster, uint32_t relatchIntervalMs)
+    : m_pLatch(ResolveNode<GenApi::CCommandPtr>(pDeviceMaster->GetNodeMap(), "PtpDataSetLatch")),
+      m_pLatchValue(ResolveNode<GenApi::CIntegerPtr>(pDeviceMaster->GetNodeMap(), "PtpDataSetLatchValue")),
+      m_relatch_interval(relatchIntervalMs) {
+    Relatch();
+}
+
+int64_t PtpClock::Now() {
+    std::chrono::steady_clock::time_point host_now = std::chrono::steady_clock::now();
+    bool stale = false;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        stale = host_now - m_host_latch > m_relatch_interval;
+    }
+    if (stale) {
+        std::unique_lock<std::mutex> latch_lock(m_latch_mutex);
+        // another thread may have relatched while this one waited for the lock
+        bool still_stale = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            still_stale = std::chrono::steady_clock::now() - m_host_latch > m_relatch_interval;
+        }
+        if (still_stale)
+            LatchLocked();
+        host_now = std::chrono::steady_clock::now();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_ptp_latch + std::chrono::duration_cast<std::chrono::nanoseconds>(host_now - m_host_latch).count();
+}
+
+void PtpClock::Relatch() {
+    std::unique_lock<std::mutex> latch_lock(m_latch_mutex);
+    LatchLocked();
+}
+
+void PtpClock::LatchLocked() {
+    // the latch happens somewhere inside the control round trip, take the midpoint
+    std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+    m_pLatch->Execute();
+    std::chrono::steady_clock::time_point after = std::chrono::steady_clock::now();
+    int64_t ptp_latch = m_pLatchValue->GetValue();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_ptp_latch = ptp_latch;
+    m_host_latch = before + (after - before) / 2;
+}
+
+ActionCommandSender::ActionCommandSender(Arena::ISystem* pSystem)
+    : m_pGroupMask(ResolveNode<GenApi::CIntegerPtr>(pSystem->GetTLSystemNodeMap(), "ActionCommandGroupMask")),
+      m_pExecuteTime(ResolveNode<GenApi::CIntegerPtr>(pSystem->GetTLSystemNodeMap(), "ActionCommandExecuteTime")),
+      m_pFireCommand(ResolveNode<GenApi::CCommandPtr>(pSystem->GetTLSystemNodeMap(), "ActionCommandFireCommand")) {
+}
+
+void ActionCommandSender::Fire(int64_t groupMask, int64_t actionTime) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pGroupMask->SetValue(groupMask);
+    m_pExecuteTime->SetValue(actionTime);
+    m_pFireCommand->Execute();
+}
+
+ActionScheduler::ActionScheduler(ActionCommandSender& sender, int64_t groupMask, Arena::IDevice* pDeviceMaster, int64_t periodNs, int64_t leadNs, size_t framesAhead, uint32_t relatchIntervalMs)
+    : m_sender(sender),
+      m_group_mask(groupMask),
+      m_clock(pDeviceMaster, relatchIntervalMs),
+      m_period_ns(periodNs),
+      m_lead_ns(leadNs),
+      m_frames_ahead(framesAhead > 0 ? framesAhead : 1),
+      m_fired(0),
+      m_skipped(0) {
+}
+
+ActionScheduler::~ActionScheduler() {
+    Stop();
+}
+
+void ActionScheduler::Start() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_running)
+        return;
+    m_running = true;
+    m_fired_times.clear();
+    m_thread = std::thread(&ActionScheduler::Run, this);
+}
+
+void ActionScheduler::Stop() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+bool ActionScheduler::WaitNext(int64_t& actionTime) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return !m_running || !m_fired_times.empty(); });
+    if (m_fired_times.empty())
+        return false;
+
+    actionTime = m_fired_times.front();
+    m_fired_times.pop_front();
+    m_cv.notify_all();
+    return true;
+}
+
+void ActionScheduler::Run() {
+    try {
+        int64_t next = m_clock.Now() + m_lead_ns;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_running) {
+            m_cv.wait(lock, [this] { return !m_running || m_fired_times.size() < m_frames_ahead; });
+            if (!m_running)
+                break;
+            lock.unlock();
+
+            // keep on the period grid, skipping slots that are already too close to schedule
+            int64_t earliest = m_clock.Now() + m_lead_ns;
+            if (next < earliest) {
+                int64_t behind = (earliest - next + m_period_ns - 1) / m_period_ns;
+                next += behind * m_period_ns;
+                m_skipped += static_cast<uint64_t>(behind);
+            }
+
+            m_sender.Fire(m_group_mask, next);
+            m_fired++;
+
+            lock.lock();
+            m_fired_times.push_back(next);
+            m_cv.notify_all();
+            next += m_period_ns;
+        }
+    } catch (GenICam::GenericException& ge) {
+        std::cout << "\nGenICam exception thrown in action scheduler: " << ge.what() << "\n";
+        StopFromRun();
+    } catch (std::exception& ex) {
+        std::cout << "\nStandard exception thrown in action scheduler: " << ex.what() << "\n";
+        StopFromRun();
+    }
+}
+
+void ActionScheduler::StopFromRun() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_running = false;
+    m_cv.notify_all();
+}
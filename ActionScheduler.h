@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "ArenaApi.h"
+
+// Maps the host steady clock onto the PTP time of the Master camera so that
+// action times can be computed without a latch round trip on every frame.
+// The mapping is refreshed every relatchIntervalMs to bound drift. A relatch
+// runs under its own lock, so threads calling Now() together latch once and
+// never pair another thread's latch value with their own host time.
+class PtpClock {
+   public:
+    PtpClock(Arena::IDevice* pDeviceMaster, uint32_t relatchIntervalMs);
+
+    // current PTP time in ns
+    int64_t Now();
+
+    void Relatch();
+
+   private:
+    // needs m_latch_mutex
+    void LatchLocked();
+
+    GenApi::CCommandPtr m_pLatch;
+    GenApi::CIntegerPtr m_pLatchValue;
+    std::chrono::milliseconds m_relatch_interval;
+    std::mutex m_latch_mutex;  // held over the latch command and the value read
+    std::mutex m_mutex;        // guards the mapping
+    int64_t m_ptp_latch = 0;
+    std::chrono::steady_clock::time_point m_host_latch;
+};
+
+// Fires scheduled action commands through the GenTL system node map. The
+// command nodes are shared by every rig on the host, so setting the group
+// mask and execute time and firing happen under one lock.
+class ActionCommandSender {
+   public:
+    explicit ActionCommandSender(Arena::ISystem* pSystem);
+
+    void Fire(int64_t groupMask, int64_t actionTime);
+
+   private:
+    GenApi::CIntegerPtr m_pGroupMask;
+    GenApi::CIntegerPtr m_pExecuteTime;
+    GenApi::CCommandPtr m_pFireCommand;
+    std::mutex m_mutex;
+};
+
+// Keeps a queue of scheduled action commands ahead of the frame being processed.
+// A worker thread fires commands for groupMask on a fixed period grid through
+// ActionCommandExecuteTime/ActionCommandFireCommand, each at least leadNs before
+// it executes, and never more than framesAhead commands beyond what the
+// consumer has taken with WaitNext(). The command taken last may not have
+// executed yet, so up to framesAhead + 1 can be pending on a device. Slots
+// that can no longer be scheduled in time are skipped and counted.
+class ActionScheduler {
+   public:
+    ActionScheduler(ActionCommandSender& sender, int64_t groupMask, Arena::IDevice* pDeviceMaster, int64_t periodNs, int64_t leadNs, size_t framesAhead, uint32_t relatchIntervalMs);
+    ~ActionScheduler();
+
+    void Start();
+    void Stop();
+
+    // Blocks until the next fired action is available and returns its execute time.
+    // Returns false once the scheduler is stopped.
+    bool WaitNext(int64_t& actionTime);
+
+    PtpClock& Clock() { return m_clock; }
+    int64_t PeriodNs() const { return m_period_ns; }
+    size_t FramesAhead() const { return m_frames_ahead; }
+    uint64_t FiredCount() const { return m_fired; }
+    uint64_t SkippedSlots() const { return m_skipped; }
+
+   private:
+    void Run();
+
+    // wakes WaitNext() with no more actions once Run() has failed
+    void StopFromRun();
+
+    ActionCommandSender& m_sender;
+    int64_t m_group_mask;
+    PtpClock m_clock;
+    int64_t m_period_ns;
+    int64_t m_lead_ns;
+    size_t m_frames_ahead;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<int64_t> m_fired_times;
+    bool m_running = false;
+
+    std::atomic<uint64_t> m_fired;
+    std::atomic<uint64_t> m_skipped;
+};
@@ -0,0 +1,165 @@
+#include "AlignedDepth.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+// points projected and splatted at a time by a shard
+const size_t kBlockPoints = 256;
+
+// the bits of +infinity mark an empty pixel
+const uint32_t kEmpty = 0x7F800000u;
+
+inline uint32_t FloatBits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float BitsFloat(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline void AtomicMin(std::atomic<uint32_t>& cell, uint32_t value) {
+    uint32_t current = cell.load(std::memory_order_relaxed);
+    while (value < current && !cell.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+}  // namespace
+
+void AlignedDepthRenderer::Clear(int width, int height, WorkerPool& pool) {
+    size_t cells = static_cast<size_t>(width) * height;
+    if (cells != m_cells) {
+        m_nearest.reset(new std::atomic<uint32_t>[cells]);
+        m_cells = cells;
+    }
+    m_width = width;
+    m_height = height;
+    pool.ParallelFor(cells, [&](size_t begin, size_t end) {
+        for (size_t cell = begin; cell < end; cell++)
+            m_nearest[cell].store(kEmpty, std::memory_order_relaxed);
+    });
+}
+
+void AlignedDepthRenderer::Splat(const cv::Point2f* pProjected, const float* pDepth, size_t count) {
+    const int radius = std::max(m_settings.splatRadius, 0);
+    for (size_t i = 0; i < count; i++) {
+        // NaN and points behind the TRI fail here, as do points off the image
+        float x = pProjected[i].x;
+        float y = pProjected[i].y;
+        if (!(pDepth[i] > 0.0f && x > -0.5f && x < m_width - 0.5f && y > -0.5f && y < m_height - 0.5f))
+            continue;
+        int col = static_cast<int>(std::round(x));
+        int row = static_cast<int>(std::round(y));
+        uint32_t depth = FloatBits(pDepth[i]);
+        for (int r = std::max(row - radius, 0); r <= std::min(row + radius, m_height - 1); r++) {
+            std::atomic<uint32_t>* pRow = &m_nearest[static_cast<size_t>(r) * m_width];
+            for (int c = std::max(col - radius, 0); c <= std::min(col + radius, m_width - 1); c++)
+                AtomicMin(pRow[c], depth);
+        }
+    }
+}
+
+void AlignedDepthRenderer::Resolve(WorkerPool& pool) {
+    const bool millimeters = m_settings.format == AlignedDepthFormat::Millimeters16;
+    m_depth.create(m_height, m_width, millimeters ? CV_16UC1 : CV_32FC1);
+    const int fill = std::max(m_settings.fillRadius, 0);
+
+    std::vector<size_t> rowCovered(m_height);
+    pool.ParallelFor(static_cast<size_t>(m_height), [&](size_t rowBegin, size_t rowEnd) {
+        for (size_t row = rowBegin; row < rowEnd; row++) {
+            const std::atomic<uint32_t>* pRow = &m_nearest[row * m_width];
+            size_t covered = 0;
+            for (int col = 0; col < m_width; col++) {
+                uint32_t bits = pRow[col].load(std::memory_order_relaxed);
+
+                // reads the splatted depths only, so filled pixels do not spread
+                if (bits == kEmpty && fill > 0) {
+                    uint32_t farthest = 0;
+                    for (int r = std::max(static_cast<int>(row) - fill, 0); r <= std::min(static_cast<int>(row) + fill, m_height - 1); r++) {
+                        const std::atomic<uint32_t>* pNeighbours = &m_nearest[static_cast<size_t>(r) * m_width];
+                        for (int c = std::max(col - fill, 0); c <= std::min(col + fill, m_width - 1); c++) {
+                            uint32_t neighbour = pNeighbours[c].load(std::memory_order_relaxed);
+                            if (neighbour != kEmpty)
+                                farthest = std::max(farthest, neighbour);
+                        }
+                    }
+                    if (farthest != 0)
+                        bits = farthest;
+                }
+
+                float depth = bits == kEmpty ? 0.0f : BitsFloat(bits);
+                covered += depth > 0.0f ? 1 : 0;
+                if (millimeters)
+                    m_depth.ptr<uint16_t>(static_cast<int>(row))[col] = static_cast<uint16_t>(std::min(std::lround(depth), 65535L));
+                else
+                    m_depth.ptr<float>(static_cast<int>(row))[col] = depth;
+            }
+            rowCovered[row] = covered;
+        }
+    });
+
+    size_t covered = 0;
+    for (size_t n : rowCovered)
+        covered += n;
+    m_coverage = m_cells > 0 ? static_cast<double>(covered) / m_cells : 0.0;
+}
+
+void AlignedDepthRenderer::Render(const PointList& points, const PointProjector& projector, const DepthProjectionTable* pDepthTable, int width, int height, WorkerPool& pool) {
+    Clear(width, height, pool);
+    const bool packed = points.format != PointFormat::Float32;
+    pool.ParallelFor(points.size, 4 * pool.Threads(), [&](size_t begin, size_t end) {
+        float x[kBlockPoints];
+        float y[kBlockPoints];
+        float z[kBlockPoints];
+        float depth[kBlockPoints];
+        cv::Point2f projected[kBlockPoints];
+        for (size_t first = begin; first < end; first += kBlockPoints) {
+            size_t n = std::min(kBlockPoints, end - first);
+            // packed lists leave the float arrays empty, unpack into the block buffers
+            const float* pX = x;
+            const float* pY = y;
+            const float* pZ = z;
+            if (packed) {
+                SimdLevel level = DetectSimdLevel();
+                UnpackCoordinates(&points.x16[first], x, n, points.format, points.scale, points.offset[0], level);
+                UnpackCoordinates(&points.y16[first], y, n, points.format, points.scale, points.offset[1], level);
+                UnpackCoordinates(&points.z16[first], z, n, points.format, points.scale, points.offset[2], level);
+            } else {
+                pX = &points.x[first];
+                pY = &points.y[first];
+                pZ = &points.z[first];
+            }
+            if (pDepthTable)
+                pDepthTable->Project(pX, pY, pZ, &points.pixel[first], n, projected);
+            else
+                projector.Project(pX, pY, pZ, n, projected);
+            projector.Depth(pX, pY, pZ, n, depth);
+            Splat(projected, depth, n);
+        }
+    });
+    Resolve(pool);
+}
+
+void AlignedDepthRenderer::Render(const cv::Point3f* pPoints, size_t count, const PointProjector& projector, const DepthProjectionTable* pDepthTable, int width, int height, WorkerPool& pool) {
+    Clear(width, height, pool);
+    pool.ParallelFor(count, 4 * pool.Threads(), [&](size_t begin, size_t end) {
+        float depth[kBlockPoints];
+        cv::Point2f projected[kBlockPoints];
+        for (size_t first = begin; first < end; first += kBlockPoints) {
+            size_t n = std::min(kBlockPoints, end - first);
+            if (pDepthTable)
+                pDepthTable->Project(pPoints + first, n, first, projected);
+            else
+                projector.Project(pPoints + first, n, projected);
+            projector.Depth(pPoints + first, n, depth);
+            Splat(projected, depth, n);
+        }
+    });
+    Resolve(pool);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <opencv2/core.hpp>
+
+#include "DepthProjectionTable.h"
+#include "PointCloudDecoder.h"
+#include "PointProjector.h"
+#include "WorkerPool.h"
+
+// Pixel format of an aligned depth map, 0 where there is no depth
+enum class AlignedDepthFormat {
+    Millimeters16,  // CV_16UC1, depth in front of the TRI rounded to mm, saturated at 65535
+    Float32,        // CV_32FC1 in mm
+};
+
+struct AlignedDepthSettings {
+    AlignedDepthFormat format = AlignedDepthFormat::Millimeters16;
+    int splatRadius = 1;  // each point covers 2 * radius + 1 TRI pixels each way, about the spacing of the HLT points on the TRI032S
+    int fillRadius = 0;   // empty pixels take the farthest depth within this many pixels, 0 leaves them empty
+};
+
+// Depth map aligned pixel for pixel with the TRI image: the HLT points are
+// projected in shards over the worker pool and splatted into a shared
+// z-buffer with an atomic minimum, so the nearest surface wins whatever the
+// order and the number of threads. The z-buffer is then converted to the
+// output format in row bands, filling the holes on the way. Holes next to an
+// edge are mostly background the HLT did not see past the foreground, hence
+// the farthest neighbour.
+class AlignedDepthRenderer {
+   public:
+    explicit AlignedDepthRenderer(const AlignedDepthSettings& settings) : m_settings(settings) {}
+
+    // Renders the listed points, any format, onto a width x height TRI image
+    void Render(const PointList& points, const PointProjector& projector, const DepthProjectionTable* pDepthTable, int width, int height, WorkerPool& pool);
+
+    // Same for count interleaved points, point i being HLT pixel i; points
+    // at Z <= 0 are invalid and skipped
+    void Render(const cv::Point3f* pPoints, size_t count, const PointProjector& projector, const DepthProjectionTable* pDepthTable, int width, int height, WorkerPool& pool);
+
+    // the map of the last Render, reused between frames
+    const cv::Mat& Depth() const { return m_depth; }
+
+    // share of TRI pixels with a depth in the last Render
+    double Coverage() const { return m_coverage; }
+
+   private:
+    void Clear(int width, int height, WorkerPool& pool);
+    void Splat(const cv::Point2f* pProjected, const float* pDepth, size_t count);
+    void Resolve(WorkerPool& pool);
+
+    AlignedDepthSettings m_settings;
+    int m_width = 0;
+    int m_height = 0;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_nearest;  // float bits of the depth, positive floats order like their bits
+    size_t m_cells = 0;
+    cv::Mat m_depth;
+    double m_coverage = 0.0;
+};
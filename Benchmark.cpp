@@ -0,0 +1,900 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core.hpp>
+
+#include "AlignedDepth.h"
+#include "ColorOverlay.h"
+#include "DepthProjectionTable.h"
+#include "ImageRectifier.h"
+#include "PointCloudDecoder.h"
+#include "PointProjector.h"
+#include "SimulatedArena.h"
+#include "StreamBufferPool.h"
+
+// Micro benchmarks of the per-frame kernels of HLTRGB_PTP on synthetic
+// Helios2 sized frames, no cameras needed.
+//
+// usage: rgbd_bench [iterations] [max threads]
+//
+// Exits with 1 if any level, thread count or point format gives different
+// results where they must be identical, if the decode or the projection
+// leaves its reference, or if the stream buffer pool does not grow on a
+// starved simulated stream, so a short run doubles as a test.
+
+#define TAB1 "  "
+#define TAB2 "    "
+
+// Helios2 resolution
+#define BENCH_WIDTH 640
+#define BENCH_HEIGHT 480
+
+// TRI032S resolution
+#define BENCH_TRI_WIDTH 2048
+#define BENCH_TRI_HEIGHT 1536
+
+// share of invalid pixels in the synthetic frames
+#define BENCH_INVALID_RATIO 0.1
+
+// drops about a quarter of the synthetic intensities, which are uniform in 0..4095
+#define BENCH_INTENSITY_THRESHOLD 1024
+
+// largest distance of a PointProjector kernel from cv::projectPoints, px
+#define BENCH_PROJECTION_TOLERANCE_PX 1e-3
+
+namespace {
+// failed equality checks, rgbd_bench exits with 1 if there are any
+int g_failures = 0;
+
+// Text for the outcome of a check that must hold, counting it if it does not
+const char* Check(bool ok, const char* pass, const char* fail) {
+    if (!ok)
+        g_failures++;
+    return ok ? pass : fail;
+}
+
+// Median wall time of one call, ms
+template <typename Function>
+double MedianMs(Function function, int iterations) {
+    std::vector<double> times;
+    times.reserve(iterations);
+    function();  // warm up caches and page in the buffers
+    for (int i = 0; i < iterations; i++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        function();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+Scan3dCoefficients BenchCoefficients() {
+    Scan3dCoefficients coefficients;
+    coefficients.scale = 0.25;
+    coefficients.offsetX = -8192.0;
+    coefficients.offsetY = -8192.0;
+    coefficients.offsetZ = 0.0;
+    return coefficients;
+}
+
+// A wall 1.5 m in front of the HLT, tilted a little, with random invalid
+// pixels, encoded with BenchCoefficients
+std::vector<uint16_t> MakeABCY16Frame(size_t width, size_t height, double invalidRatio, uint32_t seed) {
+    Scan3dCoefficients coefficients = BenchCoefficients();
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 2.0);
+    double focal = 0.75 * width;
+    std::vector<uint16_t> frame(4 * width * height);
+    for (size_t row = 0; row < height; row++) {
+        for (size_t col = 0; col < width; col++) {
+            uint16_t* abcy = &frame[4 * (row * width + col)];
+            double z = 1500.0 + 0.2 * (col - width / 2.0) + noise(rng);
+            double xyz[3] = {(col - width / 2.0) / focal * z, (row - height / 2.0) / focal * z, z};
+            abcy[0] = static_cast<uint16_t>(std::lround((xyz[0] - coefficients.offsetX) / coefficients.scale));
+            abcy[1] = static_cast<uint16_t>(std::lround((xyz[1] - coefficients.offsetY) / coefficients.scale));
+            abcy[2] = static_cast<uint16_t>(std::lround((xyz[2] - coefficients.offsetZ) / coefficients.scale));
+            abcy[3] = static_cast<uint16_t>(rng() % 4096);
+            if (chance(rng) < invalidRatio)
+                abcy[rng() % 3] = 0xFFFF;
+        }
+    }
+    return frame;
+}
+
+// TRI 2048x1536 next to the HLT, 60 mm baseline, with some lens distortion
+OverlayCalibration BenchCalibration() {
+    OverlayCalibration calibration;
+    calibration.cameraMatrix = cv::Mat::zeros(3, 3, CV_64FC1);
+    calibration.cameraMatrix.at<double>(0, 0) = 1843.2;
+    calibration.cameraMatrix.at<double>(1, 1) = 1843.2;
+    calibration.cameraMatrix.at<double>(0, 2) = 1024.0;
+    calibration.cameraMatrix.at<double>(1, 2) = 768.0;
+    calibration.cameraMatrix.at<double>(2, 2) = 1.0;
+
+    const double distortion[5] = {-0.11, 0.06, 0.0008, -0.0005, -0.01};
+    calibration.distCoeffs = cv::Mat::zeros(1, 5, CV_64FC1);
+    std::copy(distortion, distortion + 5, calibration.distCoeffs.ptr<double>());
+
+    const double rotation[3] = {0.01, -0.02, 0.005};
+    calibration.rotationVector = cv::Mat::zeros(3, 1, CV_64FC1);
+    std::copy(rotation, rotation + 3, calibration.rotationVector.ptr<double>());
+
+    const double translation[3] = {-60.0, 0.0, 0.0};
+    calibration.translationVector = cv::Mat::zeros(3, 1, CV_64FC1);
+    std::copy(translation, translation + 3, calibration.translationVector.ptr<double>());
+    return calibration;
+}
+
+cv::Mat MakeRGBFrame(int width, int height, uint32_t seed) {
+    std::mt19937 rng(seed);
+    cv::Mat image(height, width, CV_8UC3);
+    for (size_t i = 0; i < image.total() * 3; i++)
+        image.data[i] = static_cast<uint8_t>(rng());
+    return image;
+}
+
+// The per-pixel loop the overlay used before DecodeABCY16, in double
+void ReferenceDecode(const uint16_t* input_data, float* pXYZ, size_t count, const Scan3dCoefficients& c) {
+    for (size_t i = 0; i < count; i++) {
+        uint16_t x_u16 = input_data[0];
+        uint16_t y_u16 = input_data[1];
+        uint16_t z_u16 = input_data[2];
+        if (x_u16 == 0xffff || y_u16 == 0xffff || z_u16 == 0xffff) {
+            pXYZ[3 * i + 0] = 0.0f;
+            pXYZ[3 * i + 1] = 0.0f;
+            pXYZ[3 * i + 2] = 0.0f;
+        } else {
+            pXYZ[3 * i + 0] = (float)(x_u16 * c.scale + c.offsetX);
+            pXYZ[3 * i + 1] = (float)(y_u16 * c.scale + c.offsetY);
+            pXYZ[3 * i + 2] = (float)(z_u16 * c.scale + c.offsetZ);
+        }
+        input_data += 4;
+    }
+}
+
+// The Coord3D_C16 frame of the same scene, pixels with any invalid coordinate invalid
+std::vector<uint16_t> ToC16Frame(const std::vector<uint16_t>& frameABCY16) {
+    std::vector<uint16_t> frame(frameABCY16.size() / 4);
+    for (size_t i = 0; i < frame.size(); i++) {
+        const uint16_t* abcy = &frameABCY16[4 * i];
+        frame[i] = (abcy[0] == 0xFFFF || abcy[1] == 0xFFFF) ? 0xFFFF : abcy[2];
+    }
+    return frame;
+}
+
+bool SamePoints(const PointList& a, const PointList& b) {
+    bool same = a.size == b.size;
+    for (size_t i = 0; same && i < a.size; i++)
+        same = a.x[i] == b.x[i] && a.y[i] == b.y[i] && a.z[i] == b.z[i] && a.intensity[i] == b.intensity[i] && a.pixel[i] == b.pixel[i];
+    return same;
+}
+
+double MaxAbsDifference(const std::vector<float>& a, const std::vector<float>& b) {
+    double difference = 0.0;
+    for (size_t i = 0; i < a.size(); i++)
+        difference = std::max(difference, std::fabs(static_cast<double>(a[i]) - b[i]));
+    return difference;
+}
+
+//
+// For the Coord3D_ABCY16 decode
+//
+void BenchDecode(int iterations) {
+    const size_t count = BENCH_WIDTH * BENCH_HEIGHT;
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    Scan3dCoefficients coefficients = BenchCoefficients();
+
+    std::vector<float> reference(3 * count);
+    double referenceMs = MedianMs([&]() { ReferenceDecode(frame.data(), reference.data(), count, coefficients); }, iterations);
+
+    std::cout << "Coord3D_ABCY16 decode, " << BENCH_WIDTH << "x" << BENCH_HEIGHT << ", " << BENCH_INVALID_RATIO * 100 << "% invalid, best level " << SimdLevelName(DetectSimdLevel()) << "\n";
+    std::cout << TAB1 << "reference: " << referenceMs << " ms\n";
+
+    std::vector<float> scalar(3 * count);
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2}) {
+        if (level > DetectSimdLevel())
+            continue;
+        std::vector<float> xyz(3 * count);
+        double ms = MedianMs([&]() { DecodeABCY16(frame.data(), xyz.data(), count, coefficients, level); }, iterations);
+        if (level == SimdLevel::Scalar)
+            scalar = xyz;
+
+        // BenchCoefficients scale and offset without rounding in float, so every level must give the reference exactly
+        double difference = MaxAbsDifference(xyz, reference);
+        std::cout << TAB1 << SimdLevelName(level) << ": " << ms << " ms, " << referenceMs / ms << "x, " << count / ms / 1000.0 << " Mpixel/s, max difference to reference "
+                  << difference << " mm, " << Check(difference == 0.0, "same as reference", "DIFFERS FROM REFERENCE") << ", "
+                  << Check(std::memcmp(xyz.data(), scalar.data(), xyz.size() * sizeof(float)) == 0, "identical to scalar", "DIFFERS FROM SCALAR") << "\n";
+    }
+
+    // keeping the intensity and dropping weak points on top
+    std::vector<float> scalarThreshold(3 * count);
+    std::vector<uint16_t> intensity(count);
+    DecodeABCY16(frame.data(), scalarThreshold.data(), intensity.data(), count, coefficients, BENCH_INTENSITY_THRESHOLD, SimdLevel::Scalar);
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2}) {
+        if (level > DetectSimdLevel())
+            continue;
+        std::vector<float> xyz(3 * count);
+        double ms = MedianMs([&]() { DecodeABCY16(frame.data(), xyz.data(), intensity.data(), count, coefficients, BENCH_INTENSITY_THRESHOLD, level); }, iterations);
+
+        std::cout << TAB1 << SimdLevelName(level) << " with intensity, threshold " << BENCH_INTENSITY_THRESHOLD << ": " << ms << " ms, "
+                  << Check(std::memcmp(xyz.data(), scalarThreshold.data(), xyz.size() * sizeof(float)) == 0, "identical to scalar", "DIFFERS FROM SCALAR") << "\n";
+    }
+
+    // packing the valid points into a list
+    PointList scalarPoints;
+    scalarPoints.Reserve(count);
+    scalarPoints.size = DecodeABCY16Compact(frame.data(), count, 0, coefficients, BENCH_INTENSITY_THRESHOLD, scalarPoints, 0, SimdLevel::Scalar);
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2}) {
+        if (level > DetectSimdLevel())
+            continue;
+        PointList points;
+        points.Reserve(count);
+        double ms = MedianMs([&]() { points.size = DecodeABCY16Compact(frame.data(), count, 0, coefficients, BENCH_INTENSITY_THRESHOLD, points, 0, level); }, iterations);
+
+        std::cout << TAB1 << SimdLevelName(level) << " into a valid point list, threshold " << BENCH_INTENSITY_THRESHOLD << ": " << ms << " ms, " << points.size << " points, "
+                  << Check(SamePoints(points, scalarPoints), "identical to scalar", "DIFFERS FROM SCALAR") << "\n";
+    }
+}
+
+//
+// For the depth-only Coord3D_C16 decode with a ray table
+//
+void BenchDepthOnly(int iterations) {
+    const size_t count = BENCH_WIDTH * BENCH_HEIGHT;
+    std::vector<uint16_t> frameABCY16 = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    std::vector<uint16_t> frameC16 = ToC16Frame(frameABCY16);
+    Scan3dCoefficients coefficients = BenchCoefficients();
+
+    // measured on another frame of the scene, as the rig does at startup
+    std::vector<uint16_t> frameRays = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 2);
+    RayTable intrinsics = RayTableFromIntrinsics(BENCH_WIDTH, BENCH_HEIGHT, 0.75 * BENCH_WIDTH, 0.75 * BENCH_WIDTH, BENCH_WIDTH / 2.0, BENCH_HEIGHT / 2.0);
+    RayTable rays = RayTableFromABCY16(frameRays.data(), BENCH_WIDTH, BENCH_HEIGHT, coefficients, intrinsics);
+
+    PointList full;
+    full.Reserve(count);
+    double fullMs = MedianMs([&]() { full.size = DecodeABCY16Compact(frameABCY16.data(), count, 0, coefficients, 0, full, 0, DetectSimdLevel()); }, iterations);
+
+    std::cout << "Coord3D_C16 decode with a ray table, " << BENCH_WIDTH << "x" << BENCH_HEIGHT << ", " << frameC16.size() * sizeof(uint16_t) << " bytes per frame against "
+              << frameABCY16.size() * sizeof(uint16_t) << " for Coord3D_ABCY16\n";
+    std::cout << TAB1 << "Coord3D_ABCY16 into a valid point list, " << SimdLevelName(DetectSimdLevel()) << ": " << fullMs << " ms, " << full.size << " points\n";
+
+    PointList scalarPoints;
+    scalarPoints.Reserve(count);
+    scalarPoints.size = DecodeC16Compact(frameC16.data(), count, 0, rays, coefficients, scalarPoints, 0, SimdLevel::Scalar);
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2}) {
+        if (level > DetectSimdLevel())
+            continue;
+        PointList points;
+        points.Reserve(count);
+        double ms = MedianMs([&]() { points.size = DecodeC16Compact(frameC16.data(), count, 0, rays, coefficients, points, 0, level); }, iterations);
+
+        std::cout << TAB1 << SimdLevelName(level) << " into a valid point list: " << ms << " ms, " << points.size << " points, "
+                  << Check(SamePoints(points, scalarPoints), "identical to scalar", "DIFFERS FROM SCALAR") << "\n";
+    }
+
+    // the rays come from another noisy frame, X and Y carry the noise in Z of both frames
+    double difference = 0.0;
+    bool samePixels = scalarPoints.size == full.size;
+    for (size_t i = 0; samePixels && i < full.size; i++) {
+        samePixels = scalarPoints.pixel[i] == full.pixel[i];
+        difference = std::max(difference, static_cast<double>(std::max(std::fabs(scalarPoints.x[i] - full.x[i]), std::fabs(scalarPoints.y[i] - full.y[i]))));
+    }
+    std::cout << TAB1 << "against Coord3D_ABCY16: " << Check(samePixels, "same points", "DIFFERENT POINTS") << ", max X and Y difference " << difference << " mm\n";
+}
+
+//
+// For the row-parallel decode on 1 to maxThreads threads
+//
+void BenchDecodeScaling(int iterations, size_t maxThreads) {
+    const size_t count = BENCH_WIDTH * BENCH_HEIGHT;
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    Scan3dCoefficients coefficients = BenchCoefficients();
+
+    std::vector<float> single(3 * count);
+    DecodeABCY16(frame.data(), single.data(), count, coefficients);
+
+    std::cout << "Row-parallel Coord3D_ABCY16 decode, " << SimdLevelName(DetectSimdLevel()) << ", 1.." << maxThreads << " threads\n";
+    double oneThreadMs = 0.0;
+    for (size_t threads = 1; threads <= maxThreads; threads++) {
+        WorkerPool pool(threads);
+        std::vector<float> xyz(3 * count);
+        double ms = MedianMs([&]() { DecodeABCY16Parallel(frame.data(), xyz.data(), NULL, BENCH_WIDTH, BENCH_HEIGHT, coefficients, 0, pool); }, iterations);
+        if (threads == 1)
+            oneThreadMs = ms;
+
+        std::cout << TAB1 << threads << " threads: " << ms << " ms, " << oneThreadMs / ms << "x, "
+                  << Check(std::memcmp(xyz.data(), single.data(), xyz.size() * sizeof(float)) == 0, "identical to single-threaded", "DIFFERS FROM SINGLE-THREADED") << "\n";
+    }
+}
+
+// Colors of the fused overlay agree with those of the separate passes at the pixels of the points
+bool SameColors(const PointList& points, const std::vector<uint8_t>& colors, const std::vector<float>& xyz, const std::vector<uint8_t>& passes) {
+    size_t valid = 0;
+    for (size_t i = 0; i < xyz.size() / 3; i++)
+        valid += (xyz[3 * i] != 0.0f || xyz[3 * i + 1] != 0.0f || xyz[3 * i + 2] != 0.0f) ? 1 : 0;
+    if (valid != points.size)
+        return false;
+    for (size_t i = 0; i < points.size; i++) {
+        if (std::memcmp(&colors[3 * i], &passes[3 * points.pixel[i]], 3) != 0)
+            return false;
+    }
+    return true;
+}
+
+//
+// For the projection onto the TRI image, cv::projectPoints against the
+// kernels of PointProjector for several sets of distortion terms
+//
+void BenchProjection(int iterations) {
+    const size_t count = BENCH_WIDTH * BENCH_HEIGHT;
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    std::vector<float> xyz(3 * count);
+    DecodeABCY16(frame.data(), xyz.data(), count, BenchCoefficients());
+    std::vector<float> x(count);
+    std::vector<float> y(count);
+    std::vector<float> z(count);
+    for (size_t i = 0; i < count; i++) {
+        x[i] = xyz[3 * i];
+        y[i] = xyz[3 * i + 1];
+        z[i] = xyz[3 * i + 2];
+    }
+
+    // BenchCalibration with more and more terms of the 14 coefficient model
+    struct DistortionSet {
+        const char* name;
+        int coefficients;
+        double values[14];
+    };
+    const DistortionSet sets[] = {
+        {"pinhole", 0, {0}},
+        {"radial, 5 coefficients with p1 = p2 = 0", 5, {-0.11, 0.06, 0.0, 0.0, -0.01}},
+        {"radial and tangential, 5 coefficients", 5, {-0.11, 0.06, 0.0008, -0.0005, -0.01}},
+        {"rational, 8 coefficients", 8, {-0.11, 0.06, 0.0008, -0.0005, -0.01, 0.02, -0.01, 0.005}},
+        {"thin prism, 12 coefficients", 12, {-0.11, 0.06, 0.0008, -0.0005, -0.01, 0.02, -0.01, 0.005, 0.001, -0.0004, 0.0006, 0.0002}},
+        {"tilt, 14 coefficients", 14, {-0.11, 0.06, 0.0008, -0.0005, -0.01, 0.02, -0.01, 0.005, 0.001, -0.0004, 0.0006, 0.0002, 0.002, -0.001}},
+    };
+
+    std::cout << "Projection of " << count << " points onto " << BENCH_TRI_WIDTH << "x" << BENCH_TRI_HEIGHT << "\n";
+    for (const DistortionSet& set : sets) {
+        OverlayCalibration calibration = BenchCalibration();
+        calibration.distCoeffs = cv::Mat::zeros(1, std::max(set.coefficients, 4), CV_64FC1);
+        std::copy(set.values, set.values + set.coefficients, calibration.distCoeffs.ptr<double>());
+        PointProjector projector(calibration);
+
+        cv::Mat reference;
+        double openCVMs = MedianMs([&]() { cv::projectPoints(cv::Mat(static_cast<int>(count), 1, CV_32FC3, xyz.data()), calibration.rotationVector, calibration.translationVector, calibration.cameraMatrix, calibration.distCoeffs, reference); }, iterations);
+        const cv::Point2f* pReference = reference.ptr<cv::Point2f>();
+        std::cout << TAB1 << set.name << ", terms " << projector.TermNames() << ", cv::projectPoints: " << openCVMs << " ms\n";
+
+        std::vector<cv::Point2f> scalar(count);
+        for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::AVX2}) {
+            if (level > DetectSimdLevel())
+                continue;
+            std::vector<cv::Point2f> projected(count);
+            double ms = MedianMs([&]() { projector.Project(x.data(), y.data(), z.data(), count, projected.data(), level); }, iterations);
+            if (level == SimdLevel::Scalar)
+                scalar = projected;
+
+            double difference = 0.0;
+            size_t moved = 0;
+            for (size_t i = 0; i < count; i++) {
+                difference = std::max(difference, static_cast<double>(std::max(std::fabs(projected[i].x - pReference[i].x), std::fabs(projected[i].y - pReference[i].y))));
+                moved += (std::round(projected[i].x) != std::round(pReference[i].x) || std::round(projected[i].y) != std::round(pReference[i].y)) ? 1 : 0;
+            }
+            std::cout << TAB2 << SimdLevelName(level) << ": " << ms << " ms, " << openCVMs / ms << "x, max difference to OpenCV " << difference << " px, " << moved << " nearest pixels differ, "
+                      << Check(difference <= BENCH_PROJECTION_TOLERANCE_PX, "agrees with OpenCV", "DISAGREES WITH OPENCV") << ", "
+                      << Check(std::memcmp(projected.data(), scalar.data(), count * sizeof(cv::Point2f)) == 0, "identical to scalar", "DIFFERS FROM SCALAR") << "\n";
+        }
+    }
+}
+
+//
+// For the depth table against exact projection of the valid points, with
+// more and more depths per pixel and with a table built to an error limit
+//
+void BenchDepthTable(int iterations) {
+    const size_t count = BENCH_WIDTH * BENCH_HEIGHT;
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    Scan3dCoefficients coefficients = BenchCoefficients();
+    PointProjector projector(BenchCalibration());
+    WorkerPool pool(1);
+
+    // measured on another frame of the scene, as the rig does at startup
+    std::vector<uint16_t> frameRays = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 2);
+    RayTable intrinsics = RayTableFromIntrinsics(BENCH_WIDTH, BENCH_HEIGHT, 0.75 * BENCH_WIDTH, 0.75 * BENCH_WIDTH, BENCH_WIDTH / 2.0, BENCH_HEIGHT / 2.0);
+    RayTable rays = RayTableFromABCY16(frameRays.data(), BENCH_WIDTH, BENCH_HEIGHT, coefficients, intrinsics);
+
+    PointList points;
+    points.Reserve(count);
+    points.size = DecodeABCY16Compact(frame.data(), count, 0, coefficients, 0, points, 0, DetectSimdLevel());
+    std::vector<cv::Point2f> exact(points.size);
+    double exactMs = MedianMs([&]() { projector.Project(points.x.data(), points.y.data(), points.z.data(), points.size, exact.data()); }, iterations);
+
+    std::cout << "Depth table projection of " << points.size << " valid points, terms " << projector.TermNames() << ", exact: " << exactMs << " ms\n";
+    DepthTableSettings settings;
+    settings.imageWidth = BENCH_TRI_WIDTH;
+    settings.imageHeight = BENCH_TRI_HEIGHT;
+    for (float maxErrorPx : {0.0f, 0.05f}) {
+        for (size_t samples : {4, 8, 16, 32}) {
+            if (maxErrorPx > 0.0f && samples > 4)
+                break;
+            settings.samples = samples;
+            settings.maxErrorPx = maxErrorPx;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            DepthProjectionTable table(projector, rays, settings, pool);
+            double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::vector<cv::Point2f> projected(points.size);
+            double ms = MedianMs([&]() { table.Project(points.x.data(), points.y.data(), points.z.data(), points.pixel.data(), points.size, projected.data()); }, iterations);
+
+            // the points lie on their pixel's ray only up to the noise of both frames
+            double difference = 0.0;
+            size_t moved = 0;
+            for (size_t i = 0; i < points.size; i++) {
+                difference = std::max(difference, std::hypot(static_cast<double>(projected[i].x - exact[i].x), static_cast<double>(projected[i].y - exact[i].y)));
+                moved += (std::round(projected[i].x) != std::round(exact[i].x) || std::round(projected[i].y) != std::round(exact[i].y)) ? 1 : 0;
+            }
+            const DepthTableAccuracy& accuracy = table.Accuracy();
+            std::cout << TAB1 << accuracy.samples << " depths" << (maxErrorPx > 0.0f ? ", built to " + std::to_string(maxErrorPx) + " px" : "") << ", " << table.Bytes() / (1024 * 1024) << " MiB, built in " << buildMs
+                      << " ms, table error max " << accuracy.maxErrorPx << " px mean " << accuracy.meanErrorPx << " px\n";
+            std::cout << TAB2 << ms << " ms, " << exactMs / ms << "x, max difference to exact " << difference << " px, " << moved << " nearest pixels differ\n";
+        }
+    }
+}
+
+//
+// For rectifying the TRI image, the remap over more and more threads against
+// the distortion it saves on the projection of a full HLT frame
+//
+void BenchRectify(int iterations, size_t maxThreads) {
+    const size_t count = BENCH_WIDTH * BENCH_HEIGHT;
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    std::vector<float> xyz(3 * count);
+    DecodeABCY16(frame.data(), xyz.data(), count, BenchCoefficients());
+    cv::Mat imageRGB = MakeRGBFrame(BENCH_TRI_WIDTH, BENCH_TRI_HEIGHT, 2);
+    const cv::Point3f* pPoints = reinterpret_cast<const cv::Point3f*>(xyz.data());
+
+    PointProjector projector(BenchCalibration());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ImageRectifier rectifier(BenchCalibration(), BENCH_TRI_WIDTH, BENCH_TRI_HEIGHT, 0.0);
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const PointProjector& pinhole = rectifier.Projector();
+
+    std::vector<cv::Point2f> projected(count);
+    double distortedMs = MedianMs([&]() { projector.Project(pPoints, count, projected.data()); }, iterations);
+    double pinholeMs = MedianMs([&]() { pinhole.Project(pPoints, count, projected.data()); }, iterations);
+    std::cout << "Rectified TRI " << BENCH_TRI_WIDTH << "x" << BENCH_TRI_HEIGHT << ", " << rectifier.Bytes() / (1024 * 1024) << " MiB of remap tables built in " << buildMs << " ms\n";
+    std::cout << TAB1 << "projection of " << count << " points, terms " << projector.TermNames() << ": " << distortedMs << " ms, pinhole: " << pinholeMs << " ms\n";
+
+    cv::Mat rectified;
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        WorkerPool pool(threads);
+        double ms = MedianMs([&]() { rectifier.Rectify(imageRGB, rectified, pool); }, iterations);
+        std::cout << TAB2 << "remap, " << threads << " threads: " << ms << " ms, pinhole and remap " << (ms + pinholeMs < distortedMs ? "faster" : "slower") << " than projecting with distortion by "
+                  << std::fabs(distortedMs - pinholeMs - ms) << " ms\n";
+    }
+}
+
+//
+// For the color sampling modes on a full frame of projected points, at every
+// SIMD level, with the cost of preparing the frame
+//
+void BenchSampling(int iterations, size_t maxThreads) {
+    const size_t count = BENCH_WIDTH * BENCH_HEIGHT;
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    std::vector<float> xyz(3 * count);
+    std::vector<uint16_t> intensity(count);
+    DecodeABCY16(frame.data(), xyz.data(), intensity.data(), count, BenchCoefficients(), 0, DetectSimdLevel());
+    std::vector<cv::Point2f> projected(count);
+    PointProjector(BenchCalibration()).Project(reinterpret_cast<const cv::Point3f*>(xyz.data()), count, projected.data());
+    cv::Mat imageRGB = MakeRGBFrame(BENCH_TRI_WIDTH, BENCH_TRI_HEIGHT, 2);
+    WorkerPool pool(maxThreads);
+
+    std::cout << "Color sampling of " << count << " projected points\n";
+    for (ColorSampling sampling : {ColorSampling::Nearest, ColorSampling::Bilinear, ColorSampling::Area}) {
+        OverlayOptions options;
+        options.grayFallback = true;
+        options.sampling = sampling;
+        ColorSampler sampler;
+        double prepareMs = MedianMs([&]() { sampler.Prepare(imageRGB, options, pool); }, iterations);
+        std::cout << TAB1 << ColorSamplingName(sampling) << (sampling == ColorSampling::Area ? ", " + std::to_string(options.areaSize) + " px box" : "") << ", prepare on " << maxThreads << " threads: " << prepareMs << " ms\n";
+
+        std::vector<uint8_t> scalar;
+        for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE41}) {
+            if (level > DetectSimdLevel())
+                continue;
+            std::vector<uint8_t> colors(3 * count);
+            double ms = MedianMs([&]() { sampler.Sample(projected.data(), intensity.data(), count, colors.data(), level); }, iterations);
+            if (level == SimdLevel::Scalar)
+                scalar = colors;
+            std::cout << TAB2 << SimdLevelName(level) << ": " << ms << " ms, " << 1000000.0 * ms / count << " ns per point, " << Check(colors == scalar, "identical to scalar", "DIFFERS FROM SCALAR") << "\n";
+        }
+    }
+}
+
+//
+// For the overlay, separate full frame passes against the fused tiles of
+// valid points, with all points kept and with about half dropped by intensity
+//
+void BenchOverlay(int iterations, size_t maxThreads) {
+    const size_t count = BENCH_WIDTH * BENCH_HEIGHT;
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    Scan3dCoefficients coefficients = BenchCoefficients();
+    OverlayCalibration calibration = BenchCalibration();
+    PointProjector projector(calibration);
+    cv::Mat imageRGB = MakeRGBFrame(BENCH_TRI_WIDTH, BENCH_TRI_HEIGHT, 2);
+
+    std::cout << "Overlay decode, project and color, " << BENCH_WIDTH << "x" << BENCH_HEIGHT << " onto " << BENCH_TRI_WIDTH << "x" << BENCH_TRI_HEIGHT << "\n";
+
+    for (uint16_t threshold : {0, 2048}) {
+        OverlayOptions options;
+        options.intensityThreshold = threshold;
+        options.grayFallback = true;
+
+        // as OverlayColorOnto3DAndSave does without g_fused_overlay, one thread
+        std::vector<float> xyz(3 * count);
+        std::vector<uint16_t> intensity(count);
+        std::vector<uint8_t> passes(3 * count);
+        cv::Mat projected;
+        double passesMs = MedianMs([&]() {
+            std::fill(passes.begin(), passes.end(), 0);
+            DecodeABCY16(frame.data(), xyz.data(), intensity.data(), count, coefficients, options.intensityThreshold, DetectSimdLevel());
+            cv::projectPoints(cv::Mat(static_cast<int>(count), 1, CV_32FC3, xyz.data()), calibration.rotationVector, calibration.translationVector, calibration.cameraMatrix, calibration.distCoeffs, projected);
+            SampleNearestColor(projected.ptr<cv::Point2f>(), intensity.data(), count, imageRGB, options, passes.data());
+        }, iterations);
+        std::cout << TAB1 << "intensity threshold " << threshold << ", separate passes, 1 thread: " << passesMs << " ms\n";
+
+        std::vector<size_t> threadCounts = {1};
+        if (maxThreads > 1)
+            threadCounts.push_back(maxThreads);
+        for (size_t threads : threadCounts) {
+            WorkerPool pool(threads);
+            ColorSampler sampler;
+            sampler.Prepare(imageRGB, options, pool);
+            for (size_t tileRows : {4, 16, 64}) {
+                PointList points;
+                std::vector<uint8_t> colors;
+                double ms = MedianMs([&]() { DecodeProjectColorFused(frame.data(), BENCH_WIDTH, BENCH_HEIGHT, coefficients, NULL, projector, NULL, NULL, options, sampler, points, colors, pool, tileRows); }, iterations);
+
+                std::cout << TAB2 << "fused, " << tileRows << " row tiles, " << threads << " threads: " << ms << " ms, " << passesMs / ms << "x, " << points.size << " points, "
+                          << Check(SameColors(points, colors, xyz, passes), "same colors", "COLORS DIFFER") << "\n";
+            }
+        }
+    }
+}
+
+//
+// For the overlay spread over 1 to maxThreads threads, doubling: the full
+// frame passes with sharded projection and sampling, and the fused tiles
+//
+void BenchOverlayScaling(int iterations, size_t maxThreads) {
+    const size_t count = BENCH_WIDTH * BENCH_HEIGHT;
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    Scan3dCoefficients coefficients = BenchCoefficients();
+    PointProjector projector(BenchCalibration());
+    cv::Mat imageRGB = MakeRGBFrame(BENCH_TRI_WIDTH, BENCH_TRI_HEIGHT, 2);
+    OverlayOptions options;
+    options.grayFallback = true;
+
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    std::cout << "Overlay scaling, " << std::thread::hardware_concurrency() << " cores, rgbd_bench <iterations> 16 for 1 to 16 threads\n";
+    std::vector<uint8_t> singlePasses;
+    std::vector<uint8_t> singleFused;
+    double passesOneMs = 0.0;
+    double fusedOneMs = 0.0;
+    for (size_t threads : threadCounts) {
+        WorkerPool pool(threads);
+        ColorSampler sampler;
+        sampler.Prepare(imageRGB, options, pool);
+
+        std::vector<float> xyz(3 * count);
+        std::vector<uint16_t> intensity(count);
+        std::vector<uint8_t> passes(3 * count);
+        double passesMs = MedianMs([&]() {
+            std::fill(passes.begin(), passes.end(), 0);
+            DecodeABCY16Parallel(frame.data(), xyz.data(), intensity.data(), BENCH_WIDTH, BENCH_HEIGHT, coefficients, 0, pool);
+            ProjectColorParallel(reinterpret_cast<const cv::Point3f*>(xyz.data()), intensity.data(), count, projector, NULL, NULL, sampler, passes.data(), pool);
+        }, iterations);
+
+        PointList points;
+        std::vector<uint8_t> colors;
+        double fusedMs = MedianMs([&]() { DecodeProjectColorFused(frame.data(), BENCH_WIDTH, BENCH_HEIGHT, coefficients, NULL, projector, NULL, NULL, options, sampler, points, colors, pool, 16); }, iterations);
+        colors.resize(3 * points.size);
+
+        if (threads == 1) {
+            singlePasses = passes;
+            singleFused = colors;
+            passesOneMs = passesMs;
+            fusedOneMs = fusedMs;
+        }
+        // speedup per thread, only meaningful while every thread has a core of its own
+        bool identical = passes == singlePasses && colors == singleFused;
+        std::cout << TAB1 << threads << " threads: sharded passes " << passesMs << " ms, " << passesOneMs / passesMs << "x, fused " << fusedMs << " ms, " << fusedOneMs / fusedMs << "x, "
+                  << 100.0 * fusedOneMs / fusedMs / threads << "% efficiency, " << Check(identical, "identical to single-threaded", "DIFFERS FROM SINGLE-THREADED")
+                  << (threads > std::thread::hardware_concurrency() ? ", MORE THREADS THAN CORES" : "") << "\n";
+    }
+}
+
+//
+// For the occlusion test of the fused overlay, at several z-buffer
+// resolutions and thread counts. The synthetic wall hides nothing, so every
+// point should stay visible.
+//
+// Two planes parallel to the TRI image, the near one at 1 m covering the
+// middle of the far one at 2 m with the same point spacing and its edges on
+// cell boundaries: exactly the far points behind the near plane must be
+// occluded, for any cell size and number of parts.
+// The far points come first, so the near ones are splatted by other parts.
+void CheckOcclusionPlanes(size_t maxThreads) {
+    const int width = 400;
+    const int height = 300;
+    std::vector<cv::Point2f> projected;
+    std::vector<float> depth;
+    std::vector<uint8_t> behind;
+    for (float planeDepth : {2000.0f, 1000.0f}) {
+        bool near = planeDepth < 1500.0f;
+        for (int row = 0; row < height; row++) {
+            for (int col = 0; col < width; col++) {
+                bool middle = col >= 100 && col < 300 && row >= 52 && row < 252;
+                if (near && !middle)
+                    continue;
+                projected.push_back(cv::Point2f(col + (near ? 0.25f : 0.0f), row - (near ? 0.25f : 0.0f)));
+                depth.push_back(planeDepth);
+                behind.push_back(!near && middle ? 1 : 0);
+            }
+        }
+    }
+    size_t expected = static_cast<size_t>(std::count(behind.begin(), behind.end(), 1));
+
+    std::cout << TAB1 << "near plane over a far plane, " << projected.size() << " points, " << expected << " behind:";
+    for (size_t threads : {size_t(1), maxThreads}) {
+        WorkerPool pool(threads);
+        for (int shift : {0, 2}) {
+            OcclusionSettings settings;
+            settings.shift = shift;
+            OcclusionBuffer occlusion(settings);
+            std::vector<cv::Point2f> points = projected;
+            size_t occluded = occlusion.Resolve(points.data(), depth.data(), points.size(), width, height, pool);
+            bool marked = occluded == expected && occlusion.Occluded() == behind;
+            for (size_t i = 0; marked && i < points.size(); i++)
+                marked = behind[i] ? std::isnan(points[i].x) : points[i] == projected[i];
+            std::cout << " " << threads << " threads " << (width >> shift) << "x" << (height >> shift) << " cells " << Check(marked, "far points marked", "WRONG POINTS MARKED") << ",";
+        }
+    }
+    std::cout << "\n";
+}
+
+void BenchOcclusion(int iterations, size_t maxThreads) {
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    Scan3dCoefficients coefficients = BenchCoefficients();
+    PointProjector projector(BenchCalibration());
+    cv::Mat imageRGB = MakeRGBFrame(BENCH_TRI_WIDTH, BENCH_TRI_HEIGHT, 2);
+    OverlayOptions options;
+    const int shifts[] = {0, 1, 2, 3};
+    std::vector<uint8_t> singleOccluded[4];
+
+    std::cout << "Occlusion test of the fused overlay\n";
+    CheckOcclusionPlanes(maxThreads);
+    for (size_t threads : {size_t(1), maxThreads}) {
+        WorkerPool pool(threads);
+        ColorSampler sampler;
+        sampler.Prepare(imageRGB, options, pool);
+        PointList points;
+        std::vector<uint8_t> colors;
+        double plainMs = MedianMs([&]() { DecodeProjectColorFused(frame.data(), BENCH_WIDTH, BENCH_HEIGHT, coefficients, NULL, projector, NULL, NULL, options, sampler, points, colors, pool, 16); }, iterations);
+        std::cout << TAB1 << threads << " threads, without the test: " << plainMs << " ms\n";
+
+        for (size_t s = 0; s < 4; s++) {
+            OcclusionSettings settings;
+            settings.shift = shifts[s];
+            OcclusionBuffer occlusion(settings);
+            double ms = MedianMs([&]() { DecodeProjectColorFused(frame.data(), BENCH_WIDTH, BENCH_HEIGHT, coefficients, NULL, projector, NULL, &occlusion, options, sampler, points, colors, pool, 16); }, iterations);
+            if (threads == 1)
+                singleOccluded[s] = occlusion.Occluded();
+            std::cout << TAB2 << (BENCH_TRI_WIDTH >> shifts[s]) << "x" << (BENCH_TRI_HEIGHT >> shifts[s]) << " cells: " << ms << " ms, " << ms - plainMs << " ms for the test, " << occlusion.OccludedCount() << " of " << points.size
+                      << " points occluded, " << Check(occlusion.Occluded() == singleOccluded[s], "same points as single-threaded", "OTHER POINTS THAN SINGLE-THREADED") << "\n";
+        }
+    }
+}
+
+//
+// For the depth map aligned with the TRI image, from the points of the fused
+// overlay, with and without hole filling. The map must not depend on the
+// number of threads.
+//
+void BenchAlignedDepth(int iterations, size_t maxThreads) {
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    Scan3dCoefficients coefficients = BenchCoefficients();
+    PointProjector projector(BenchCalibration());
+    cv::Mat imageRGB = MakeRGBFrame(BENCH_TRI_WIDTH, BENCH_TRI_HEIGHT, 2);
+    OverlayOptions options;
+    WorkerPool decodePool(1);
+    ColorSampler sampler;
+    sampler.Prepare(imageRGB, options, decodePool);
+    PointList points;
+    std::vector<uint8_t> colors;
+    DecodeProjectColorFused(frame.data(), BENCH_WIDTH, BENCH_HEIGHT, coefficients, NULL, projector, NULL, NULL, options, sampler, points, colors, decodePool, 16);
+
+    std::cout << "Depth aligned with the " << BENCH_TRI_WIDTH << "x" << BENCH_TRI_HEIGHT << " TRI image, " << points.size << " points\n";
+    for (AlignedDepthFormat format : {AlignedDepthFormat::Millimeters16, AlignedDepthFormat::Float32}) {
+        for (int fillRadius : {0, 2}) {
+            AlignedDepthSettings settings;
+            settings.format = format;
+            settings.fillRadius = fillRadius;
+            std::cout << TAB1 << (format == AlignedDepthFormat::Float32 ? "float32" : "16 bit mm") << ", fill radius " << fillRadius << "\n";
+
+            cv::Mat reference;
+            for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+                WorkerPool pool(threads);
+                AlignedDepthRenderer renderer(settings);
+                double ms = MedianMs([&]() { renderer.Render(points, projector, NULL, BENCH_TRI_WIDTH, BENCH_TRI_HEIGHT, pool); }, iterations);
+                const cv::Mat& depth = renderer.Depth();
+                if (threads == 1)
+                    reference = depth.clone();
+                bool identical = std::memcmp(depth.data, reference.data, depth.total() * depth.elemSize()) == 0;
+                std::cout << TAB2 << threads << " threads: " << ms << " ms, " << 100.0 * renderer.Coverage() << "% of the pixels, " << Check(identical, "identical to single-threaded", "DIFFERS FROM SINGLE-THREADED") << "\n";
+            }
+        }
+    }
+}
+
+//
+// For the point formats of the fused overlay: time, memory per point and
+// error against float32
+//
+void BenchPointFormats(int iterations) {
+    std::vector<uint16_t> frame = MakeABCY16Frame(BENCH_WIDTH, BENCH_HEIGHT, BENCH_INVALID_RATIO, 1);
+    Scan3dCoefficients coefficients = BenchCoefficients();
+    PointProjector projector(BenchCalibration());
+    cv::Mat imageRGB = MakeRGBFrame(BENCH_TRI_WIDTH, BENCH_TRI_HEIGHT, 2);
+    OverlayOptions options;
+    WorkerPool pool(1);
+    ColorSampler sampler;
+    sampler.Prepare(imageRGB, options, pool);
+
+    std::cout << "Point formats of the fused overlay, 16 row tiles, 1 thread\n";
+
+    PointList reference;
+    std::vector<uint8_t> referenceColors;
+    for (PointFormat format : {PointFormat::Float32, PointFormat::Float16, PointFormat::Scaled16}) {
+        PointList points;
+        points.format = format;
+        std::vector<uint8_t> colors;
+        double ms = MedianMs([&]() { DecodeProjectColorFused(frame.data(), BENCH_WIDTH, BENCH_HEIGHT, coefficients, NULL, projector, NULL, NULL, options, sampler, points, colors, pool, 16); }, iterations);
+
+        size_t coordinateBytes = format == PointFormat::Float32 ? sizeof(float) : sizeof(uint16_t);
+        std::cout << TAB1 << PointFormatName(format) << ": " << ms << " ms, " << 3 * coordinateBytes + sizeof(uint16_t) + sizeof(uint32_t) << " bytes per listed point, "
+                  << (format == PointFormat::Scaled16 ? 11 : 17) << " per PLY record";
+        if (format == PointFormat::Float32) {
+            reference = points;
+            referenceColors = colors;
+            std::cout << "\n";
+            continue;
+        }
+
+        // back to float at every level, against the float32 list
+        std::vector<float> scalar(3 * points.size);
+        double error = 0.0;
+        bool identical = true;
+        for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2}) {
+            if (level > DetectSimdLevel())
+                continue;
+            std::vector<float> xyz(3 * points.size);
+            UnpackCoordinates(points.x16.data(), xyz.data(), points.size, format, points.scale, points.offset[0], level);
+            UnpackCoordinates(points.y16.data(), xyz.data() + points.size, points.size, format, points.scale, points.offset[1], level);
+            UnpackCoordinates(points.z16.data(), xyz.data() + 2 * points.size, points.size, format, points.scale, points.offset[2], level);
+            if (level == SimdLevel::Scalar)
+                scalar = xyz;
+            identical = identical && std::memcmp(xyz.data(), scalar.data(), xyz.size() * sizeof(float)) == 0;
+
+            std::vector<uint16_t> packed(points.size);
+            PackCoordinates(reference.x.data(), packed.data(), points.size, format, points.scale, points.offset[0], level);
+            identical = identical && std::equal(packed.begin(), packed.end(), points.x16.begin());
+        }
+        for (size_t i = 0; i < points.size; i++) {
+            error = std::max(error, static_cast<double>(std::fabs(scalar[i] - reference.x[i])));
+            error = std::max(error, static_cast<double>(std::fabs(scalar[points.size + i] - reference.y[i])));
+            error = std::max(error, static_cast<double>(std::fabs(scalar[2 * points.size + i] - reference.z[i])));
+        }
+        bool sameColors = points.size == reference.size && std::equal(colors.begin(), colors.begin() + 3 * points.size, referenceColors.begin());
+        std::cout << ", max error " << error << " mm, " << Check(sameColors, "same colors", "COLORS DIFFER") << ", levels " << Check(identical, "identical", "DIFFER") << "\n";
+    }
+}
+
+// Takes each image and hands the buffer straight back
+class DiscardImages : public Arena::IImageCallback {
+   public:
+    void OnImage(Arena::IImage*) override {}
+};
+
+// Free-runs a simulated HLT into a pool started with too few buffers while
+// nothing takes the frames, so StreamInputBufferCount reaches 0 and the pool
+// has to grow; then with a callback taking every frame, where it has to keep
+// its count
+void BenchStreamBuffers() {
+    std::cout << "stream buffer pool on a simulated HLT at 30 fps:\n";
+    SimulationParams params;
+    params.widthHLT = 64;
+    params.heightHLT = 48;
+    SimulatedSystem system(params);
+    Arena::IDevice* pDevice = system.CreateDevice(system.Devices()[0].serialNumber);
+    const int64_t periodNs = static_cast<int64_t>(1000000000.0 / params.maxFrameRateHLT);
+    const size_t minBuffers = 2;
+    {
+        StreamBufferPool pool(pDevice, "HLT", minBuffers, 16);
+        pool.Start(minBuffers);
+        std::this_thread::sleep_for(std::chrono::nanoseconds(4 * minBuffers * periodNs));
+        pool.Sample();
+        bool changed = pool.Update(periodNs, 0, 1);
+        bool restarted = pool.ApplyTarget();
+        std::cout << TAB1 << "starved: " << minBuffers << " -> " << pool.BufferCount() << " buffers, "
+                  << Check(changed && restarted && pool.BufferCount() > minBuffers, "grown", "NOT GROWN") << "\n";
+
+        DiscardImages discard;
+        pDevice->RegisterImageCallback(&discard);
+        size_t before = pool.BufferCount();
+        for (int i = 0; i < 10; i++) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(periodNs));
+            pool.Sample();
+        }
+        changed = pool.Update(periodNs, 0, 1);
+        restarted = pool.ApplyTarget();
+        std::cout << TAB1 << "consumed: " << before << " -> " << pool.BufferCount() << " buffers, "
+                  << Check(!changed && !restarted && pool.BufferCount() == before, "kept", "CHANGED") << "\n";
+        pool.Stop();
+        pDevice->DeregisterImageCallback(&discard);
+    }
+    system.DestroyDevice(pDevice);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 200;
+    size_t maxThreads = argc > 2 ? std::max(1, std::atoi(argv[2])) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "rgbd_bench, median of " << iterations << " iterations\n\n";
+    BenchDecode(iterations);
+    std::cout << "\n";
+    BenchDepthOnly(iterations);
+    std::cout << "\n";
+    BenchDecodeScaling(iterations, maxThreads);
+    std::cout << "\n";
+    BenchProjection(iterations);
+    std::cout << "\n";
+    BenchDepthTable(iterations);
+    std::cout << "\n";
+    BenchRectify(iterations, maxThreads);
+    std::cout << "\n";
+    BenchSampling(iterations, maxThreads);
+    std::cout << "\n";
+    BenchOverlay(iterations, maxThreads);
+    std::cout << "\n";
+    BenchOverlayScaling(iterations, maxThreads);
+    std::cout << "\n";
+    BenchOcclusion(iterations, maxThreads);
+    std::cout << "\n";
+    BenchAlignedDepth(iterations, maxThreads);
+    std::cout << "\n";
+    BenchPointFormats(iterations);
+    std::cout << "\n";
+    BenchStreamBuffers();
+
+    if (g_failures > 0) {
+        std::cout << "\n" << g_failures << " CHECKS FAILED\n";
+        return 1;
+    }
+    return 0;
+}
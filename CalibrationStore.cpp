@@ -0,0 +1,121 @@
+#include "CalibrationStore.h"
+
+#include <iostream>
+#include <opencv2/core.hpp>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// how often the watch thread checks for Stop()
+const int kPollIntervalMs = 250;
+
+// editors and calibration tools often write a new file and rename it over
+// the old one, so the directory is watched rather than the file
+void SplitPath(const std::string& path, std::string& directory, std::string& name) {
+    size_t slash = path.find_last_of('/');
+    directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    name = slash == std::string::npos ? path : path.substr(slash + 1);
+}
+}  // namespace
+
+CalibrationStore::CalibrationStore(const std::string& file, const std::string& name) : m_file(file), m_name(name), m_running(false) {
+    m_current = Load(1);
+}
+
+CalibrationStore::~CalibrationStore() {
+    Stop();
+}
+
+std::shared_ptr<const LoadedCalibration> CalibrationStore::Load(uint64_t version) const {
+    OverlayCalibration calibration;
+    cv::FileStorage fs(m_file, cv::FileStorage::READ);
+    if (!fs.isOpened())
+        throw std::runtime_error("calibration file '" + m_file + "' of " + m_name + " cannot be read");
+
+    fs["cameraMatrix"] >> calibration.cameraMatrix;
+    fs["distCoeffs"] >> calibration.distCoeffs;
+    fs["rotationVector"] >> calibration.rotationVector;
+    fs["translationVector"] >> calibration.translationVector;
+
+    fs.release();
+
+    // the projector checks that the model is complete
+    return std::make_shared<const LoadedCalibration>(calibration, version);
+}
+
+void CalibrationStore::Watch() {
+    if (m_running)
+        return;
+#ifdef __linux__
+    std::string directory;
+    std::string name;
+    SplitPath(m_file, directory, name);
+    // the rig streams on without reloads when the watch cannot be set up
+    int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    int watch = inotifyFd < 0 ? -1 : inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch < 0) {
+        if (inotifyFd >= 0)
+            close(inotifyFd);
+        std::cout << m_name << ": cannot watch " << directory << ", " << m_file << " stays as loaded\n";
+        return;
+    }
+    m_running = true;
+    m_thread = std::thread(&CalibrationStore::Run, this, inotifyFd, watch);
+    std::cout << m_name << ": reloading " << m_file << " when it changes\n";
+#else
+    std::cout << m_name << ": calibration reload needs inotify, " << m_file << " stays as loaded\n";
+#endif
+}
+
+void CalibrationStore::Stop() {
+    m_running = false;
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void CalibrationStore::Run(int inotifyFd, int watch) {
+#ifdef __linux__
+    std::string directory;
+    std::string name;
+    SplitPath(m_file, directory, name);
+
+    alignas(struct inotify_event) char buffer[4096];
+    while (m_running) {
+        pollfd fd = {inotifyFd, POLLIN, 0};
+        if (poll(&fd, 1, kPollIntervalMs) <= 0)
+            continue;
+
+        bool changed = false;
+        ssize_t length;
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + length;) {
+                const struct inotify_event* pEvent = reinterpret_cast<const struct inotify_event*>(p);
+                if (pEvent->len > 0 && name == pEvent->name)
+                    changed = true;
+                p += sizeof(struct inotify_event) + pEvent->len;
+            }
+        }
+        if (!changed)
+            continue;
+
+        // a half written file fails to parse and is picked up again by its next write
+        try {
+            std::shared_ptr<const LoadedCalibration> loaded = Load(Get()->version + 1);
+            std::atomic_store(&m_current, loaded);
+            std::cout << m_name << ": reloaded " << m_file << ", distortion terms " << loaded->projector.TermNames() << "\n";
+        } catch (std::exception& ex) {
+            std::cout << m_name << ": keeping the previous calibration, reloading " << m_file << " failed: " << ex.what() << "\n";
+        }
+    }
+    inotify_rm_watch(inotifyFd, watch);
+    close(inotifyFd);
+#else
+    (void)inotifyFd;
+    (void)watch;
+#endif
+}
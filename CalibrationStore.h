@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "PointProjector.h"
+
+// A calibration file as parsed once: the camera model and the projector
+// prepared from it, with the rotation matrix and the distortion terms in use
+// already worked out
+struct LoadedCalibration {
+    explicit LoadedCalibration(const OverlayCalibration& calibration, uint64_t version) : calibration(calibration), projector(calibration), version(version) {}
+
+    OverlayCalibration calibration;
+    PointProjector projector;
+    uint64_t version;  // counts the loads, anything built on the calibration is rebuilt when it changes
+};
+
+// Holds the calibration of a rig, loaded from its orientation file at
+// construction. With Watch() an inotify watch reloads the file whenever it
+// is written or replaced and swaps the new calibration in atomically; frames
+// being processed keep the one they took with Get(). A file that fails to
+// parse is reported and the previous calibration stays.
+class CalibrationStore {
+   public:
+    CalibrationStore(const std::string& file, const std::string& name);
+    ~CalibrationStore();
+
+    CalibrationStore(const CalibrationStore&) = delete;
+    CalibrationStore& operator=(const CalibrationStore&) = delete;
+
+    void Watch();
+    void Stop();
+
+    std::shared_ptr<const LoadedCalibration> Get() const { return std::atomic_load(&m_current); }
+
+   private:
+    std::shared_ptr<const LoadedCalibration> Load(uint64_t version) const;
+    void Run(int inotifyFd, int watch);
+
+    std::string m_file;
+    std::string m_name;
+    std::shared_ptr<const LoadedCalibration> m_current;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+};
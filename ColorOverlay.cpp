@@ -0,0 +1,507 @@
+#include "ColorOverlay.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "PointCloudDecoder.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COLOR_OVERLAY_X86
+#endif
+
+namespace {
+inline void WriteGray(uint16_t intensity, const OverlayOptions& options, uint8_t* pColor) {
+    uint8_t gray = static_cast<uint8_t>(std::min(intensity >> options.grayShift, 255));
+    pColor[0] = gray;
+    pColor[1] = gray;
+    pColor[2] = gray;
+}
+
+// the nearest pixel is on the image, as std::round in SampleNearestColor decides, NaN not
+inline bool OnImage(float x, float y, float cols, float rows) {
+    return x > -0.5f && x < cols - 0.5f && y > -0.5f && y < rows - 0.5f;
+}
+
+// std::round for the coordinates OnImage accepts, the same in the vector kernels
+inline int NearestIndex(float value) {
+    float whole = std::trunc(value);
+    return static_cast<int>(whole) + (value - whole >= 0.5f ? 1 : 0);
+}
+
+// Bilinear weights in 1 / 256 of a pixel, the four products sum to 65536
+inline void BilinearWeights(float x, float y, int cols, int rows, int& x0, int& y0, int& ax, int& ay) {
+    float fx = std::min(std::max(x, 0.0f), static_cast<float>(cols - 1));
+    float fy = std::min(std::max(y, 0.0f), static_cast<float>(rows - 1));
+    float x0f = std::floor(fx);
+    float y0f = std::floor(fy);
+    ax = static_cast<int>((fx - x0f) * 256.0f + 0.5f);
+    ay = static_cast<int>((fy - y0f) * 256.0f + 0.5f);
+    x0 = static_cast<int>(x0f);
+    y0 = static_cast<int>(y0f);
+}
+
+void SampleBilinearScalar(const cv::Mat& image, const OverlayOptions& options, const cv::Point2f* pProjected, const uint16_t* pIntensity, size_t count, uint8_t* pColorData) {
+    const float cols = static_cast<float>(image.cols);
+    const float rows = static_cast<float>(image.rows);
+    for (size_t i = 0; i < count; i++) {
+        if (!OnImage(pProjected[i].x, pProjected[i].y, cols, rows)) {
+            if (options.grayFallback && pIntensity)
+                WriteGray(pIntensity[i], options, pColorData + 3 * i);
+            continue;
+        }
+        int x0, y0, ax, ay;
+        BilinearWeights(pProjected[i].x, pProjected[i].y, image.cols, image.rows, x0, y0, ax, ay);
+        int x1 = std::min(x0 + 1, image.cols - 1);
+        int y1 = std::min(y0 + 1, image.rows - 1);
+        const uint8_t* pTop = image.ptr<uint8_t>(y0);
+        const uint8_t* pBottom = image.ptr<uint8_t>(y1);
+        const int w00 = (256 - ax) * (256 - ay);
+        const int w01 = ax * (256 - ay);
+        const int w10 = (256 - ax) * ay;
+        const int w11 = ax * ay;
+        for (int c = 0; c < 3; c++) {
+            int sum = w00 * pTop[3 * x0 + c] + w01 * pTop[3 * x1 + c] + w10 * pBottom[3 * x0 + c] + w11 * pBottom[3 * x1 + c];
+            pColorData[3 * i + 2 - c] = static_cast<uint8_t>((sum + 32768) >> 16);
+        }
+    }
+}
+
+// Box around the nearest pixel, clipped at the border, as integral image
+// columns and rows
+inline void AreaBox(int col, int row, int half, int cols, int rows, int& x0, int& y0, int& x1, int& y1) {
+    x0 = std::max(col - half, 0);
+    y0 = std::max(row - half, 0);
+    x1 = std::min(col + half + 1, cols);
+    y1 = std::min(row + half + 1, rows);
+}
+
+void SampleAreaScalar(const cv::Mat& image, const uint32_t* pIntegral, const OverlayOptions& options, const cv::Point2f* pProjected, const uint16_t* pIntensity, size_t count, uint8_t* pColorData) {
+    const float cols = static_cast<float>(image.cols);
+    const float rows = static_cast<float>(image.rows);
+    const size_t stride = 3 * (image.cols + 1);
+    const int half = options.areaSize / 2;
+    for (size_t i = 0; i < count; i++) {
+        if (!OnImage(pProjected[i].x, pProjected[i].y, cols, rows)) {
+            if (options.grayFallback && pIntensity)
+                WriteGray(pIntensity[i], options, pColorData + 3 * i);
+            continue;
+        }
+        int x0, y0, x1, y1;
+        AreaBox(NearestIndex(pProjected[i].x), NearestIndex(pProjected[i].y), half, image.cols, image.rows, x0, y0, x1, y1);
+        float scale = 1.0f / static_cast<float>((x1 - x0) * (y1 - y0));
+        const uint32_t* pTop = pIntegral + y0 * stride;
+        const uint32_t* pBottom = pIntegral + y1 * stride;
+        for (int c = 0; c < 3; c++) {
+            uint32_t sum = pBottom[3 * x1 + c] - pBottom[3 * x0 + c] - pTop[3 * x1 + c] + pTop[3 * x0 + c];
+            pColorData[3 * i + 2 - c] = static_cast<uint8_t>(std::lrint(static_cast<float>(static_cast<int32_t>(sum)) * scale));
+        }
+    }
+}
+
+#ifdef COLOR_OVERLAY_X86
+// Four points per iteration: the tests, pixel positions and weights in
+// float lanes, then each point's channels in integer lanes. The pixel loads
+// stay single, which leaves nothing for wider AVX2 lanes to gain.
+
+struct LanePositions {
+    int onImage;  // bit per lane
+    alignas(16) int32_t col[4];
+    alignas(16) int32_t row[4];
+};
+
+__attribute__((target("sse4.1"))) inline void LoadPoints(const cv::Point2f* pProjected, __m128& x, __m128& y) {
+    __m128 first = _mm_loadu_ps(&pProjected[0].x);
+    __m128 second = _mm_loadu_ps(&pProjected[2].x);
+    x = _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+    y = _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+__attribute__((target("sse4.1"))) inline int OnImageMask(__m128 x, __m128 y, float cols, float rows) {
+    const __m128 low = _mm_set1_ps(-0.5f);
+    __m128 on = _mm_and_ps(_mm_cmpgt_ps(x, low), _mm_cmplt_ps(x, _mm_set1_ps(cols - 0.5f)));
+    on = _mm_and_ps(on, _mm_and_ps(_mm_cmpgt_ps(y, low), _mm_cmplt_ps(y, _mm_set1_ps(rows - 0.5f))));
+    return _mm_movemask_ps(on);
+}
+
+// NearestIndex in four lanes
+__attribute__((target("sse4.1"))) inline __m128i NearestIndex4(__m128 value) {
+    __m128 whole = _mm_round_ps(value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m128 up = _mm_cmpge_ps(_mm_sub_ps(value, whole), _mm_set1_ps(0.5f));
+    return _mm_sub_epi32(_mm_cvttps_epi32(whole), _mm_castps_si128(up));
+}
+
+// B, G, R of a pixel in the low three 32 bit lanes
+__attribute__((target("sse4.1"))) inline __m128i LoadPixel(const uint8_t* pPixel) {
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(pPixel[0] | (pPixel[1] << 8) | (pPixel[2] << 16)));
+}
+
+// the low three lanes, 0..255, in reverse order
+__attribute__((target("sse4.1"))) inline void StoreColor(__m128i channels, uint8_t* pColor) {
+    int packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(channels, channels), _mm_setzero_si128()));
+    pColor[0] = static_cast<uint8_t>(packed >> 16);
+    pColor[1] = static_cast<uint8_t>(packed >> 8);
+    pColor[2] = static_cast<uint8_t>(packed);
+}
+
+__attribute__((target("sse4.1"))) void SampleNearestSSE41(const cv::Mat& image, const OverlayOptions& options, const cv::Point2f* pProjected, const uint16_t* pIntensity, size_t count, uint8_t* pColorData) {
+    const float cols = static_cast<float>(image.cols);
+    const float rows = static_cast<float>(image.rows);
+    const bool grayFallback = options.grayFallback && pIntensity;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x, y;
+        LoadPoints(pProjected + i, x, y);
+        LanePositions lanes;
+        lanes.onImage = OnImageMask(x, y, cols, rows);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes.col), NearestIndex4(x));
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes.row), NearestIndex4(y));
+        for (int lane = 0; lane < 4; lane++) {
+            uint8_t* pColor = pColorData + 3 * (i + lane);
+            if (!(lanes.onImage & (1 << lane))) {
+                if (grayFallback)
+                    WriteGray(pIntensity[i + lane], options, pColor);
+                continue;
+            }
+            const uint8_t* pRGB = image.ptr<uint8_t>(lanes.row[lane]) + 3 * lanes.col[lane];
+            pColor[0] = pRGB[2];
+            pColor[1] = pRGB[1];
+            pColor[2] = pRGB[0];
+        }
+    }
+    SampleNearestColor(pProjected + i, pIntensity ? pIntensity + i : NULL, count - i, image, options, pColorData + 3 * i);
+}
+
+__attribute__((target("sse4.1"))) void SampleBilinearSSE41(const cv::Mat& image, const OverlayOptions& options, const cv::Point2f* pProjected, const uint16_t* pIntensity, size_t count, uint8_t* pColorData) {
+    const float cols = static_cast<float>(image.cols);
+    const float rows = static_cast<float>(image.rows);
+    const __m128 maxCol = _mm_set1_ps(cols - 1.0f);
+    const __m128 maxRow = _mm_set1_ps(rows - 1.0f);
+    const __m128 steps = _mm_set1_ps(256.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i round = _mm_set1_epi32(32768);
+    const bool grayFallback = options.grayFallback && pIntensity;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x, y;
+        LoadPoints(pProjected + i, x, y);
+        LanePositions lanes;
+        lanes.onImage = OnImageMask(x, y, cols, rows);
+
+        // as BilinearWeights
+        __m128 fx = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), maxCol);
+        __m128 fy = _mm_min_ps(_mm_max_ps(y, _mm_setzero_ps()), maxRow);
+        __m128 x0f = _mm_floor_ps(fx);
+        __m128 y0f = _mm_floor_ps(fy);
+        alignas(16) int32_t ax[4];
+        alignas(16) int32_t ay[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(ax), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(fx, x0f), steps), half)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(ay), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(fy, y0f), steps), half)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes.col), _mm_cvttps_epi32(x0f));
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes.row), _mm_cvttps_epi32(y0f));
+
+        for (int lane = 0; lane < 4; lane++) {
+            uint8_t* pColor = pColorData + 3 * (i + lane);
+            if (!(lanes.onImage & (1 << lane))) {
+                if (grayFallback)
+                    WriteGray(pIntensity[i + lane], options, pColor);
+                continue;
+            }
+            int x0 = lanes.col[lane];
+            int x1 = std::min(x0 + 1, image.cols - 1);
+            const uint8_t* pTop = image.ptr<uint8_t>(lanes.row[lane]);
+            const uint8_t* pBottom = image.ptr<uint8_t>(std::min(lanes.row[lane] + 1, image.rows - 1));
+            __m128i sum = _mm_mullo_epi32(LoadPixel(pTop + 3 * x0), _mm_set1_epi32((256 - ax[lane]) * (256 - ay[lane])));
+            sum = _mm_add_epi32(sum, _mm_mullo_epi32(LoadPixel(pTop + 3 * x1), _mm_set1_epi32(ax[lane] * (256 - ay[lane]))));
+            sum = _mm_add_epi32(sum, _mm_mullo_epi32(LoadPixel(pBottom + 3 * x0), _mm_set1_epi32((256 - ax[lane]) * ay[lane])));
+            sum = _mm_add_epi32(sum, _mm_mullo_epi32(LoadPixel(pBottom + 3 * x1), _mm_set1_epi32(ax[lane] * ay[lane])));
+            StoreColor(_mm_srli_epi32(_mm_add_epi32(sum, round), 16), pColor);
+        }
+    }
+    SampleBilinearScalar(image, options, pProjected + i, pIntensity ? pIntensity + i : NULL, count - i, pColorData + 3 * i);
+}
+
+__attribute__((target("sse4.1"))) void SampleAreaSSE41(const cv::Mat& image, const uint32_t* pIntegral, const OverlayOptions& options, const cv::Point2f* pProjected, const uint16_t* pIntensity, size_t count, uint8_t* pColorData) {
+    const float cols = static_cast<float>(image.cols);
+    const float rows = static_cast<float>(image.rows);
+    const size_t stride = 3 * (image.cols + 1);
+    const __m128i half = _mm_set1_epi32(options.areaSize / 2);
+    const __m128i halfEnd = _mm_set1_epi32(options.areaSize / 2 + 1);
+    const __m128i colEnd = _mm_set1_epi32(image.cols);
+    const __m128i rowEnd = _mm_set1_epi32(image.rows);
+    const bool grayFallback = options.grayFallback && pIntensity;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x, y;
+        LoadPoints(pProjected + i, x, y);
+        int onImage = OnImageMask(x, y, cols, rows);
+
+        // as AreaBox
+        __m128i col = NearestIndex4(x);
+        __m128i row = NearestIndex4(y);
+        __m128i x0 = _mm_max_epi32(_mm_sub_epi32(col, half), _mm_setzero_si128());
+        __m128i y0 = _mm_max_epi32(_mm_sub_epi32(row, half), _mm_setzero_si128());
+        __m128i x1 = _mm_min_epi32(_mm_add_epi32(col, halfEnd), colEnd);
+        __m128i y1 = _mm_min_epi32(_mm_add_epi32(row, halfEnd), rowEnd);
+        __m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_cvtepi32_ps(_mm_mullo_epi32(_mm_sub_epi32(x1, x0), _mm_sub_epi32(y1, y0))));
+        alignas(16) int32_t box[4][4];
+        alignas(16) float scales[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(box[0]), x0);
+        _mm_store_si128(reinterpret_cast<__m128i*>(box[1]), y0);
+        _mm_store_si128(reinterpret_cast<__m128i*>(box[2]), x1);
+        _mm_store_si128(reinterpret_cast<__m128i*>(box[3]), y1);
+        _mm_store_ps(scales, scale);
+
+        for (int lane = 0; lane < 4; lane++) {
+            uint8_t* pColor = pColorData + 3 * (i + lane);
+            if (!(onImage & (1 << lane))) {
+                if (grayFallback)
+                    WriteGray(pIntensity[i + lane], options, pColor);
+                continue;
+            }
+            // 4 sums from 3, the padding entry keeps the last load inside the table
+            const uint32_t* pTop = pIntegral + box[1][lane] * stride;
+            const uint32_t* pBottom = pIntegral + box[3][lane] * stride;
+            __m128i sum = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pBottom + 3 * box[2][lane])), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBottom + 3 * box[0][lane])));
+            sum = _mm_sub_epi32(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTop + 3 * box[2][lane])));
+            sum = _mm_add_epi32(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTop + 3 * box[0][lane])));
+            StoreColor(_mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(sum), _mm_set1_ps(scales[lane]))), pColor);
+        }
+    }
+    SampleAreaScalar(image, pIntegral, options, pProjected + i, pIntensity ? pIntensity + i : NULL, count - i, pColorData + 3 * i);
+}
+#endif
+}  // namespace
+
+const char* ColorSamplingName(ColorSampling sampling) {
+    switch (sampling) {
+        case ColorSampling::Bilinear:
+            return "bilinear";
+        case ColorSampling::Area:
+            return "area";
+        default:
+            return "nearest";
+    }
+}
+
+void SampleNearestColor(const cv::Point2f* pProjected, const uint16_t* pIntensity, size_t count, const cv::Mat& imageRGB, const OverlayOptions& options, uint8_t* pColorData) {
+    const float cols = static_cast<float>(imageRGB.cols);
+    const float rows = static_cast<float>(imageRGB.rows);
+    const bool grayFallback = options.grayFallback && pIntensity;
+    for (size_t i = 0; i < count; i++) {
+        float colTRI = std::round(pProjected[i].x);
+        float rowTRI = std::round(pProjected[i].y);
+
+        // only handle appropriate points, NaN included
+        if (!(colTRI >= 0.0f && colTRI < cols && rowTRI >= 0.0f && rowTRI < rows)) {
+            if (grayFallback)
+                WriteGray(pIntensity[i], options, pColorData + i * 3);
+            continue;
+        }
+
+        const uint8_t* pRGB = imageRGB.ptr<uint8_t>(static_cast<int>(rowTRI)) + 3 * static_cast<int>(colTRI);
+        pColorData[i * 3 + 0] = pRGB[2];
+        pColorData[i * 3 + 1] = pRGB[1];
+        pColorData[i * 3 + 2] = pRGB[0];
+    }
+}
+
+int AreaSizeForFootprint(double focalLengthTRI, double focalLengthHLT) {
+    if (!(focalLengthTRI > 0.0) || !(focalLengthHLT > 0.0))
+        return 3;
+    long half = std::lround((focalLengthTRI / focalLengthHLT - 1.0) / 2.0);
+    return 2 * static_cast<int>(std::max(half, 0L)) + 1;
+}
+
+void ColorSampler::Prepare(const cv::Mat& imageRGB, const OverlayOptions& options, WorkerPool& pool) {
+    if (imageRGB.type() != CV_8UC3)
+        throw std::logic_error("color sampling needs an 8 bit, 3 channel TRI image");
+    m_image = imageRGB;
+    m_options = options;
+    m_options.areaSize = std::max(options.areaSize | 1, 1);
+    if (options.sampling != ColorSampling::Area)
+        return;
+
+    // sums along each row, then down each column, both in bands over pool
+    const size_t cols = static_cast<size_t>(imageRGB.cols);
+    const size_t rows = static_cast<size_t>(imageRGB.rows);
+    const size_t stride = 3 * (cols + 1);
+    m_integral.resize((rows + 1) * stride + 1);
+    std::fill_n(m_integral.begin(), stride, 0);
+    m_integral.back() = 0;
+    uint32_t* pIntegral = m_integral.data();
+    pool.ParallelFor(rows, [&](size_t rowBegin, size_t rowEnd) {
+        for (size_t row = rowBegin; row < rowEnd; row++) {
+            const uint8_t* pRGB = imageRGB.ptr<uint8_t>(static_cast<int>(row));
+            uint32_t* pSum = pIntegral + (row + 1) * stride;
+            pSum[0] = pSum[1] = pSum[2] = 0;
+            for (size_t i = 0; i < 3 * cols; i++)
+                pSum[i + 3] = pSum[i] + pRGB[i];
+        }
+    });
+    pool.ParallelFor(stride, [&](size_t begin, size_t end) {
+        for (size_t row = 2; row <= rows; row++) {
+            uint32_t* pSum = pIntegral + row * stride;
+            const uint32_t* pAbove = pSum - stride;
+            for (size_t i = begin; i < end; i++)
+                pSum[i] += pAbove[i];
+        }
+    });
+}
+
+void ColorSampler::Sample(const cv::Point2f* pProjected, const uint16_t* pIntensity, size_t count, uint8_t* pColorData, SimdLevel level) const {
+#ifdef COLOR_OVERLAY_X86
+    if (level >= SimdLevel::SSE41 && DetectSimdLevel() >= SimdLevel::SSE41) {
+        if (m_options.sampling == ColorSampling::Bilinear)
+            SampleBilinearSSE41(m_image, m_options, pProjected, pIntensity, count, pColorData);
+        else if (m_options.sampling == ColorSampling::Area)
+            SampleAreaSSE41(m_image, m_integral.data(), m_options, pProjected, pIntensity, count, pColorData);
+        else
+            SampleNearestSSE41(m_image, m_options, pProjected, pIntensity, count, pColorData);
+        return;
+    }
+#else
+    (void)level;
+#endif
+    if (m_options.sampling == ColorSampling::Bilinear)
+        SampleBilinearScalar(m_image, m_options, pProjected, pIntensity, count, pColorData);
+    else if (m_options.sampling == ColorSampling::Area)
+        SampleAreaScalar(m_image, m_integral.data(), m_options, pProjected, pIntensity, count, pColorData);
+    else
+        SampleNearestColor(pProjected, pIntensity, count, m_image, m_options, pColorData);
+}
+
+void ProjectColorParallel(const cv::Point3f* pPoints, const uint16_t* pIntensity, size_t count, const PointProjector& projector, const DepthProjectionTable* pDepthTable, OcclusionBuffer* pOcclusion,
+                          const ColorSampler& sampler, uint8_t* pColorData, WorkerPool& pool) {
+    if (pOcclusion) {
+        // the whole frame is projected before any point can be colored
+        pOcclusion->projected.resize(count);
+        pOcclusion->depth.resize(count);
+        cv::Point2f* pProjected = pOcclusion->projected.data();
+        pool.ParallelFor(count, 4 * pool.Threads(), [&](size_t begin, size_t end) {
+            if (pDepthTable)
+                pDepthTable->Project(pPoints + begin, end - begin, begin, pProjected + begin);
+            else
+                projector.Project(pPoints + begin, end - begin, pProjected + begin);
+            projector.Depth(pPoints + begin, end - begin, &pOcclusion->depth[begin]);
+        });
+        pOcclusion->Resolve(pProjected, pOcclusion->depth.data(), count, sampler.Image().cols, sampler.Image().rows, pool);
+        pool.ParallelFor(count, 4 * pool.Threads(), [&](size_t begin, size_t end) {
+            sampler.Sample(pProjected + begin, pIntensity ? pIntensity + begin : NULL, end - begin, pColorData + 3 * begin);
+        });
+        return;
+    }
+
+    // a few shards per thread even out the points off the TRI image, which cost less
+    pool.ParallelFor(count, 4 * pool.Threads(), [&](size_t begin, size_t end) {
+        std::vector<cv::Point2f> projected(end - begin);
+        if (pDepthTable)
+            pDepthTable->Project(pPoints + begin, end - begin, begin, projected.data());
+        else
+            projector.Project(pPoints + begin, end - begin, projected.data());
+        sampler.Sample(projected.data(), pIntensity ? pIntensity + begin : NULL, end - begin, pColorData + 3 * begin);
+    });
+}
+
+void DecodeProjectColorFused(const uint16_t* pInputHLT, size_t width, size_t height, const Scan3dCoefficients& coefficients, const RayTable* pRays, const PointProjector& projector, const DepthProjectionTable* pDepthTable,
+                             OcclusionBuffer* pOcclusion, const OverlayOptions& options, const ColorSampler& sampler, PointList& points, std::vector<uint8_t>& colors, WorkerPool& pool, size_t tileRows) {
+    tileRows = std::max<size_t>(tileRows, 1);
+    size_t tiles = (height + tileRows - 1) / tileRows;
+    SimdLevel level = DetectSimdLevel();
+
+    // 16 bit lists are packed from float tiles, which stay in cache
+    const bool packed = points.format != PointFormat::Float32;
+    if (points.format == PointFormat::Scaled16) {
+        points.scale = static_cast<float>(coefficients.scale);
+        points.offset[0] = static_cast<float>(coefficients.offsetX);
+        points.offset[1] = static_cast<float>(coefficients.offsetY);
+        points.offset[2] = static_cast<float>(coefficients.offsetZ);
+    }
+
+    // each tile packs its points at the start of its own pixel range, they are joined afterwards
+    points.Reserve(width * height);
+    if (colors.size() < 3 * width * height)
+        colors.resize(3 * width * height);
+    std::vector<size_t> tilePoints(tiles);
+
+    // with the occlusion test the tiles keep their projections for it and color afterwards
+    if (pOcclusion) {
+        pOcclusion->projected.resize(width * height);
+        pOcclusion->depth.resize(width * height);
+    }
+
+    pool.ParallelFor(tiles, [&](size_t tileBegin, size_t tileEnd) {
+        // reused by all tiles of the band
+        std::vector<cv::Point2f> projected(width * tileRows);
+        PointList tileList;
+        if (packed)
+            tileList.Reserve(width * tileRows);
+
+        for (size_t tile = tileBegin; tile < tileEnd; tile++) {
+            size_t first = tile * tileRows * width;
+            size_t count = (std::min(height, (tile + 1) * tileRows) - tile * tileRows) * width;
+            PointList& decoded = packed ? tileList : points;
+            size_t offset = packed ? 0 : first;
+
+            size_t n = pRays ? DecodeC16Compact(pInputHLT + first, count, static_cast<uint32_t>(first), *pRays, coefficients, decoded, offset, level)
+                             : DecodeABCY16Compact(pInputHLT + 4 * first, count, static_cast<uint32_t>(first), coefficients, options.intensityThreshold, decoded, offset, level);
+            tilePoints[tile] = n;
+            if (n == 0)
+                continue;
+
+            cv::Point2f* pProjected = pOcclusion ? &pOcclusion->projected[first] : projected.data();
+            if (pDepthTable)
+                pDepthTable->Project(&decoded.x[offset], &decoded.y[offset], &decoded.z[offset], &decoded.pixel[offset], n, pProjected);
+            else
+                projector.Project(&decoded.x[offset], &decoded.y[offset], &decoded.z[offset], n, pProjected, level);
+
+            // points that do not land on the TRI image stay black
+            if (pOcclusion) {
+                projector.Depth(&decoded.x[offset], &decoded.y[offset], &decoded.z[offset], n, &pOcclusion->depth[first]);
+            } else {
+                std::fill_n(&colors[3 * first], 3 * n, 0);
+                sampler.Sample(pProjected, &decoded.intensity[offset], n, &colors[3 * first], level);
+            }
+            if (packed)
+                PackPoints(tileList, 0, points, first, n, level);
+        }
+    });
+
+    size_t size = 0;
+    for (size_t tile = 0; tile < tiles; tile++) {
+        size_t first = tile * tileRows * width;
+        size_t n = tilePoints[tile];
+        if (first != size) {
+            if (packed) {
+                std::copy_n(&points.x16[first], n, &points.x16[size]);
+                std::copy_n(&points.y16[first], n, &points.y16[size]);
+                std::copy_n(&points.z16[first], n, &points.z16[size]);
+            } else {
+                std::copy_n(&points.x[first], n, &points.x[size]);
+                std::copy_n(&points.y[first], n, &points.y[size]);
+                std::copy_n(&points.z[first], n, &points.z[size]);
+            }
+            std::copy_n(&points.intensity[first], n, &points.intensity[size]);
+            std::copy_n(&points.pixel[first], n, &points.pixel[size]);
+            if (pOcclusion) {
+                std::copy_n(&pOcclusion->projected[first], n, &pOcclusion->projected[size]);
+                std::copy_n(&pOcclusion->depth[first], n, &pOcclusion->depth[size]);
+            } else {
+                std::copy_n(&colors[3 * first], 3 * n, &colors[3 * size]);
+            }
+        }
+        size += n;
+    }
+    points.size = size;
+
+    if (pOcclusion) {
+        cv::Point2f* pProjected = pOcclusion->projected.data();
+        pOcclusion->Resolve(pProjected, pOcclusion->depth.data(), size, sampler.Image().cols, sampler.Image().rows, pool);
+        pool.ParallelFor(size, 4 * pool.Threads(), [&](size_t begin, size_t end) {
+            std::fill_n(&colors[3 * begin], 3 * (end - begin), 0);
+            sampler.Sample(pProjected + begin, &points.intensity[begin], end - begin, &colors[3 * begin], level);
+        });
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "DepthProjectionTable.h"
+#include "FeatureCache.h"
+#include "OcclusionBuffer.h"
+#include "PointCloudDecoder.h"
+#include "PointProjector.h"
+#include "WorkerPool.h"
+
+// How a projected point takes its color from the TRI image
+enum class ColorSampling {
+    Nearest,   // the pixel the point lands on
+    Bilinear,  // the four pixels around it, weighted by distance
+    Area,      // the mean of a box around it, about the footprint of one HLT pixel on the TRI
+};
+
+const char* ColorSamplingName(ColorSampling sampling);
+
+// Dropping and coloring of the overlay points
+struct OverlayOptions {
+    uint16_t intensityThreshold = 0;  // points with a weaker return are dropped, 0 keeps all
+    bool grayFallback = false;        // points outside the TRI image are colored by their intensity
+    int grayShift = 2;                // intensity >> grayShift is the gray level
+    ColorSampling sampling = ColorSampling::Nearest;
+    int areaSize = 3;                 // side of the Area box in TRI pixels, odd, clipped at the image border, see AreaSizeForFootprint
+};
+
+// Side of an Area box covering the footprint of one HLT pixel on the TRI:
+// the focal length ratio rounded to the nearest odd number of TRI pixels, 3
+// when a focal length is unknown (0). Both cameras divide by about the same
+// depth, the baseline being small against the range, so the footprint
+// barely changes with depth.
+int AreaSizeForFootprint(double focalLengthTRI, double focalLengthHLT);
+
+// Looks up the TRI pixel nearest to each projected point and writes its
+// color to pColorData as 3 bytes per point, in reverse channel order of the
+// image. Points outside the image get their intensity as gray with
+// options.grayFallback and pIntensity set, else they are left untouched.
+void SampleNearestColor(const cv::Point2f* pProjected, const uint16_t* pIntensity, size_t count, const cv::Mat& imageRGB, const OverlayOptions& options, uint8_t* pColorData);
+
+// The TRI image of one frame prepared for options.sampling: Area sums the
+// box from an integral image built by Prepare. Points land on the image
+// exactly when SampleNearestColor finds them on it, and those off it are
+// handled the same way. Bilinear weights are 8 bit fixed point and the Area
+// mean is rounded from float, so every level gives identical colors.
+// Nearest at the scalar level is SampleNearestColor.
+class ColorSampler {
+   public:
+    // Keeps a reference to imageRGB, which must outlive the sampling
+    void Prepare(const cv::Mat& imageRGB, const OverlayOptions& options, WorkerPool& pool);
+
+    void Sample(const cv::Point2f* pProjected, const uint16_t* pIntensity, size_t count, uint8_t* pColorData, SimdLevel level) const;
+    void Sample(const cv::Point2f* pProjected, const uint16_t* pIntensity, size_t count, uint8_t* pColorData) const { Sample(pProjected, pIntensity, count, pColorData, DetectSimdLevel()); }
+
+    const cv::Mat& Image() const { return m_image; }
+
+   private:
+    cv::Mat m_image;
+    OverlayOptions m_options;
+    std::vector<uint32_t> m_integral;  // (rows + 1) x (cols + 1) x 3 sums, one padding entry for 4 lane loads
+};
+
+// Projects count interleaved points and colors them through sampler, in
+// shards spread over pool. Each shard writes only its own range of
+// pColorData, so the shards need no locking and the colors do not depend on
+// the number of threads. With pDepthTable set the points are projected
+// through it, point i being HLT pixel i. With pOcclusion set the whole frame
+// is projected first and the points it finds occluded are colored like
+// points off the image.
+void ProjectColorParallel(const cv::Point3f* pPoints, const uint16_t* pIntensity, size_t count, const PointProjector& projector, const DepthProjectionTable* pDepthTable, OcclusionBuffer* pOcclusion,
+                          const ColorSampler& sampler, uint8_t* pColorData, WorkerPool& pool);
+
+// Decodes the valid points of the HLT frame into points, projects them and
+// writes their colors to colors, 3 bytes per point. Works tileRows rows at a
+// time, so the points of a tile are still in cache when they are projected
+// and sampled, and projection and sampling only see valid points. Tiles are
+// spread over pool. The colors match sampler on the full frame at the
+// pixels of the points. With pRays set the frame is Coord3D_C16 and
+// X and Y are rebuilt from the rays, see DecodeC16Compact. The points are
+// stored in the format of points; 16 bit formats are packed per tile after
+// projection, which still works on the float coordinates, and Scaled16
+// takes the scale and offsets of coefficients. With pDepthTable set the
+// points are projected through it instead of projector. With pOcclusion set
+// the tiles only project, and the listed points are colored after the
+// occlusion test, its marks following the order of points.
+void DecodeProjectColorFused(const uint16_t* pInputHLT, size_t width, size_t height, const Scan3dCoefficients& coefficients, const RayTable* pRays, const PointProjector& projector, const DepthProjectionTable* pDepthTable,
+                             OcclusionBuffer* pOcclusion, const OverlayOptions& options, const ColorSampler& sampler, PointList& points, std::vector<uint8_t>& colors, WorkerPool& pool, size_t tileRows);
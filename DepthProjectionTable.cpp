@@ -0,0 +1,160 @@
+#include "DepthProjectionTable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+// points projected exactly at a time
+const size_t kBlockPoints = 256;
+}  // namespace
+
+DepthProjectionTable::DepthProjectionTable(const PointProjector& projector, const RayTable& rays, const DepthTableSettings& settings, WorkerPool& pool)
+    : m_projector(projector), m_pixels(rays.width * rays.height), m_inverseFar(1.0f / settings.farMm) {
+    if (rays.Empty())
+        throw std::logic_error("depth projection table without a ray table");
+    if (!(settings.nearMm > 0.0f && settings.farMm > settings.nearMm) || settings.samples < 2)
+        throw std::logic_error("depth projection table needs 0 < nearMm < farMm and at least 2 samples");
+
+    size_t samples = settings.samples;
+    Build(rays, settings, samples, pool);
+    while (settings.maxErrorPx > 0.0f && m_accuracy.maxErrorPx > settings.maxErrorPx && 2 * samples <= settings.maxSamples) {
+        samples *= 2;
+        Build(rays, settings, samples, pool);
+    }
+}
+
+void DepthProjectionTable::Build(const RayTable& rays, const DepthTableSettings& settings, size_t samples, WorkerPool& pool) {
+    m_samples = samples;
+    m_inverseStep = static_cast<float>(samples - 1) / (1.0f / settings.nearMm - m_inverseFar);
+    m_table.assign(m_pixels * samples, cv::Point2f());
+
+    // per row, so the bands need no locking
+    std::vector<double> rowMax(rays.height);
+    std::vector<double> rowSum(rays.height);
+    std::vector<size_t> rowPoints(rays.height);
+    pool.ParallelFor(rays.height, [&](size_t rowBegin, size_t rowEnd) {
+        std::vector<float> x(samples);
+        std::vector<float> y(samples);
+        std::vector<float> z(samples);
+        std::vector<cv::Point2f> projected(samples);
+        std::vector<cv::Point2f> halfway(samples);
+        for (size_t row = rowBegin; row < rowEnd; row++) {
+            for (size_t pixel = row * rays.width; pixel < (row + 1) * rays.width; pixel++) {
+                if (std::isnan(rays.x[pixel]) || std::isnan(rays.y[pixel])) {
+                    for (size_t s = 0; s < samples; s++)
+                        m_table[s * m_pixels + pixel] = cv::Point2f(std::numeric_limits<float>::quiet_NaN(), 0.0f);
+                    continue;
+                }
+                for (size_t s = 0; s < samples; s++) {
+                    z[s] = 1.0f / (m_inverseFar + s / m_inverseStep);
+                    x[s] = rays.x[pixel] * z[s];
+                    y[s] = rays.y[pixel] * z[s];
+                }
+                m_projector.Project(x.data(), y.data(), z.data(), samples, projected.data());
+                for (size_t s = 0; s < samples; s++)
+                    m_table[s * m_pixels + pixel] = projected[s];
+
+                // linear interpolation is off the most halfway between the samples
+                for (size_t s = 0; s + 1 < samples; s++) {
+                    z[s] = 1.0f / (m_inverseFar + (s + 0.5f) / m_inverseStep);
+                    x[s] = rays.x[pixel] * z[s];
+                    y[s] = rays.y[pixel] * z[s];
+                }
+                m_projector.Project(x.data(), y.data(), z.data(), samples - 1, halfway.data());
+                for (size_t s = 0; s + 1 < samples; s++) {
+                    const cv::Point2f& exact = halfway[s];
+                    bool onImage = exact.x >= 0.0f && exact.y >= 0.0f && exact.x < settings.imageWidth && exact.y < settings.imageHeight;
+                    cv::Point2f interpolated;
+                    if ((settings.imageWidth > 0 && !onImage) || !Lookup(pixel, z[s], interpolated))
+                        continue;
+                    double error = std::hypot(interpolated.x - exact.x, interpolated.y - exact.y);
+                    rowMax[row] = std::max(rowMax[row], error);
+                    rowSum[row] += error;
+                    rowPoints[row]++;
+                }
+            }
+        }
+    });
+
+    m_accuracy = DepthTableAccuracy();
+    m_accuracy.samples = samples;
+    size_t points = 0;
+    for (size_t row = 0; row < rays.height; row++) {
+        m_accuracy.maxErrorPx = std::max(m_accuracy.maxErrorPx, rowMax[row]);
+        m_accuracy.meanErrorPx += rowSum[row];
+        points += rowPoints[row];
+    }
+    if (points > 0)
+        m_accuracy.meanErrorPx /= points;
+}
+
+inline bool DepthProjectionTable::Lookup(size_t pixel, float z, cv::Point2f& projected) const {
+    // false for 0, negative and NaN depths too
+    float t = (1.0f / z - m_inverseFar) * m_inverseStep;
+    if (!(t >= 0.0f && t <= static_cast<float>(m_samples - 1)))
+        return false;
+    size_t sample = std::min(static_cast<size_t>(t), m_samples - 2);
+    float fraction = t - sample;
+    const cv::Point2f& before = m_table[sample * m_pixels + pixel];
+    const cv::Point2f& after = m_table[(sample + 1) * m_pixels + pixel];
+    if (std::isnan(before.x))
+        return false;  // no ray
+    projected.x = before.x + fraction * (after.x - before.x);
+    projected.y = before.y + fraction * (after.y - before.y);
+    return true;
+}
+
+void DepthProjectionTable::Project(const float* pX, const float* pY, const float* pZ, const uint32_t* pPixel, size_t count, cv::Point2f* pProjected) const {
+    // points off the table are gathered and projected exactly block by block
+    size_t misses[kBlockPoints];
+    float x[kBlockPoints];
+    float y[kBlockPoints];
+    float z[kBlockPoints];
+    cv::Point2f exact[kBlockPoints];
+    for (size_t first = 0; first < count; first += kBlockPoints) {
+        size_t n = std::min(kBlockPoints, count - first);
+        size_t missed = 0;
+        for (size_t i = first; i < first + n; i++) {
+            if (Lookup(pPixel[i], pZ[i], pProjected[i]))
+                continue;
+            misses[missed] = i;
+            x[missed] = pX[i];
+            y[missed] = pY[i];
+            z[missed] = pZ[i];
+            missed++;
+        }
+        if (missed == 0)
+            continue;
+        m_projector.Project(x, y, z, missed, exact);
+        for (size_t i = 0; i < missed; i++)
+            pProjected[misses[i]] = exact[i];
+    }
+}
+
+void DepthProjectionTable::Project(const cv::Point3f* pPoints, size_t count, size_t firstPixel, cv::Point2f* pProjected) const {
+    size_t misses[kBlockPoints];
+    float x[kBlockPoints];
+    float y[kBlockPoints];
+    float z[kBlockPoints];
+    cv::Point2f exact[kBlockPoints];
+    for (size_t first = 0; first < count; first += kBlockPoints) {
+        size_t n = std::min(kBlockPoints, count - first);
+        size_t missed = 0;
+        for (size_t i = first; i < first + n; i++) {
+            if (Lookup(firstPixel + i, pPoints[i].z, pProjected[i]))
+                continue;
+            misses[missed] = i;
+            x[missed] = pPoints[i].x;
+            y[missed] = pPoints[i].y;
+            z[missed] = pPoints[i].z;
+            missed++;
+        }
+        if (missed == 0)
+            continue;
+        m_projector.Project(x, y, z, missed, exact);
+        for (size_t i = 0; i < missed; i++)
+            pProjected[misses[i]] = exact[i];
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "PointCloudDecoder.h"
+#include "PointProjector.h"
+#include "WorkerPool.h"
+
+// Depth range and sample count of a DepthProjectionTable
+struct DepthTableSettings {
+    float nearMm = 300.0f;    // depths covered by the table, points outside are projected exactly
+    float farMm = 8400.0f;
+    size_t samples = 16;      // depths per pixel, evenly spaced in 1 / depth
+    float maxErrorPx = 0.0f;  // when set, samples are doubled until the error is within it
+    size_t maxSamples = 256;  // or until this many
+    int imageWidth = 0;       // TRI image, the error is measured on the points landing on it, 0 measures all
+    int imageHeight = 0;
+};
+
+// Interpolation error of a table against exact projection, measured halfway
+// between the samples of every pixel with a ray, in px
+struct DepthTableAccuracy {
+    double maxErrorPx = 0.0;
+    double meanErrorPx = 0.0;
+    size_t samples = 0;
+};
+
+// The HLT pixel rays are fixed, so the TRI pixel a point lands on only
+// depends on its depth. The table holds the projection of a few depths on
+// the ray of each HLT pixel; a point is projected by linear interpolation in
+// 1 / depth between the two samples around it, without rotation or
+// distortion. The table is stored depth by depth, so neighbouring points at
+// similar depths read neighbouring entries. Points are taken to lie on the
+// ray of their pixel, as Coord3D_C16 points do exactly. Points outside the
+// depth range or on pixels without a ray go through the projector.
+class DepthProjectionTable {
+   public:
+    DepthProjectionTable(const PointProjector& projector, const RayTable& rays, const DepthTableSettings& settings, WorkerPool& pool);
+
+    // Projects count points given as separate X, Y, Z arrays in mm, pPixel
+    // holding the HLT pixel of each, like a PointList
+    void Project(const float* pX, const float* pY, const float* pZ, const uint32_t* pPixel, size_t count, cv::Point2f* pProjected) const;
+
+    // Same for the interleaved points of count consecutive pixels from firstPixel on
+    void Project(const cv::Point3f* pPoints, size_t count, size_t firstPixel, cv::Point2f* pProjected) const;
+
+    const DepthTableAccuracy& Accuracy() const { return m_accuracy; }
+    size_t Bytes() const { return m_table.size() * sizeof(cv::Point2f); }
+
+   private:
+    void Build(const RayTable& rays, const DepthTableSettings& settings, size_t samples, WorkerPool& pool);
+    bool Lookup(size_t pixel, float z, cv::Point2f& projected) const;
+
+    PointProjector m_projector;
+    size_t m_pixels = 0;
+    size_t m_samples = 0;
+    float m_inverseFar = 0.0f;   // 1 / depth of the first sample
+    float m_inverseStep = 0.0f;  // samples per unit of 1 / depth
+    std::vector<cv::Point2f> m_table;
+    DepthTableAccuracy m_accuracy;
+};
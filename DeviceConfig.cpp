@@ -0,0 +1,182 @@
+#include "DeviceConfig.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+bool ParseBool(const std::string& value) {
+    return value == "1" || value == "true" || value == "True" || value == "TRUE";
+}
+
+bool ValuesEqual(GenApi::INode* pNode, const std::string& a, const std::string& b) {
+    if (a == b)
+        return true;
+    try {
+        switch (pNode->GetPrincipalInterfaceType()) {
+            case GenApi::intfIBoolean:
+                return ParseBool(a) == ParseBool(b);
+            case GenApi::intfIInteger:
+                return std::stoll(a, nullptr, 0) == std::stoll(b, nullptr, 0);
+            case GenApi::intfIFloat: {
+                double x = std::stod(a);
+                double y = std::stod(b);
+                return std::fabs(x - y) <= 1e-9 * std::max(std::fabs(x), std::fabs(y));
+            }
+            default:
+                return false;
+        }
+    } catch (std::exception&) {
+        return false;
+    }
+}
+
+GenApi::CValuePtr GetValueNode(GenApi::INodeMap* pNodeMap, const std::string& name) {
+    GenApi::CValuePtr pValue = pNodeMap->GetNode(name.c_str());
+    if (!pValue)
+        throw std::logic_error("node " + name + " not found");
+    return pValue;
+}
+
+// Only streamable features can go through Arena::FeatureStream
+bool IsStreamable(GenApi::INodeMap* pNodeMap, const std::string& name) {
+    return GetValueNode(pNodeMap, name)->GetNode()->IsStreamable();
+}
+
+// Reads a feature stream file: one "name value" pair per line, comments start with '#'
+bool ReadSnapshot(const std::string& fileName, std::vector<FeatureSetting>& settings) {
+    std::ifstream file(fileName);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#' || line[0] == '{')
+            continue;
+
+        std::istringstream fields(line);
+        FeatureSetting setting;
+        fields >> setting.name;
+        std::getline(fields >> std::ws, setting.value);
+        if (!setting.name.empty())
+            settings.push_back(setting);
+    }
+    return !settings.empty();
+}
+
+bool IsSelector(GenApi::INodeMap* pNodeMap, const std::string& name) {
+    GenApi::CSelectorPtr pSelector = GetValueNode(pNodeMap, name)->GetNode();
+    return pSelector && pSelector->IsSelector();
+}
+
+// Values of a sequence of settings keyed by feature name and the values of its
+// selectors where it appears, e.g. "TriggerMode[TriggerSelector=FrameStart]".
+// Selectors not set earlier in the sequence count with their live value.
+// Selectors themselves are left out, their values are part of the keys.
+std::map<std::string, std::string> KeyBySelectors(GenApi::INodeMap* pNodeMap, const std::vector<FeatureSetting>& settings) {
+    std::map<std::string, std::string> selectorValues;
+    std::map<std::string, std::string> keyed;
+    for (const FeatureSetting& setting : settings) {
+        GenApi::CSelectorPtr pSelector = GetValueNode(pNodeMap, setting.name)->GetNode();
+        std::string key = setting.name;
+        if (pSelector) {
+            GenApi::FeatureList_t selecting;
+            pSelector->GetSelectingFeatures(selecting);
+            for (size_t i = 0; i < selecting.size(); i++) {
+                std::string selectorName = selecting[i]->GetNode()->GetName().c_str();
+                std::map<std::string, std::string>::iterator value = selectorValues.find(selectorName);
+                if (value == selectorValues.end())
+                    value = selectorValues.emplace(selectorName, GenApi::IsReadable(selecting[i]) ? selecting[i]->ToString().c_str() : "").first;
+                key += "[" + selectorName + "=" + value->second + "]";
+            }
+            if (pSelector->IsSelector()) {
+                selectorValues[setting.name] = setting.value;
+                continue;
+            }
+        }
+        keyed[key] = setting.value;
+    }
+    return keyed;
+}
+
+// The snapshot is only trusted if it holds exactly the desired values; a
+// change of the settings in code makes it stale. Selected features appear in
+// the snapshot once per selector value, so each desired value is compared
+// with the one stored under the same selector values.
+bool SnapshotMatches(GenApi::INodeMap* pNodeMap, const std::vector<FeatureSetting>& snapshot, const std::vector<FeatureSetting>& desired) {
+    std::vector<FeatureSetting> streamable;
+    for (const FeatureSetting& setting : desired) {
+        if (IsStreamable(pNodeMap, setting.name))
+            streamable.push_back(setting);
+    }
+    std::map<std::string, std::string> have = KeyBySelectors(pNodeMap, snapshot);
+    std::map<std::string, std::string> want = KeyBySelectors(pNodeMap, streamable);
+    for (const std::pair<const std::string, std::string>& wanted : want) {
+        std::map<std::string, std::string>::const_iterator stored = have.find(wanted.first);
+        std::string name = wanted.first.substr(0, wanted.first.find('['));
+        if (stored == have.end() || !ValuesEqual(GetValueNode(pNodeMap, name)->GetNode(), stored->second, wanted.second))
+            return false;
+    }
+    return true;
+}
+
+void WriteSnapshot(GenApi::INodeMap* pNodeMap, const std::vector<FeatureSetting>& desired, const std::string& fileName) {
+    Arena::FeatureStream featureStream(pNodeMap);
+    for (const FeatureSetting& setting : desired) {
+        if (IsStreamable(pNodeMap, setting.name))
+            featureStream.Select(setting.name.c_str());
+    }
+    featureStream.Write(fileName.c_str());
+}
+}  // namespace
+
+bool FeatureHasValue(GenApi::INodeMap* pNodeMap, const FeatureSetting& setting) {
+    GenApi::CValuePtr pValue = GetValueNode(pNodeMap, setting.name);
+    if (!GenApi::IsReadable(pValue))
+        return false;
+    return ValuesEqual(pValue->GetNode(), pValue->ToString().c_str(), setting.value);
+}
+
+bool SetFeatureIfDifferent(GenApi::INodeMap* pNodeMap, const FeatureSetting& setting) {
+    if (FeatureHasValue(pNodeMap, setting))
+        return false;
+    GetValueNode(pNodeMap, setting.name)->FromString(setting.value.c_str());
+    return true;
+}
+
+ConfigRestoreResult RestoreConfiguration(GenApi::INodeMap* pNodeMap, const std::vector<FeatureSetting>& desired, const std::string& snapshotFile) {
+    ConfigRestoreResult result;
+
+    std::vector<FeatureSetting> snapshot;
+    result.fromSnapshot = ReadSnapshot(snapshotFile, snapshot) && SnapshotMatches(pNodeMap, snapshot, desired);
+
+    // the snapshot equals the desired settings, so the desired settings are diffed either way; a matching snapshot only
+    // vouches that the device accepted them before
+    for (const FeatureSetting& setting : desired) {
+        if (SetFeatureIfDifferent(pNodeMap, setting))
+            result.written++;
+        else
+            result.unchanged++;
+    }
+    if (result.fromSnapshot)
+        return result;
+
+    // verify before persisting, a snapshot must only ever hold a configuration the device accepted; the selectors are set
+    // as in the desired settings, so each selected feature is read under the selector values it was meant for
+    for (const FeatureSetting& setting : desired) {
+        if (IsSelector(pNodeMap, setting.name)) {
+            SetFeatureIfDifferent(pNodeMap, setting);
+            continue;
+        }
+        if (GenApi::IsReadable(GetValueNode(pNodeMap, setting.name)) && !FeatureHasValue(pNodeMap, setting))
+            throw std::runtime_error("feature " + setting.name + " did not take value " + setting.value);
+    }
+    WriteSnapshot(pNodeMap, desired, snapshotFile);
+
+    return result;
+}
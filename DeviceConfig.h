@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ArenaApi.h"
+
+// One feature of a device configuration, the value in GenApi string form
+struct FeatureSetting {
+    std::string name;
+    std::string value;
+};
+
+struct ConfigRestoreResult {
+    size_t written = 0;
+    size_t unchanged = 0;
+    bool fromSnapshot = false;
+};
+
+// True if the node already holds value, compared by the node's type so that
+// "1"/"true" or "5"/"5.0" count as equal
+bool FeatureHasValue(GenApi::INodeMap* pNodeMap, const FeatureSetting& setting);
+
+// Writes the setting only if the node holds a different value, returns true if written
+bool SetFeatureIfDifferent(GenApi::INodeMap* pNodeMap, const FeatureSetting& setting);
+
+// Brings the node map to the desired configuration while writing only the
+// features that differ. If snapshotFile holds a verified configuration equal to
+// the desired one, that is all; otherwise the applied settings are read back
+// and persisted with Arena::FeatureStream for the next start. Settings are
+// applied in order, so selectors must precede the features they select.
+ConfigRestoreResult RestoreConfiguration(GenApi::INodeMap* pNodeMap, const std::vector<FeatureSetting>& desired, const std::string& snapshotFile);
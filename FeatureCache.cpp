@@ -0,0 +1,57 @@
+#include "FeatureCache.h"
+
+namespace {
+int64_t EntryValue(GenApi::CEnumerationPtr pEnumeration, const char* entryName) {
+    GenApi::CEnumEntryPtr pEntry = pEnumeration->GetEntryByName(entryName);
+    if (!pEntry)
+        throw std::logic_error(std::string("enumeration entry ") + entryName + " not found");
+    return pEntry->GetValue();
+}
+}  // namespace
+
+Scan3dCache::Scan3dCache(GenApi::INodeMap* pNodeMap)
+    : m_pScale(ResolveNode<GenApi::CFloatPtr>(pNodeMap, "Scan3dCoordinateScale")),
+      m_pOffset(ResolveNode<GenApi::CFloatPtr>(pNodeMap, "Scan3dCoordinateOffset")),
+      m_pSelector(ResolveNode<GenApi::CEnumerationPtr>(pNodeMap, "Scan3dCoordinateSelector")),
+      m_selectorA(EntryValue(m_pSelector, "CoordinateA")),
+      m_selectorB(EntryValue(m_pSelector, "CoordinateB")),
+      m_selectorC(EntryValue(m_pSelector, "CoordinateC")),
+      m_valid(false),
+      m_refreshing(false) {
+    m_scaleCallback = GenApi::Register(m_pScale->GetNode(), *this, &Scan3dCache::OnNodeChanged);
+    m_offsetCallback = GenApi::Register(m_pOffset->GetNode(), *this, &Scan3dCache::OnNodeChanged);
+}
+
+Scan3dCache::~Scan3dCache() {
+    m_pScale->GetNode()->DeregisterCallback(m_scaleCallback);
+    m_pOffset->GetNode()->DeregisterCallback(m_offsetCallback);
+}
+
+const Scan3dCoefficients& Scan3dCache::Get() {
+    if (!m_valid)
+        Refresh();
+    return m_coefficients;
+}
+
+void Scan3dCache::OnNodeChanged(GenApi::INode*) {
+    if (!m_refreshing)
+        m_valid = false;
+}
+
+void Scan3dCache::Refresh() {
+    m_refreshing = true;
+    try {
+        m_coefficients.scale = m_pScale->GetValue();
+        m_pSelector->SetIntValue(m_selectorA);
+        m_coefficients.offsetX = m_pOffset->GetValue();
+        m_pSelector->SetIntValue(m_selectorB);
+        m_coefficients.offsetY = m_pOffset->GetValue();
+        m_pSelector->SetIntValue(m_selectorC);
+        m_coefficients.offsetZ = m_pOffset->GetValue();
+    } catch (...) {
+        m_refreshing = false;
+        throw;
+    }
+    m_refreshing = false;
+    m_valid = true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+#include "ArenaApi.h"
+
+// Resolves a node by name once and returns it as a typed GenApi pointer
+// (GenApi::CIntegerPtr, CFloatPtr, CCommandPtr, ...). Keep the result instead
+// of going through Arena::GetNodeValue/SetNodeValue, which look the node up by
+// name on every call.
+template <typename NodePtr>
+NodePtr ResolveNode(GenApi::INodeMap* pNodeMap, const char* name) {
+    NodePtr pNode = pNodeMap->GetNode(name);
+    if (!pNode)
+        throw std::logic_error(std::string("node ") + name + " not found or of unexpected type");
+    return pNode;
+}
+
+// Scale and offsets that turn Coord3D_ABCY16 samples into millimeters
+struct Scan3dCoefficients {
+    double scale = 0.0;
+    double offsetX = 0.0;
+    double offsetY = 0.0;
+    double offsetZ = 0.0;
+};
+
+// Per-session cache of the Scan3d coefficients of a Helios. Reading them
+// costs a scale read plus three Scan3dCoordinateSelector writes and offset
+// reads, so they are read once and only read again after a node callback
+// reports that the scale or offset changed (e.g. a new Scan3dOperatingMode).
+class Scan3dCache {
+   public:
+    explicit Scan3dCache(GenApi::INodeMap* pNodeMap);
+    ~Scan3dCache();
+
+    Scan3dCache(const Scan3dCache&) = delete;
+    Scan3dCache& operator=(const Scan3dCache&) = delete;
+
+    const Scan3dCoefficients& Get();
+    void Invalidate() { m_valid = false; }
+
+   private:
+    void OnNodeChanged(GenApi::INode* pNode);
+    void Refresh();
+
+    GenApi::CFloatPtr m_pScale;
+    GenApi::CFloatPtr m_pOffset;
+    GenApi::CEnumerationPtr m_pSelector;
+    int64_t m_selectorA;
+    int64_t m_selectorB;
+    int64_t m_selectorC;
+    GenApi::CallbackHandleType m_scaleCallback;
+    GenApi::CallbackHandleType m_offsetCallback;
+
+    Scan3dCoefficients m_coefficients;
+    std::atomic<bool> m_valid;
+    // our own selector writes change the offset node, ignore those callbacks
+    std::atomic<bool> m_refreshing;
+};
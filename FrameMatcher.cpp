@@ -0,0 +1,71 @@
+#include "FrameMatcher.h"
+
+#include <algorithm>
+#include <chrono>
+
+FrameMatcher::FrameMatcher(ImageReceiver& receiverHLT, ImageReceiver& receiverTRI, int64_t toleranceNs)
+    : m_tolerance_ns(toleranceNs) {
+    m_hlt.pReceiver = &receiverHLT;
+    m_tri.pReceiver = &receiverTRI;
+}
+
+FrameMatcher::~FrameMatcher() {
+    for (Side* pSide : {&m_hlt, &m_tri}) {
+        if (pSide->hasPending)
+            ImageReceiver::Release(pSide->pending);
+    }
+}
+
+bool FrameMatcher::Match(int64_t actionTime, uint64_t timeoutMs, ReceivedImage& imageHLT, ReceivedImage& imageTRI) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    // always look at both sides so a loss on one device does not leave the
+    // other device's image for this action in its queue
+    bool foundHLT = FindFrame(m_hlt, actionTime, deadline, imageHLT);
+    bool foundTRI = FindFrame(m_tri, actionTime, deadline, imageTRI);
+
+    if (foundHLT && foundTRI) {
+        m_matched++;
+        return true;
+    }
+    if (foundHLT) {
+        ImageReceiver::Release(imageHLT);
+        m_hlt.orphans++;
+    }
+    if (foundTRI) {
+        ImageReceiver::Release(imageTRI);
+        m_tri.orphans++;
+    }
+    return false;
+}
+
+bool FrameMatcher::FindFrame(Side& side, int64_t actionTime, std::chrono::steady_clock::time_point deadline, ReceivedImage& image) {
+    while (true) {
+        if (side.hasPending) {
+            image = side.pending;
+            side.hasPending = false;
+        } else {
+            int64_t remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (!side.pReceiver->Pop(image, static_cast<uint64_t>(std::max<int64_t>(remainingMs, 0)))) {
+                side.missing++;
+                return false;
+            }
+        }
+
+        int64_t offset = static_cast<int64_t>(image.timestampNs) - actionTime;
+        if (offset < -m_tolerance_ns) {
+            // belongs to an earlier action that already gave up on it
+            ImageReceiver::Release(image);
+            side.orphans++;
+            continue;
+        }
+        if (offset > m_tolerance_ns) {
+            // the frame for this action was lost, keep this one for a later action
+            side.pending = image;
+            side.hasPending = true;
+            side.missing++;
+            return false;
+        }
+        return true;
+    }
+}
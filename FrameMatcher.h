@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+
+#include "ImageReceiver.h"
+
+// Pairs Helios and Triton images by PTP timestamp against the scheduled action
+// time instead of trusting that the next image of each device belongs to the
+// same trigger. Images older than the action are orphans of an earlier,
+// abandoned action and are released at once. An image newer than the action
+// means the frame for this action was lost; it is held back for the next
+// action so neither queue stalls.
+class FrameMatcher {
+   public:
+    FrameMatcher(ImageReceiver& receiverHLT, ImageReceiver& receiverTRI, int64_t toleranceNs);
+    ~FrameMatcher();
+
+    // Waits up to timeoutMs for an image from both devices within the tolerance
+    // of actionTime. On failure any image that was found is released.
+    bool Match(int64_t actionTime, uint64_t timeoutMs, ReceivedImage& imageHLT, ReceivedImage& imageTRI);
+
+    int64_t ToleranceNs() const { return m_tolerance_ns; }
+    uint64_t MatchedCount() const { return m_matched; }
+
+    // statistics per device: images released without a partner, and actions
+    // without an image from that device
+    uint64_t OrphanCountHLT() const { return m_hlt.orphans; }
+    uint64_t OrphanCountTRI() const { return m_tri.orphans; }
+    uint64_t MissingCountHLT() const { return m_hlt.missing; }
+    uint64_t MissingCountTRI() const { return m_tri.missing; }
+
+   private:
+    struct Side {
+        ImageReceiver* pReceiver = nullptr;
+        ReceivedImage pending;
+        bool hasPending = false;
+        uint64_t orphans = 0;
+        uint64_t missing = 0;
+    };
+
+    bool FindFrame(Side& side, int64_t actionTime, std::chrono::steady_clock::time_point deadline, ReceivedImage& image);
+
+    Side m_hlt;
+    Side m_tri;
+    int64_t m_tolerance_ns;
+    uint64_t m_matched = 0;
+};
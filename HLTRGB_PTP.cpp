@@ -25,10 +25,32 @@
 
 #include <stdio.h>
 
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <functional>
+#include <future>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "ActionScheduler.h"
 #include "ArenaApi.h"
-#include "SaveApi.h"
+#include "ColorOverlay.h"
+#include "DeviceConfig.h"
+#include "FeatureCache.h"
+#include "FrameMatcher.h"
+#include "ImageReceiver.h"
+#include "PlyWriter.h"
+#include "PointCloudDecoder.h"
+#include "PointProjector.h"
+#include "Rig.h"
+#include "SimulatedArena.h"
+#include "StreamBufferPool.h"
+#include "WorkerPool.h"
 
 #define TAB1 "  "
 #define TAB2 "    "
@@ -36,6 +58,8 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <opencv2/calib3d/calib3d.hpp>
@@ -48,19 +72,66 @@
 bool g_use_sac = true;
 uint32_t g_action_delta_time = 1;
 bool g_round_up_action_time = true;
-std::mutex g_transfer_control_mutex;
-std::mutex syncHLTMutex;
-std::mutex syncTRIMutex;
 int g_ActionDeviceKey = 1;
 int g_ActionGroupKey = 1;
-int g_ActionGroupMask = 1;
+int g_ActionGroupMask = 1;  // mask of the first rig, each further rig uses the next bit
 int g_ActionCommandTargetIp = 0xFFFFFFFF;  // Send the commands to the broadcast address, 255.255.255.255
 
+// Continuous acquisition control variables
+bool g_continuous_mode = true;             // false captures NUM_ITERATIONS single overlays
+int64_t g_trigger_period_us = 0;           // 0 triggers at the fastest rate the HLT operating mode allows
+uint64_t g_continuous_max_frames = 0;      // 0 streams until Ctrl+C, also set by --frames N
+uint32_t g_continuous_save_interval = 30;  // save every Nth overlay, 0 never saves
+double g_action_lead_time_ms = 5.0;        // minimum time between firing a command and its execution
+uint32_t g_action_frames_ahead = 4;        // scheduled commands kept in flight ahead of processing
+uint32_t g_ptp_relatch_interval_ms = 1000; // how often the host to PTP clock mapping is refreshed
+size_t g_receive_queue_capacity = 8;       // received images waiting for processing, per device
+int64_t g_pairing_tolerance_us = 0;        // max image timestamp offset from its action, 0 uses half the trigger period
+uint32_t g_ptp_poll_interval_ms = 50;      // PtpStatus polling interval during startup
+uint32_t g_ptp_timeout_ms = 30000;         // give up if PTP has not converged after this long
+size_t g_stream_min_buffers = 4;           // acquisition buffers per device are sized between these bounds
+size_t g_stream_max_buffers = 64;
+bool g_restore_pixel_format = false;       // put back the pixel formats found at startup on exit, the next start then has to write them again
+size_t g_worker_threads = 0;               // threads splitting the per-frame processing, shared by all rigs, 0 uses every core
+bool g_fused_overlay = true;               // decode, project and color HLT tiles in one pass instead of full frame passes
+size_t g_overlay_tile_rows = 16;           // HLT rows per tile of the fused overlay
+PointFormat g_point_format = PointFormat::Float32;  // coordinates kept by the fused overlay, Float16 and Scaled16 need half the memory
+uint16_t g_intensity_threshold = 0;        // HLT points with a weaker intensity are dropped before projection, 0 keeps all
+bool g_intensity_gray_fallback = true;     // HLT points outside the TRI view are colored gray by their intensity
+int g_intensity_gray_shift = 2;            // intensity >> shift is the gray level, 2 maps 0..1023 onto 0..255
+bool g_depth_only = false;                 // stream Coord3D_C16 and rebuild X and Y from a ray table, a quarter of the HLT bandwidth
+uint64_t g_ray_frame_timeout_ms = 3000;    // wait for the Coord3D_ABCY16 frame the ray table is measured on
+bool g_depth_table = false;                // project through a per-pixel table of TRI positions at sampled depths instead of the camera model
+float g_depth_table_near_mm = 300.0f;      // depth range of the table, points outside it are projected exactly
+float g_depth_table_far_mm = 8400.0f;
+size_t g_depth_table_samples = 16;         // depths per pixel at first, each one costs 8 bytes per HLT pixel
+float g_depth_table_max_error_px = 0.1f;   // samples are doubled up to 256 until the interpolation error is within this, 0 keeps g_depth_table_samples
+bool g_rectify_rgb = false;                // undistort the TRI images once per frame and project the points with a pinhole model, saves the rectified images too
+double g_rectify_alpha = 0.0;              // 0 crops the rectified image to pixels with a source, 1 keeps every TRI pixel with black borders
+bool g_calibration_reload = true;          // reload the orientation file of a rig when it changes, without restarting
+bool g_occlusion = false;                  // color only the HLT points nearest to the TRI, the ones hidden behind them are colored like points off the image
+int g_occlusion_shift = 2;                 // z-buffer cells of 1 << shift TRI pixels each way
+float g_occlusion_tolerance_mm = 20.0f;    // points less than this behind the nearest surface of their cell still get its color
+ColorSampling g_color_sampling = ColorSampling::Nearest;  // Bilinear blends the 4 TRI pixels around a point, Area averages its footprint
+int g_color_area_size = 0;                 // side of the Area box in TRI pixels, 0 covers one HLT pixel, from the focal lengths of both cameras
+bool g_aligned_depth = false;              // render the HLT depth onto the TRI image plane, pixel for pixel with the (rectified) TRI image
+AlignedDepthFormat g_aligned_depth_format = AlignedDepthFormat::Millimeters16;  // saved as 16 bit .png, Float32 as .tiff
+int g_aligned_depth_splat_radius = 1;      // each HLT point covers 2 * radius + 1 TRI pixels each way
+int g_aligned_depth_fill_radius = 2;       // empty TRI pixels take the farthest depth this close, 0 leaves them at 0
+std::atomic<bool> g_stop_requested(false);
+
+// Simulation control variables
+bool g_simulate = false;                   // run on simulated devices instead of connected cameras, also set by --simulate
+SimulationParams g_simulation;             // resolution, frame rate, invalid pixels, drops and PTP behaviour of the simulated rigs
+bool g_wait_for_enter = true;              // keep the console open until enter is pressed, a run bounded by --frames exits at once
+
 // Helios RGB: Overlay PTP SAC
 // This example demonstrates color overlay over 3D image, part 3 - Overlay:
 //		With the system calibrated, we can now remove the calibration target from the scene and grab new images with the Helios and Triton cameras,
 //      using the calibration result to find the RGB color for each 3D point measured with the Helios. Based on the output of solvePnP we can project
-//      the 3D points measured by the Helios onto the RGB camera image using the OpenCV function projectPoints.
+//      the 3D points measured by the Helios onto the RGB camera image with PointProjector, the camera model of the OpenCV function projectPoints
+//      compiled for the distortion terms in use. With g_depth_table the points go through a per-pixel lookup table instead, and with
+//      g_rectify_rgb the Triton image is undistorted first and the points are projected with a pinhole model.
 //      Grab a Helios image with the GetHeliosImage() function(output: xyz_mm) and a Triton RGB image with the GetTritionRGBImage() function(output: triton_rgb).
 //      The following code shows how to project the Helios xyz points onto the Triton image, giving a(row, col) position for each 3D point.
 //      We can sample the Triton image at that(row, col) position to find the 3D point?s RGB value.
@@ -77,12 +148,22 @@ int g_ActionCommandTargetIp = 0xFFFFFFFF;  // Send the commands to the broadcast
 // orientation values file name
 #define FILE_NAME_IN "orientation.yml"
 
+// orientation matching the simulated rig geometry, written when simulating
+#define SIMULATED_FILE_NAME_IN "orientation_simulated.yml"
+
+// Helios/Triton pairing for hosts with more than one rig, see PairDevicesIntoRigs()
+#define RIG_MAP_FILE "rigs.yml"
+
+// verified device configurations are kept in <prefix><serial number>.txt
+#define CONFIG_SNAPSHOT_PREFIX "config_"
+
 // file name
-// separate naming patterns for OpenCV and Arena since they use counters differently
+// images and overlays are numbered by the frame counter
 // #define OPENCV_FILE_NAME "Images\\Cpp_HLTRGB_3" //for HLT and TRI images
-// #define ARENA_FILE_NAME "Images\\Cpp_HLTRGB_3_Overlay<count:path>.ply" //for overlay
-#define OPENCV_FILE_NAME "Images/Cpp_HLTRGB_3"                         // for HLT and TRI images
-#define ARENA_FILE_NAME "Images/Cpp_HLTRGB_3_Overlay<count:path>.ply"  // for overlay
+// #define PLY_FILE_NAME "Images\\Cpp_HLTRGB_3_Overlay" //for overlay
+// with several rigs the rig name is inserted before the counter
+#define OPENCV_FILE_NAME "Images/Cpp_HLTRGB_3"          // for HLT and TRI images
+#define PLY_FILE_NAME "Images/Cpp_HLTRGB_3_Overlay"     // for overlay
 
 // number of images to capture from each camera
 #define NUM_ITERATIONS 3
@@ -113,68 +194,143 @@ int g_ActionCommandTargetIp = 0xFFFFFFFF;  // Send the commands to the broadcast
 // For PTP/SAC
 //
 
+// Rewriting PtpEnable restarts PTP negotiation, so only write what differs
 void SetCameraAsPtpMaster(Arena::IDevice* pDevice) {
-    Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "PtpSlaveOnly", false);
-    Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "PtpEnable", true);
+    SetFeatureIfDifferent(pDevice->GetNodeMap(), {"PtpSlaveOnly", "false"});
+    SetFeatureIfDifferent(pDevice->GetNodeMap(), {"PtpEnable", "true"});
 }
 
 void SetCameraAsPtpSlave(Arena::IDevice* pDevice) {
-    Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "PtpSlaveOnly", true);
-    Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "PtpEnable", true);
+    SetFeatureIfDifferent(pDevice->GetNodeMap(), {"PtpSlaveOnly", "true"});
+    SetFeatureIfDifferent(pDevice->GetNodeMap(), {"PtpEnable", "true"});
 }
 
-void ApplyHLTSettings(Arena::IDevice* pDevice) {
+// Polls PtpStatus every g_ptp_poll_interval_ms until the device reports the
+// expected role, throws after g_ptp_timeout_ms
+void WaitForPtpStatus(Arena::IDevice* pDevice, const char* name, const char* expectedStatus) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    GenICam::gcstring lastStatus;
+    while (true) {
+        GenICam::gcstring currPtpStatus = Arena::GetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "PtpStatus");
+        if (currPtpStatus != lastStatus) {
+            std::cout << TAB1 << name << " PtpStatus " << currPtpStatus << std::endl;
+            lastStatus = currPtpStatus;
+        }
+        if (currPtpStatus == expectedStatus)
+            return;
+
+        if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(g_ptp_timeout_ms))
+            throw std::runtime_error(std::string(name) + " did not become PTP " + expectedStatus + " within " + std::to_string(g_ptp_timeout_ms) + " ms");
+        std::this_thread::sleep_for(std::chrono::milliseconds(g_ptp_poll_interval_ms));
+    }
+}
+
+// Trigger on Action0 of the rig's action group, shared by HLT and TRI
+void AddActionTriggerSettings(std::vector<FeatureSetting>& settings, int64_t groupMask) {
+    settings.push_back({"TriggerSelector", "FrameStart"});
+    settings.push_back({"TriggerSource", "Action0"});
+    settings.push_back({"TriggerMode", "On"});
+
+    settings.push_back({"ActionUnconditionalMode", "On"});
+    settings.push_back({"ActionSelector", "0"});
+    settings.push_back({"ActionDeviceKey", std::to_string(g_ActionDeviceKey)});
+    settings.push_back({"ActionGroupKey", std::to_string(g_ActionGroupKey)});
+    settings.push_back({"ActionGroupMask", std::to_string(groupMask)});
+}
+
+// Applies the settings through the device's configuration snapshot, writing only what differs
+void RestoreDeviceSettings(Arena::IDevice* pDevice, const std::string& name, const std::vector<FeatureSetting>& settings) {
     // Enable packet size negotiation and packet resend
     Arena::SetNodeValue<bool>(pDevice->GetTLStreamNodeMap(), "StreamAutoNegotiatePacketSize", true);
     Arena::SetNodeValue<bool>(pDevice->GetTLStreamNodeMap(), "StreamPacketResendEnable", true);
 
-    // Trigger on Action0
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "TriggerSelector", "FrameStart");
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "TriggerSource", "Action0");
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "TriggerMode", "On");
+    GenICam::gcstring serial = Arena::GetNodeValue<GenICam::gcstring>(pDevice->GetTLDeviceNodeMap(), "DeviceSerialNumber");
+    std::string snapshotFile = CONFIG_SNAPSHOT_PREFIX + std::string(serial.c_str()) + ".txt";
+    ConfigRestoreResult result = RestoreConfiguration(pDevice->GetNodeMap(), settings, snapshotFile);
 
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "ActionUnconditionalMode", "On");
-    Arena::SetNodeValue<int64_t>(pDevice->GetNodeMap(), "ActionSelector", 0);
-    Arena::SetNodeValue<int64_t>(pDevice->GetNodeMap(), "ActionDeviceKey", g_ActionDeviceKey);
-    Arena::SetNodeValue<int64_t>(pDevice->GetNodeMap(), "ActionGroupKey", g_ActionGroupKey);
-    Arena::SetNodeValue<int64_t>(pDevice->GetNodeMap(), "ActionGroupMask", g_ActionDeviceKey);
+    std::cout << name << " configuration " << (result.fromSnapshot ? "restored from " : "saved to ") << snapshotFile << ": "
+              << result.written << " features written, " << result.unchanged << " already set" << std::endl;
+}
 
-    // Use Coord3D_ABCY16 format
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "PixelFormat", "Coord3D_ABCY16");
+void ApplyHLTSettings(Arena::IDevice* pDevice, const Rig& rig) {
+    std::vector<FeatureSetting> settings;
+    AddActionTriggerSettings(settings, rig.actionGroupMask);
+
+    // Use Coord3D_ABCY16 format, or depth only with X and Y rebuilt from a ray table
+    settings.push_back({"PixelFormat", g_depth_only ? "Coord3D_C16" : "Coord3D_ABCY16"});
 
     // Set Operating Mode and Exposure Time as defined at top of code
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "Scan3dOperatingMode", HLT_Operating_Mode);
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "ExposureTimeSelector", HLT_Exposure_Time);
+    settings.push_back({"Scan3dOperatingMode", HLT_Operating_Mode});
+    settings.push_back({"ExposureTimeSelector", HLT_Exposure_Time});
 
-    std::cout << "HLT using: " << HLT_Operating_Mode << " operating mode, and " << HLT_Exposure_Time << " exposure time" << std::endl;
-}
+    RestoreDeviceSettings(pDevice, rig.name + " HLT", settings);
 
-void ApplyTRISettings(Arena::IDevice* pDevice) {
-    // Enable packet size negotiation and packet resend
-    Arena::SetNodeValue<bool>(pDevice->GetTLStreamNodeMap(), "StreamAutoNegotiatePacketSize", true);
-    Arena::SetNodeValue<bool>(pDevice->GetTLStreamNodeMap(), "StreamPacketResendEnable", true);
-
-    // Trigger on Action0
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "TriggerSelector", "FrameStart");
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "TriggerSource", "Action0");
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "TriggerMode", "On");
+    std::cout << rig.name << " HLT using: " << HLT_Operating_Mode << " operating mode, and " << HLT_Exposure_Time << " exposure time" << std::endl;
+}
 
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "ActionUnconditionalMode", "On");
-    Arena::SetNodeValue<int64_t>(pDevice->GetNodeMap(), "ActionSelector", 0);
-    Arena::SetNodeValue<int64_t>(pDevice->GetNodeMap(), "ActionDeviceKey", g_ActionDeviceKey);
-    Arena::SetNodeValue<int64_t>(pDevice->GetNodeMap(), "ActionGroupKey", g_ActionGroupKey);
-    Arena::SetNodeValue<int64_t>(pDevice->GetNodeMap(), "ActionGroupMask", g_ActionDeviceKey);
+void ApplyTRISettings(Arena::IDevice* pDevice, const Rig& rig) {
+    std::vector<FeatureSetting> settings;
+    AddActionTriggerSettings(settings, rig.actionGroupMask);
 
     // Use automatic exposure time
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "ExposureAuto", "Continuous");
+    settings.push_back({"ExposureAuto", "Continuous"});
 
     // Use RGB8 format
-    Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "PixelFormat", "RGB8");
+    settings.push_back({"PixelFormat", "RGB8"});
+
+    RestoreDeviceSettings(pDevice, rig.name + " TRI", settings);
+
+    std::cout << rig.name << " TRI using automatic exposure time, and RGB8 pixel format" << std::endl;
+}
+
+// Rays of the HLT pixels for depth-only streaming and the depth table. The
+// intrinsics give the rays of all pixels, when the device has them; a
+// free-running Coord3D_ABCY16 frame replaces them wherever it has a valid
+// point. Leaves the HLT in its streaming pixel format and triggered by
+// action commands again.
+RayTable CaptureRayTable(Rig& rig) {
+    GenApi::INodeMap* pNodeMap = rig.pDeviceHLT->GetNodeMap();
+    GenICam::gcstring pixelFormat = Arena::GetNodeValue<GenICam::gcstring>(pNodeMap, "PixelFormat");
+    size_t width = static_cast<size_t>(Arena::GetNodeValue<int64_t>(pNodeMap, "Width"));
+    size_t height = static_cast<size_t>(Arena::GetNodeValue<int64_t>(pNodeMap, "Height"));
+
+    RayTable intrinsics;
+    GenApi::CFloatPtr pFocalLength = pNodeMap->GetNode("Scan3dFocalLength");
+    GenApi::CFloatPtr pPrincipalPointU = pNodeMap->GetNode("Scan3dPrincipalPointU");
+    GenApi::CFloatPtr pPrincipalPointV = pNodeMap->GetNode("Scan3dPrincipalPointV");
+    if (GenApi::IsReadable(pFocalLength) && GenApi::IsReadable(pPrincipalPointU) && GenApi::IsReadable(pPrincipalPointV)) {
+        double focalLength = pFocalLength->GetValue();
+        intrinsics = RayTableFromIntrinsics(width, height, focalLength, focalLength, pPrincipalPointU->GetValue(), pPrincipalPointV->GetValue());
+    }
+
+    // one frame with all coordinates, without waiting for an action command
+    Arena::SetNodeValue<GenICam::gcstring>(pNodeMap, "PixelFormat", "Coord3D_ABCY16");
+    Arena::SetNodeValue<GenICam::gcstring>(pNodeMap, "TriggerMode", "Off");
+    RayTable rays;
+    rig.pDeviceHLT->StartStream();
+    try {
+        Scan3dCache scan3d(pNodeMap);
+        Arena::IImage* pImage = rig.pDeviceHLT->GetImage(g_ray_frame_timeout_ms);
+        if (pImage->IsIncomplete()) {
+            rig.pDeviceHLT->RequeueBuffer(pImage);
+            throw std::runtime_error("incomplete ray table frame from " + rig.name + " HLT");
+        }
+        rays = RayTableFromABCY16(reinterpret_cast<const uint16_t*>(pImage->GetData()), width, height, scan3d.Get(), intrinsics);
+        rig.pDeviceHLT->RequeueBuffer(pImage);
+    } catch (...) {
+        rig.pDeviceHLT->StopStream();
+        throw;
+    }
+    rig.pDeviceHLT->StopStream();
+    Arena::SetNodeValue<GenICam::gcstring>(pNodeMap, "TriggerMode", "On");
+    Arena::SetNodeValue<GenICam::gcstring>(pNodeMap, "PixelFormat", pixelFormat);
 
-    std::cout << "TRI using automatic exposure time, and RGB8 pixel format" << std::endl;
+    std::cout << rig.name << " HLT ray table from a Coord3D_ABCY16 frame" << (intrinsics.Empty() ? "" : " and the intrinsics") << std::endl;
+    return rays;
 }
 
-void FireScheduledActionCommand(Arena::ISystem* pSystem, Arena::IDevice* pDeviceHLT) {
+// Returns the execute time of the fired command
+int64_t FireScheduledActionCommand(ActionCommandSender& sender, Arena::IDevice* pDeviceHLT, int64_t groupMask) {
     // Get the PTP timestamp from the Master camera
     Arena::ExecuteNode(pDeviceHLT->GetNodeMap(), "PtpDataSetLatch");
     int64_t curr_ptp = Arena::GetNodeValue<int64_t>(pDeviceHLT->GetNodeMap(), "PtpDataSetLatchValue");
@@ -193,182 +349,461 @@ void FireScheduledActionCommand(Arena::ISystem* pSystem, Arena::IDevice* pDevice
     // Fire an Action Command g_action_delta_time seconds from now
     std::cout << TAB1 << "Scheduled Action Command set for time: " << curr_ptp << " ns" << std::endl;
 
-    Arena::SetNodeValue<int64_t>(pSystem->GetTLSystemNodeMap(), "ActionCommandExecuteTime", curr_ptp);
-    Arena::ExecuteNode(pSystem->GetTLSystemNodeMap(), "ActionCommandFireCommand");
+    sender.Fire(groupMask, curr_ptp);
+    return curr_ptp;
 }
 
 //
-// For Overlay
+// For startup timing
 //
-void OverlayColorOnto3DAndSave(Arena::IDevice* pDeviceTRI, Arena::IDevice* pDeviceHLT, int64_t actionCommandExecuteTime, int counter) {
-    // Read in camera matrix, distance coefficients, and rotation and translation vectors
-    cv::Mat cameraMatrix;
-    cv::Mat distCoeffs;
-    cv::Mat rotationVector;
-    cv::Mat translationVector;
 
-    cv::FileStorage fs(FILE_NAME_IN, cv::FileStorage::READ);
+// Records how long each startup phase takes, up to the first overlay of any rig
+class StartupTimer {
+   public:
+    void Start() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_start = m_last = std::chrono::steady_clock::now();
+        m_phases.clear();
+        m_done = false;
+    }
+
+    void Mark(const std::string& phase) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_done)
+            return;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        m_phases.emplace_back(phase, std::chrono::duration<double, std::milli>(now - m_last).count());
+        m_last = now;
+    }
+
+    // Marks the first frame and prints the breakdown, only the first call counts
+    void FirstFrame() {
+        Mark("first frame");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_done)
+            return;
+        m_done = true;
+        Print();
+    }
+
+   private:
+    void Print() const {
+        std::cout << "Startup timing:" << std::endl;
+        for (const auto& phase : m_phases)
+            std::cout << TAB1 << phase.first << ": " << phase.second << " ms" << std::endl;
+        std::cout << TAB1 << "time to first frame: " << std::chrono::duration<double, std::milli>(m_last - m_start).count() << " ms" << std::endl;
+    }
 
-    fs["cameraMatrix"] >> cameraMatrix;
-    fs["distCoeffs"] >> distCoeffs;
-    fs["rotationVector"] >> rotationVector;
-    fs["translationVector"] >> translationVector;
+    std::mutex m_mutex;
+    bool m_done = false;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_last;
+    std::vector<std::pair<std::string, double>> m_phases;
+};
 
-    fs.release();
+StartupTimer g_startup_timer;
+
+//
+// For continuous acquisition
+//
+
+void HandleStopSignal(int) {
+    g_stop_requested = true;
+}
+
+// Fastest frame rate a triggered device can sustain in its current configuration,
+// 0 if the device does not report one
+double GetMaxFrameRate(Arena::IDevice* pDevice) {
+    GenApi::CFloatPtr pFrameRate = pDevice->GetNodeMap()->GetNode("AcquisitionFrameRate");
+    if (!GenApi::IsReadable(pFrameRate))
+        return 0.0;
+    return pFrameRate->GetMax();
+}
+
+// Trigger period in ns: g_trigger_period_us, limited to what both devices can sustain
+int64_t GetTriggerPeriodNs(Arena::IDevice* pDeviceHLT, Arena::IDevice* pDeviceTRI) {
+    double max_rate = GetMaxFrameRate(pDeviceHLT);
+    double max_rate_tri = GetMaxFrameRate(pDeviceTRI);
+    if (max_rate <= 0.0 || (max_rate_tri > 0.0 && max_rate_tri < max_rate))
+        max_rate = max_rate_tri;
+    if (max_rate <= 0.0)
+        throw std::logic_error("unable to read AcquisitionFrameRate, set g_trigger_period_us");
+
+    int64_t min_period_ns = static_cast<int64_t>(std::ceil(1000000000.0 / max_rate));
+    int64_t period_ns = g_trigger_period_us * 1000;
+    if (period_ns == 0) {
+        period_ns = min_period_ns;
+    } else if (period_ns < min_period_ns) {
+        std::cout << TAB1 << "Trigger period " << g_trigger_period_us << " us is faster than the " << max_rate << " fps maximum, using " << min_period_ns / 1000 << " us" << std::endl;
+        period_ns = min_period_ns;
+    }
+    return period_ns;
+}
+
+// Number of scheduled actions a device can hold, 0 if the device does not report it
+int64_t GetActionQueueSize(Arena::IDevice* pDevice) {
+    GenApi::CIntegerPtr pQueueSize = pDevice->GetNodeMap()->GetNode("ActionQueueSize");
+    if (!GenApi::IsReadable(pQueueSize))
+        return 0;
+    return pQueueSize->GetValue();
+}
+
+//
+// For Overlay
+//
+void OverlayColorOnto3DAndSave(const Rig& rig, RigPipeline& pipeline, ReceivedImage& imageHLT, ReceivedImage& imageTRI, int64_t actionCommandExecuteTime, int counter, bool save) {
+    // calibration as loaded at startup or by the last reload, what was built on an older one is rebuilt
+    std::shared_ptr<const LoadedCalibration> loaded = pipeline.calibration.Get();
+    if (loaded->version != pipeline.calibrationVersion) {
+        pipeline.rectifier.reset();
+        pipeline.depthTable.reset();
+        pipeline.calibrationVersion = loaded->version;
+    }
+    const OverlayCalibration& calibration = loaded->calibration;
 
     // variables for HLT
-    Arena::IImage* pImageHLT = nullptr;
+    Arena::IImage* pImageHLT = imageHLT.pImage;
     cv::Mat imageMatrixXYZ;
     size_t width = 0;
     size_t height = 0;
-    GenApi::INodeMap* HLT_node_map = pDeviceHLT->GetNodeMap();
-    double xyz_scale_mm = Arena::GetNodeValue<double>(HLT_node_map, "Scan3dCoordinateScale");
-    Arena::SetNodeValue<GenICam::gcstring>(HLT_node_map, "Scan3dCoordinateSelector", "CoordinateA");
-    double x_offset_mm = Arena::GetNodeValue<double>(HLT_node_map, "Scan3dCoordinateOffset");
-    Arena::SetNodeValue<GenICam::gcstring>(HLT_node_map, "Scan3dCoordinateSelector", "CoordinateB");
-    double y_offset_mm = Arena::GetNodeValue<double>(HLT_node_map, "Scan3dCoordinateOffset");
-    Arena::SetNodeValue<GenICam::gcstring>(HLT_node_map, "Scan3dCoordinateSelector", "CoordinateC");
-    double z_offset_mm = Arena::GetNodeValue<double>(HLT_node_map, "Scan3dCoordinateOffset");
+    cv::Mat imageMatrixIntensity;
+    const Scan3dCoefficients& scan3d = pipeline.scan3dCache.Get();
+    OverlayOptions options;
+    options.intensityThreshold = g_intensity_threshold;
+    options.grayFallback = g_intensity_gray_fallback;
+    options.grayShift = g_intensity_gray_shift;
+    options.sampling = g_color_sampling;
 
     // variables for TRI
-    Arena::IImage* pImageTRI = nullptr;
+    Arena::IImage* pImageTRI = imageTRI.pImage;
     size_t triHeight, triWidth;
     cv::Mat imageMatrixRGB;
 
-    std::cout << TAB1 << "Get HLT and TRI images\n";
-    for (uint32_t x = 0; x < 2; x++) {
-        std::unique_lock<std::mutex> deviceLock(g_transfer_control_mutex);
-
-        if (x == 0) {
-            // Get an image from Helios
-            pImageHLT = pDeviceHLT->GetImage(g_action_delta_time * 1000 * 2);  // Wait for 2 * g_action_delta_time in seconds
-        } else {
-            // Get an image from Triton
-            pImageTRI = pDeviceTRI->GetImage(g_action_delta_time * 1000 * 2);  // Wait for 2 * g_action_delta_time in seconds
-        }
-    }
-
     // HLT image processing
     width = pImageHLT->GetWidth();
     height = pImageHLT->GetHeight();
-    imageMatrixXYZ = cv::Mat((int)height, (int)width, CV_32FC3);
-    const uint16_t* input_data = reinterpret_cast<const uint16_t*>(pImageHLT->GetData());
-    for (unsigned int ir = 0; ir < height; ++ir) {
-        for (unsigned int ic = 0; ic < width; ++ic) {
-            // Get unsigned 16 bit values for X,Y,Z coordinates
-            ushort x_u16 = input_data[0];
-            ushort y_u16 = input_data[1];
-            ushort z_u16 = input_data[2];
-
-            // Convert 16-bit X,Y,Z to float values in mm
-            if (x_u16 == 0xffff || y_u16 == 0xffff || z_u16 == 0xffff) {  // erase invalid data
-                imageMatrixXYZ.at<cv::Vec3f>(ir, ic)[0] = (float)(0.0);
-                imageMatrixXYZ.at<cv::Vec3f>(ir, ic)[1] = (float)(0.0);
-                imageMatrixXYZ.at<cv::Vec3f>(ir, ic)[2] = (float)(0.0);
-            } else {
-                imageMatrixXYZ.at<cv::Vec3f>(ir, ic)[0] = (float)(x_u16 * xyz_scale_mm + x_offset_mm);
-                imageMatrixXYZ.at<cv::Vec3f>(ir, ic)[1] = (float)(y_u16 * xyz_scale_mm + y_offset_mm);
-                imageMatrixXYZ.at<cv::Vec3f>(ir, ic)[2] = (float)(z_u16 * xyz_scale_mm + z_offset_mm);
-            }
+    const uint16_t* pInputHLT = reinterpret_cast<const uint16_t*>(pImageHLT->GetData());
+
+    // depth-only frames carry neither X and Y nor the intensity
+    const RayTable* pRays = NULL;
+    if (pImageHLT->GetPixelFormat() == PFNC_Coord3D_C16) {
+        if (pipeline.rays.width != width || pipeline.rays.height != height)
+            throw std::logic_error("no ray table for the Coord3D_C16 frames of " + rig.name);
+        pRays = &pipeline.rays;
+    }
 
-            input_data += 4;
+    // the fused overlay works on the valid points only, the full XYZ and intensity matrices are made for saving them
+    if (!g_fused_overlay || save) {
+        imageMatrixXYZ = cv::Mat((int)height, (int)width, CV_32FC3);
+
+        // Convert 16-bit X,Y,Z to float values in mm, invalid and weak pixels erased to 0, keep the intensity
+        if (pRays) {
+            DecodeC16Parallel(pInputHLT, imageMatrixXYZ.ptr<float>(), *pRays, scan3d, pipeline.workerPool);
+        } else {
+            imageMatrixIntensity = cv::Mat((int)height, (int)width, CV_16UC1);
+            DecodeABCY16Parallel(pInputHLT, imageMatrixXYZ.ptr<float>(), imageMatrixIntensity.ptr<uint16_t>(), width, height, scan3d, options.intensityThreshold, pipeline.workerPool);
         }
     }
+    const uint16_t* pIntensity = imageMatrixIntensity.empty() ? NULL : imageMatrixIntensity.ptr<uint16_t>();
 
-    // HLT image and timestamp
-    cv::imwrite(OPENCV_FILE_NAME "_XYZ" + std::to_string(counter) + ".jpg", imageMatrixXYZ);
-    std::cout << TAB2 << "Got FrameID " << pImageHLT->GetFrameId() << " from HLT with timestamp: " << pImageHLT->GetTimestamp() << " ns \t (" << (pImageHLT->GetTimestamp() - actionCommandExecuteTime) << " ns offset)" << std::endl;
+    // HLT timestamp
+    std::cout << TAB2 << "Got FrameID " << imageHLT.frameId << " from HLT with timestamp: " << imageHLT.timestampNs << " ns \t (" << (static_cast<int64_t>(imageHLT.timestampNs) - actionCommandExecuteTime) << " ns offset)" << std::endl;
 
     // TRI image processing
     triHeight = pImageTRI->GetHeight();
     triWidth = pImageTRI->GetWidth();
-    imageMatrixRGB = cv::Mat((int)triHeight, (int)triWidth, CV_8UC3);
-    memcpy(imageMatrixRGB.data, pImageTRI->GetData(), triHeight * triWidth * 3);
 
-    // TRI image and timestamp
-    cv::imwrite(OPENCV_FILE_NAME "_RGB" + std::to_string(counter) + ".jpg", imageMatrixRGB);
-    std::cout << TAB2 << "Got FrameID " << pImageTRI->GetFrameId() << " from TRI with timestamp: " << pImageTRI->GetTimestamp() << " ns \t (" << (pImageTRI->GetTimestamp() - actionCommandExecuteTime) << " ns offset)" << std::endl;
+    // the rectified image is remapped straight from the image buffer and colored with a pinhole projection, the remap tables are built once per rig
+    if (g_rectify_rgb) {
+        imageMatrixRGB = cv::Mat((int)triHeight, (int)triWidth, CV_8UC3, const_cast<uint8_t*>(pImageTRI->GetData()));
+        if (!pipeline.rectifier) {
+            pipeline.rectifier.reset(new ImageRectifier(calibration, static_cast<int>(triWidth), static_cast<int>(triHeight), g_rectify_alpha));
+            std::cout << TAB2 << "Rectifier for " << triWidth << "x" << triHeight << " TRI images, " << pipeline.rectifier->Bytes() / (1024 * 1024) << " MiB of remap tables\n";
+        }
+        pipeline.rectifier->Rectify(imageMatrixRGB, pipeline.imageRectified, pipeline.workerPool);
+        imageMatrixRGB = pipeline.imageRectified;
+    } else {
+        imageMatrixRGB = cv::Mat((int)triHeight, (int)triWidth, CV_8UC3);
+        memcpy(imageMatrixRGB.data, pImageTRI->GetData(), triHeight * triWidth * 3);
+    }
 
-    // Overlay RGB color data onto 3D XYZ points
-    std::cout << TAB1 << "Overlay the RGB color data onto the 3D XYZ points\n";
+    // projection kernel for the distortion terms in use, pinhole onto the rectified image
+    const PointProjector& projector = pipeline.rectifier ? pipeline.rectifier->Projector() : loaded->projector;
+
+    // the Area box covers one HLT pixel unless its size is set
+    options.areaSize = g_color_area_size > 0 ? g_color_area_size : AreaSizeForFootprint(projector.FocalLength(), pipeline.focalLengthHLT);
+
+    // the depth table is built once per rig and calibration
+    if (g_depth_table && !pipeline.depthTable) {
+        if (pipeline.rays.width != width || pipeline.rays.height != height)
+            throw std::logic_error("no ray table for the depth table of " + rig.name);
+        DepthTableSettings settings;
+        settings.nearMm = g_depth_table_near_mm;
+        settings.farMm = g_depth_table_far_mm;
+        settings.samples = g_depth_table_samples;
+        settings.maxErrorPx = g_depth_table_max_error_px;
+        settings.imageWidth = static_cast<int>(triWidth);
+        settings.imageHeight = static_cast<int>(triHeight);
+        pipeline.depthTable.reset(new DepthProjectionTable(projector, pipeline.rays, settings, pipeline.workerPool));
+
+        const DepthTableAccuracy& accuracy = pipeline.depthTable->Accuracy();
+        std::cout << TAB2 << "Depth table of " << accuracy.samples << " depths per pixel, " << pipeline.depthTable->Bytes() / (1024 * 1024) << " MiB, max error " << accuracy.maxErrorPx << " px, mean "
+                  << accuracy.meanErrorPx << " px" << (g_depth_table_max_error_px > 0.0f && accuracy.maxErrorPx > g_depth_table_max_error_px ? ", ABOVE THE LIMIT" : "") << "\n";
+    }
+    const DepthProjectionTable* pDepthTable = pipeline.depthTable.get();
+
+    // the z-buffer grids are sized on the first frame and reused
+    if (g_occlusion && !pipeline.occlusion) {
+        OcclusionSettings settings;
+        settings.shift = g_occlusion_shift;
+        settings.toleranceMm = g_occlusion_tolerance_mm;
+        pipeline.occlusion.reset(new OcclusionBuffer(settings));
+    }
+    OcclusionBuffer* pOcclusion = pipeline.occlusion.get();
 
-    // reshape image matrix
-    std::cout << TAB2 << "Reshape XYZ matrix\n";
+    // the integral image of area sampling is built here, once per frame
+    pipeline.sampler.Prepare(imageMatrixRGB, options, pipeline.workerPool);
 
-    int size = imageMatrixXYZ.rows * imageMatrixXYZ.cols;
-    cv::Mat xyzPoints = imageMatrixXYZ.reshape(3, size);
+    // TRI image and timestamp
+    if (save)
+        cv::imwrite(OPENCV_FILE_NAME + rig.outputSuffix + (g_rectify_rgb ? "_RGBRectified" : "_RGB") + std::to_string(counter) + ".jpg", imageMatrixRGB);
+    std::cout << TAB2 << "Got FrameID " << imageTRI.frameId << " from TRI with timestamp: " << imageTRI.timestampNs << " ns \t (" << (static_cast<int64_t>(imageTRI.timestampNs) - actionCommandExecuteTime) << " ns offset)" << std::endl;
+
+    // HLT images
+    if (save) {
+        cv::imwrite(OPENCV_FILE_NAME + rig.outputSuffix + "_XYZ" + std::to_string(counter) + ".jpg", imageMatrixXYZ);
+        if (pIntensity)
+            cv::imwrite(OPENCV_FILE_NAME + rig.outputSuffix + "_Intensity" + std::to_string(counter) + ".png", imageMatrixIntensity);
+    }
 
-    // project points
-    std::cout << TAB2 << "Project points\n";
+    // Overlay RGB color data onto 3D XYZ points
+    std::cout << TAB1 << "Overlay the RGB color data onto the 3D XYZ points, distortion terms: " << projector.TermNames() << "\n";
 
-    cv::Mat projectedPointsTRI;
+    std::string fileName = PLY_FILE_NAME + rig.outputSuffix + std::to_string(counter) + ".ply";
+    size_t points = 0;
+    if (g_fused_overlay) {
+        std::cout << TAB2 << "Decode valid points, project and get values in tiles of " << g_overlay_tile_rows << " rows, keeping " << PointFormatName(g_point_format) << " points\n";
 
-    cv::projectPoints(
-        xyzPoints,
-        rotationVector,
-        translationVector,
-        cameraMatrix,
-        distCoeffs,
-        projectedPointsTRI);
+        pipeline.points.format = g_point_format;
 
-    // loop through projected points to access RGB data at those points
-    std::cout << TAB2 << "Get values at projected points\n";
+        DecodeProjectColorFused(pInputHLT, width, height, scan3d, pRays, projector, pDepthTable, pOcclusion, options, pipeline.sampler, pipeline.points, pipeline.colors, pipeline.workerPool, g_overlay_tile_rows);
+        std::cout << TAB2 << pipeline.points.size << " of " << width * height << " points valid\n";
+        if (pOcclusion)
+            std::cout << TAB2 << pOcclusion->OccludedCount() << " points occluded from the TRI\n";
 
-    uint8_t* pColorData = new uint8_t[width * height * 3];
+        // save .ply with color and intensity
+        if (save)
+            points = WritePointCloudPly(fileName, pipeline.points, pipeline.colors.data());
+    } else {
+        // points that do not land on the TRI image stay black
+        uint8_t* pColorData = new uint8_t[width * height * 3]();
 
-    for (int i = 0; i < width * height; i++) {
-        unsigned int colTRI = (unsigned int)std::round(projectedPointsTRI.at<cv::Vec2f>(i)[0]);
-        unsigned int rowTRI = (unsigned int)std::round(projectedPointsTRI.at<cv::Vec2f>(i)[1]);
+        // project points and access RGB data at those points, in shards over the worker threads
+        std::cout << TAB2 << "Project points and get values at projected points\n";
 
-        // only handle appropriate points
-        if (rowTRI < 0 ||
-            colTRI < 0 ||
-            rowTRI >= static_cast<unsigned int>(imageMatrixRGB.rows) ||
-            colTRI >= static_cast<unsigned int>(imageMatrixRGB.cols))
-            continue;
+        ProjectColorParallel(imageMatrixXYZ.ptr<cv::Point3f>(), pIntensity, width * height, projector, pDepthTable, pOcclusion, pipeline.sampler, pColorData, pipeline.workerPool);
+        if (pOcclusion)
+            std::cout << TAB2 << pOcclusion->OccludedCount() << " points occluded from the TRI\n";
 
-        // access corresponding XYZ and RGB data
-        uchar R = imageMatrixRGB.at<cv::Vec3b>(rowTRI, colTRI)[0];
-        uchar G = imageMatrixRGB.at<cv::Vec3b>(rowTRI, colTRI)[1];
-        uchar B = imageMatrixRGB.at<cv::Vec3b>(rowTRI, colTRI)[2];
+        // save .ply with color and intensity, leaving out invalid and weak points
+        if (save)
+            points = WritePointCloudPly(fileName, imageMatrixXYZ.ptr<float>(), pColorData, pIntensity, width * height);
 
-        float X = imageMatrixXYZ.at<cv::Vec3f>(i)[0];
-        float Y = imageMatrixXYZ.at<cv::Vec3f>(i)[1];
-        float Z = imageMatrixXYZ.at<cv::Vec3f>(i)[2];
+        // delete pColorData to prevent memory leak
+        delete[] pColorData;
+        pColorData = NULL;
+    }
 
-        // grab RGB data to save colored .ply
-        pColorData[i * 3 + 0] = B;
-        pColorData[i * 3 + 1] = G;
-        pColorData[i * 3 + 2] = R;
+    // depth map aligned with imageMatrixRGB, the z-buffer is sized on the first frame and reused
+    if (g_aligned_depth) {
+        if (!pipeline.alignedDepth) {
+            AlignedDepthSettings settings;
+            settings.format = g_aligned_depth_format;
+            settings.splatRadius = g_aligned_depth_splat_radius;
+            settings.fillRadius = g_aligned_depth_fill_radius;
+            pipeline.alignedDepth.reset(new AlignedDepthRenderer(settings));
+        }
+        if (g_fused_overlay)
+            pipeline.alignedDepth->Render(pipeline.points, projector, pDepthTable, imageMatrixRGB.cols, imageMatrixRGB.rows, pipeline.workerPool);
+        else
+            pipeline.alignedDepth->Render(imageMatrixXYZ.ptr<cv::Point3f>(), width * height, projector, pDepthTable, imageMatrixRGB.cols, imageMatrixRGB.rows, pipeline.workerPool);
+        std::cout << TAB2 << "Depth aligned with the TRI image on " << 100.0 * pipeline.alignedDepth->Coverage() << "% of its pixels\n";
+
+        if (save)
+            cv::imwrite(OPENCV_FILE_NAME + rig.outputSuffix + "_DepthAligned" + std::to_string(counter) + (g_aligned_depth_format == AlignedDepthFormat::Float32 ? ".tiff" : ".png"), pipeline.alignedDepth->Depth());
     }
 
     // Save result
+    if (save)
+        std::cout << TAB1 << "Save overlay of " << points << " points to " << fileName << "\n\n";
 
-    // prepare to save
-    Save::ImageParams params(
-        pImageHLT->GetWidth(),
-        pImageHLT->GetHeight(),
-        pImageHLT->GetBitsPerPixel());
+    // release the image copies
+    ImageReceiver::Release(imageHLT);
+    ImageReceiver::Release(imageTRI);
+}
 
-    Save::ImageWriter plyWriter(params, ARENA_FILE_NAME);
+// Triggers both cameras every trigger period until g_stop_requested is set or
+// g_continuous_max_frames overlays have been captured, then reports the
+// sustained frame rate. Action commands are fired by an ActionScheduler up to
+// g_action_frames_ahead frames ahead, so exposure overlaps processing. When a
+// buffer pool changes its target the scheduler is stopped, the actions it
+// fired are taken and both streams restart with the new counts.
+void RunContinuousAcquisition(Rig& rig, RigPipeline& pipeline, ActionCommandSender& sender) {
+    Arena::IDevice* pDeviceHLT = rig.pDeviceHLT;
+    Arena::IDevice* pDeviceTRI = rig.pDeviceTRI;
+    ImageReceiver& receiverHLT = pipeline.receiverHLT;
+    ImageReceiver& receiverTRI = pipeline.receiverTRI;
+    StreamBufferPool& poolHLT = pipeline.poolHLT;
+    StreamBufferPool& poolTRI = pipeline.poolTRI;
+
+    int64_t period_ns = GetTriggerPeriodNs(pDeviceHLT, pDeviceTRI);
+    int64_t lead_ns = static_cast<int64_t>(g_action_lead_time_ms * 1000000.0);
+
+    // the cameras drop scheduled actions beyond their queue size; the action of the frame being waited for is still pending when
+    // the scheduler fires the next one, so up to frames_ahead + 1 are scheduled on each device
+    size_t frames_ahead = g_action_frames_ahead;
+    for (Arena::IDevice* pDevice : {pDeviceHLT, pDeviceTRI}) {
+        int64_t queue_size = GetActionQueueSize(pDevice);
+        if (queue_size > 0 && static_cast<size_t>(queue_size) <= frames_ahead)
+            frames_ahead = static_cast<size_t>(std::max<int64_t>(queue_size - 1, 1));
+    }
 
-    // save .ply with color data
-    bool filterPoints = true;
-    bool isSignedPixelFormat = false;
+    std::cout << rig.name << ": continuous acquisition every " << period_ns / 1000 << " us (" << 1000000000.0 / period_ns << " fps), "
+              << frames_ahead << " actions ahead with " << g_action_lead_time_ms << " ms lead time, press Ctrl+C to stop\n\n";
+
+    // every action in flight can be waiting in a buffer, the counts are resized between scheduler runs
+    poolHLT.Start(std::max(poolHLT.Target(), poolHLT.Recommend(period_ns, 0, frames_ahead)));
+    poolTRI.Start(std::max(poolTRI.Target(), poolTRI.Recommend(period_ns, 0, frames_ahead)));
+    std::cout << rig.name << ": streaming with " << poolHLT.BufferCount() << " HLT and " << poolTRI.BufferCount() << " TRI buffers\n";
+    g_startup_timer.Mark("stream start");
+
+    ActionScheduler scheduler(sender, rig.actionGroupMask, pDeviceHLT, period_ns, lead_ns, frames_ahead, g_ptp_relatch_interval_ms);
+    FrameMatcher matcher(receiverHLT, receiverTRI, g_pairing_tolerance_us > 0 ? g_pairing_tolerance_us * 1000 : period_ns / 2);
+    scheduler.Start();
+
+    uint64_t frames = 0;
+    uint64_t unmatched = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastReport = start;
+    uint64_t framesAtLastReport = 0;
+
+    int64_t actionTime = 0;
+    bool resize = false;
+    while (!g_stop_requested && (g_continuous_max_frames == 0 || frames < g_continuous_max_frames)) {
+        if (!scheduler.WaitNext(actionTime)) {
+            // stopped for a resize and every action it fired has been waited for, so no frame is in flight
+            if (!resize)
+                break;
+            poolHLT.ApplyTarget();
+            poolTRI.ApplyTarget();
+            std::cout << TAB1 << rig.name << ": streaming with " << poolHLT.BufferCount() << " HLT and " << poolTRI.BufferCount() << " TRI buffers" << std::endl;
+            resize = false;
+            scheduler.Start();
+            continue;
+        }
 
-    plyWriter.SetPly(".ply", filterPoints, isSignedPixelFormat, xyz_scale_mm, x_offset_mm, y_offset_mm, z_offset_mm);
+        int64_t untilAction = actionTime - scheduler.Clock().Now();
+        uint64_t timeoutMs = static_cast<uint64_t>(std::max<int64_t>(untilAction, 0) / 1000000 + 2 * period_ns / 1000000) + TIMEOUT;
+        bool save = g_continuous_save_interval != 0 && frames % g_continuous_save_interval == 0;
+        ReceivedImage imageHLT;
+        ReceivedImage imageTRI;
+        poolHLT.Sample();
+        poolTRI.Sample();
+        if (matcher.Match(actionTime, timeoutMs, imageHLT, imageTRI)) {
+            if (frames == 0)
+                g_startup_timer.FirstFrame();
+            OverlayColorOnto3DAndSave(rig, pipeline, imageHLT, imageTRI, actionTime, static_cast<int>(frames), save);
+            frames++;
+        } else {
+            std::cout << TAB1 << rig.name << ": no matching HLT and TRI images for action " << actionTime << std::endl;
+            unmatched++;
+        }
 
-    plyWriter.Save(pImageHLT->GetData(), pColorData);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - lastReport >= std::chrono::seconds(1)) {
+            double seconds = std::chrono::duration<double>(now - lastReport).count();
+            std::cout << TAB1 << rig.name << " frame rate: " << (frames - framesAtLastReport) / seconds << " fps" << std::endl;
+            lastReport = now;
+            framesAtLastReport = frames;
+
+            // buffer counts from starvation and how long buffers are held; a new count restarts the
+            // streams, so the scheduler stops firing and the actions already fired are taken first
+            bool resizeHLT = poolHLT.Update(period_ns, receiverHLT.TakeMaxHoldTimeNs(), frames_ahead);
+            bool resizeTRI = poolTRI.Update(period_ns, receiverTRI.TakeMaxHoldTimeNs(), frames_ahead);
+            if ((resizeHLT || resizeTRI) && !resize) {
+                resize = true;
+                scheduler.Stop();
+            }
+        }
+    }
 
-    std::cout << TAB1 << "Save overlay to " << plyWriter.GetLastFileName(true) << "\n\n";
+    scheduler.Stop();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "\n" << rig.name << " sustained frame rate: " << (elapsed > 0.0 ? frames / elapsed : 0.0) << " fps (" << frames << " overlays in " << elapsed << " s, "
+              << scheduler.SkippedSlots() << " trigger slots skipped, " << unmatched << " actions without a pair)\n";
+    std::cout << TAB1 << "HLT: " << matcher.MissingCountHLT() << " missing, " << matcher.OrphanCountHLT() << " orphans released\n";
+    std::cout << TAB1 << "TRI: " << matcher.MissingCountTRI() << " missing, " << matcher.OrphanCountTRI() << " orphans released\n";
+    poolHLT.PrintStats();
+    poolTRI.PrintStats();
+    for (ImageReceiver* pReceiver : {&receiverHLT, &receiverTRI}) {
+        std::cout << TAB1 << pReceiver->Name() << ": " << pReceiver->ReceivedCount() << " received, " << pReceiver->IncompleteCount() << " incomplete, "
+                  << pReceiver->OverflowCount() << " dropped on full queue\n";
+    }
+}
 
-    // requeue image buffers
-    pDeviceHLT->RequeueBuffer(pImageHLT);
-    pDeviceTRI->RequeueBuffer(pImageTRI);
+// Captures NUM_ITERATIONS overlays, each on its own scheduled action command
+void RunSingleOverlays(Rig& rig, RigPipeline& pipeline, ActionCommandSender& sender) {
+    FrameMatcher matcher(pipeline.receiverHLT, pipeline.receiverTRI, g_pairing_tolerance_us > 0 ? g_pairing_tolerance_us * 1000 : static_cast<int64_t>(g_action_delta_time) * 500000000);
+    pipeline.poolHLT.Start(pipeline.poolHLT.Recommend(static_cast<int64_t>(g_action_delta_time) * 1000000000, 0, 1));
+    pipeline.poolTRI.Start(pipeline.poolTRI.Recommend(static_cast<int64_t>(g_action_delta_time) * 1000000000, 0, 1));
+    g_startup_timer.Mark("stream start");
+
+    std::cout << rig.name << ": capture " << NUM_ITERATIONS << " overlays \n\n";
+    for (int i = 0; i < NUM_ITERATIONS && !g_stop_requested; i++) {
+        int64_t actionCommandExecuteTime = FireScheduledActionCommand(sender, rig.pDeviceHLT, rig.actionGroupMask);
+        ReceivedImage imageHLT;
+        ReceivedImage imageTRI;
+        std::cout << TAB1 << "Get HLT and TRI images\n";
+        if (!matcher.Match(actionCommandExecuteTime, g_action_delta_time * 1000 * 2, imageHLT, imageTRI))  // Wait for 2 * g_action_delta_time in seconds
+            throw std::runtime_error("timed out waiting for HLT and TRI images of " + rig.name);
+        if (i == 0)
+            g_startup_timer.FirstFrame();
+        OverlayColorOnto3DAndSave(rig, pipeline, imageHLT, imageTRI, actionCommandExecuteTime, i, true);
+    }
+}
 
-    // delete pColorData to prevent memory leak
-    pColorData = NULL;
-    delete pColorData;
+// Streams one rig on the calling thread until it is done or stopped
+void RunRig(Rig& rig, WorkerPool& workerPool, ActionCommandSender& sender) {
+    try {
+        // measured before the receivers are registered, they would take the frame
+        RayTable rays;
+        if (g_depth_only || g_depth_table)
+            rays = CaptureRayTable(rig);
+
+        // images arrive on each device's own grab thread, the receivers
+        // deregister themselves when the pipeline goes away
+        RigPipeline pipeline(rig, workerPool, g_receive_queue_capacity, g_stream_min_buffers, g_stream_max_buffers);
+        pipeline.rays = std::move(rays);
+        if (g_calibration_reload)
+            pipeline.calibration.Watch();
+        try {
+            if (g_continuous_mode)
+                RunContinuousAcquisition(rig, pipeline, sender);
+            else
+                RunSingleOverlays(rig, pipeline, sender);
+        } catch (...) {
+            pipeline.poolHLT.Stop();
+            pipeline.poolTRI.Stop();
+            throw;
+        }
+        pipeline.poolHLT.Stop();
+        pipeline.poolTRI.Stop();
+    } catch (...) {
+        // one failing rig stops the others
+        g_stop_requested = true;
+        throw;
+    }
 }
 
 // =-=-=-=-=-=-=-=-=-
@@ -376,151 +811,190 @@ void OverlayColorOnto3DAndSave(Arena::IDevice* pDeviceTRI, Arena::IDevice* pDevi
 // =- & CLEAN UP =-=-
 // =-=-=-=-=-=-=-=-=-
 
-bool isApplicableDeviceTriton(Arena::DeviceInfo deviceInfo) {
-    return deviceInfo.ModelName() == "TRI032S-C";  // change name here to search for different Triton model
+bool isApplicableDeviceTriton(const DiscoveredDevice& device) {
+    return device.modelName == "TRI032S-C";  // change name here to search for different Triton model
 }
 
-bool isApplicableDeviceHelios2(Arena::DeviceInfo deviceInfo)  // either Helios2 or Helios2+ can be used
+bool isApplicableDeviceHelios2(const DiscoveredDevice& device)  // either Helios2 or Helios2+ can be used
 {
-    return ((deviceInfo.ModelName().find("HLT") != GenICam::gcstring::npos) || (deviceInfo.ModelName().find("HTP") != GenICam::gcstring::npos));
+    return ((device.modelName.find("HLT") != std::string::npos) || (device.modelName.find("HTP") != std::string::npos));
 }
 
-int main() {
+int main(int argc, char** argv) {
     // flag to track when an exception has been thrown
     bool exceptionThrown = false;
 
     std::cout << "Cpp_HLTRGB_3_Overlay_PTP_SAC\n";
 
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--simulate") {
+            g_simulate = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            // unattended runs such as the simulated pipeline test
+            g_continuous_max_frames = std::strtoull(argv[++i], nullptr, 10);
+            g_wait_for_enter = false;
+        }
+    }
+
     try {
+        std::string calibrationFile = FILE_NAME_IN;
+        if (g_simulate) {
+            calibrationFile = SIMULATED_FILE_NAME_IN;
+            WriteSimulatedCalibration(calibrationFile, g_simulation);
+        }
+
         std::ifstream ifile;
-        ifile.open(FILE_NAME_IN);
-        if (!ifile) {
-            std::cout << "File '" << FILE_NAME_IN << "' not found\nPlease run examples 'Cpp_HLTRGB_1_Calibration' and 'Cpp_HLTRGB_2_Orientation' prior to this one\nPress enter to complete\n";
-            std::getchar();
+        ifile.open(calibrationFile);
+        if (!ifile && !std::ifstream(RIG_MAP_FILE)) {
+            std::cout << "File '" << FILE_NAME_IN << "' not found\nPlease run examples 'Cpp_HLTRGB_1_Calibration' and 'Cpp_HLTRGB_2_Orientation' prior to this one\n";
+            if (g_wait_for_enter) {
+                std::cout << "Press enter to complete\n";
+                std::getchar();
+            }
             return 0;
         }
 
         // prepare example
-        Arena::ISystem* pSystem = Arena::OpenSystem();
-        pSystem->UpdateDevices(100);
-        std::vector<Arena::DeviceInfo> deviceInfos = pSystem->GetDevices();
-        if (deviceInfos.size() == 0) {
-            std::cout << "\nNo camera connected\nPress enter to complete\n";
-            std::getchar();
+        g_startup_timer.Start();
+        Arena::ISystem* pSystem = g_simulate ? new SimulatedSystem(g_simulation) : Arena::OpenSystem();
+        if (g_simulate)
+            std::cout << "Simulating " << g_simulation.rigCount << " HLT and TRI pairs" << std::endl;
+        std::vector<DiscoveredDevice> devices = DiscoverDevices(pSystem, 100);
+        if (devices.size() == 0) {
+            std::cout << "\nNo camera connected\n";
+            if (g_wait_for_enter) {
+                std::cout << "Press enter to complete\n";
+                std::getchar();
+            }
             return 0;
         }
 
         // print list of detected device for troubleshooting
         std::cout << "Detected devices :" << std::endl;
         int counter = 0;
-        for (auto& deviceInfo : deviceInfos) {
-            std::cout << TAB1 << "Device " << counter << " : " << deviceInfo.ModelName() << std::endl;
+        for (auto& device : devices) {
+            std::cout << TAB1 << "Device " << counter << " : " << device.modelName << std::endl;
             counter++;
         }
 
-        Arena::IDevice* pDeviceTRI = nullptr;
-        Arena::IDevice* pDeviceHLT = nullptr;
-        std::string currPtpStatus;
-
-        // find HLT and make it Master
-        for (auto& deviceInfo : deviceInfos) {
-            if (!pDeviceHLT && isApplicableDeviceHelios2(deviceInfo)) {
-                pDeviceHLT = pSystem->CreateDevice(deviceInfo);
-                SetCameraAsPtpMaster(pDeviceHLT);
-                std::cout << "Waiting for HLT to become Master" << std::endl;
-                do {
-                    // Sleep(1000);
-                    sleep(1);
-                    std::cout << ".";
-
-                    std::unique_lock<std::mutex> deviceLock(syncHLTMutex);
-                    currPtpStatus = Arena::GetNodeValue<GenICam::gcstring>(pDeviceHLT->GetNodeMap(), "PtpStatus");
-                } while (currPtpStatus != "Master");
-                std::cout << std::endl;
-                std::cout << "Apply HLT Settings" << std::endl;
-                ApplyHLTSettings(pDeviceHLT);
-
-            } else if (isApplicableDeviceHelios2(deviceInfo)) {
-                throw std::logic_error("too many Helios2 devices connected");
-            }
+        // pair the HLT and TRI devices into rigs
+        std::vector<DiscoveredDevice> heliosDevices;
+        std::vector<DiscoveredDevice> tritonDevices;
+        for (auto& device : devices) {
+            if (isApplicableDeviceHelios2(device))
+                heliosDevices.push_back(device);
+            else if (isApplicableDeviceTriton(device))
+                tritonDevices.push_back(device);
         }
 
-        // find TRI and make it Slave
-        for (auto& deviceInfo : deviceInfos) {
-            if (!pDeviceTRI && isApplicableDeviceTriton(deviceInfo)) {
-                pDeviceTRI = pSystem->CreateDevice(deviceInfo);
-                SetCameraAsPtpSlave(pDeviceTRI);
-
-                std::cout << "Waiting for TRI to become Slave" << std::endl;
-                do {
-                    // Sleep(1000);
-                    sleep(1);
-                    std::cout << ".";
-
-                    std::unique_lock<std::mutex> deviceLock(syncTRIMutex);
-                    currPtpStatus = Arena::GetNodeValue<GenICam::gcstring>(pDeviceTRI->GetNodeMap(), "PtpStatus");
-                } while (currPtpStatus != "Slave");
-                std::cout << std::endl;
-                ApplyTRISettings(pDeviceTRI);
-            } else if (isApplicableDeviceTriton(deviceInfo)) {
-                throw std::logic_error("too many Triton devices connected");
-            }
+        std::vector<Rig> rigs = PairDevicesIntoRigs(heliosDevices, tritonDevices, RIG_MAP_FILE, calibrationFile, g_ActionGroupMask);
+        for (Rig& rig : rigs) {
+            if (!std::ifstream(rig.calibrationFile))
+                throw std::logic_error("calibration file '" + rig.calibrationFile + "' of " + rig.name + " not found");
+            std::cout << TAB1 << rig.name << " : HLT " << rig.deviceHLT.serialNumber << ", TRI " << rig.deviceTRI.serialNumber
+                      << ", action group mask " << rig.actionGroupMask << ", calibration " << rig.calibrationFile << std::endl;
         }
 
-        if (!pDeviceTRI)
-            throw std::logic_error("No applicable Triton devices");
-
-        if (!pDeviceHLT)
-            throw std::logic_error("No applicable Helios 2 devices");
+        g_startup_timer.Mark("discovery");
+
+        // open and configure all devices at the same time. Every rig is on the
+        // same PTP domain, the HLT of the first rig becomes Master and all
+        // other devices Slave
+        std::vector<std::future<void>> bringUps;
+        for (size_t i = 0; i < rigs.size(); i++) {
+            Rig& rig = rigs[i];
+            bool master = i == 0;
+            bringUps.push_back(std::async(std::launch::async, [pSystem, &rig, master]() {
+                Arena::IDevice* pDevice = CreateDiscoveredDevice(pSystem, rig.deviceHLT);
+                rig.pDeviceHLT = pDevice;
+                if (master)
+                    SetCameraAsPtpMaster(pDevice);
+                else
+                    SetCameraAsPtpSlave(pDevice);
+                rig.pixelFormatInitialHLT = Arena::GetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "PixelFormat");
+                ApplyHLTSettings(pDevice, rig);
+            }));
+            bringUps.push_back(std::async(std::launch::async, [pSystem, &rig]() {
+                Arena::IDevice* pDevice = CreateDiscoveredDevice(pSystem, rig.deviceTRI);
+                rig.pDeviceTRI = pDevice;
+                SetCameraAsPtpSlave(pDevice);
+                rig.pixelFormatInitialTRI = Arena::GetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "PixelFormat");
+                ApplyTRISettings(pDevice, rig);
+            }));
+        }
+        for (std::future<void>& bringUp : bringUps)
+            bringUp.wait();
+        for (std::future<void>& bringUp : bringUps)
+            bringUp.get();
+        g_startup_timer.Mark("open and configure");
+
+        // PTP negotiation ran while the settings were written, wait for all roles together
+        std::cout << "Waiting for " << rigs[0].name << " HLT to become Master and all other devices to become Slave" << std::endl;
+        std::vector<std::string> ptpNames;
+        for (Rig& rig : rigs) {
+            ptpNames.push_back(rig.name + " HLT");
+            ptpNames.push_back(rig.name + " TRI");
+        }
+        std::vector<std::future<void>> ptpWaits;
+        for (size_t i = 0; i < rigs.size(); i++) {
+            ptpWaits.push_back(std::async(std::launch::async, WaitForPtpStatus, rigs[i].pDeviceHLT, ptpNames[2 * i].c_str(), i == 0 ? "Master" : "Slave"));
+            ptpWaits.push_back(std::async(std::launch::async, WaitForPtpStatus, rigs[i].pDeviceTRI, ptpNames[2 * i + 1].c_str(), "Slave"));
+        }
+        for (std::future<void>& ptpWait : ptpWaits)
+            ptpWait.wait();
+        for (std::future<void>& ptpWait : ptpWaits)
+            ptpWait.get();
+        g_startup_timer.Mark("PTP convergence");
 
         if (g_use_sac == true) {
+            // the group mask is written with every action command, one bit per rig
             std::cout << "Applied the following settings to GenTL System:" << std::endl;
             Arena::SetNodeValue<int64_t>(pSystem->GetTLSystemNodeMap(), "ActionCommandDeviceKey", g_ActionDeviceKey);
             Arena::SetNodeValue<int64_t>(pSystem->GetTLSystemNodeMap(), "ActionCommandGroupKey", g_ActionGroupKey);
-            Arena::SetNodeValue<int64_t>(pSystem->GetTLSystemNodeMap(), "ActionCommandGroupMask", g_ActionGroupMask);
             Arena::SetNodeValue<int64_t>(pSystem->GetTLSystemNodeMap(), "ActionCommandTargetIP", g_ActionCommandTargetIp);
 
             std::cout << TAB1 << "ActionCommandDeviceKey = " << g_ActionDeviceKey << std::endl;
             std::cout << TAB1 << "ActionCommandGroupKey = " << g_ActionGroupKey << std::endl;
-            std::cout << TAB1 << "ActionCommandGroupMask = " << g_ActionGroupMask << std::endl;
             std::cout << TAB1 << "ActionCommandTargetIP = " << (g_ActionCommandTargetIp >> 24 & 0xFF) << "." << (g_ActionCommandTargetIp >> 16 & 0xFF) << "." << (g_ActionCommandTargetIp >> 8 & 0xFF) << "." << (g_ActionCommandTargetIp & 0xFF) << std::endl;
         }
         std::cout << std::endl;
 
-        // run example
-
-        // get node values that will be changed in order to return their values at
-        // the end of the example
-        GenICam::gcstring pixelFormatInitialTRI = Arena::GetNodeValue<GenICam::gcstring>(pDeviceTRI->GetNodeMap(), "PixelFormat");
-        GenICam::gcstring pixelFormatInitialHLT = Arena::GetNodeValue<GenICam::gcstring>(pDeviceHLT->GetNodeMap(), "PixelFormat");
-
-        pDeviceHLT->StartStream();
-        pDeviceTRI->StartStream();
-
-        if (pDeviceTRI && pDeviceHLT) {
-            std::cout << "Capture " << NUM_ITERATIONS << " overlays \n\n";
-            for (int i = 0; i < NUM_ITERATIONS; i++) {
-                FireScheduledActionCommand(pSystem, pDeviceHLT);
-                int64_t actionCommandExecuteTime = Arena::GetNodeValue<int64_t>(pSystem->GetTLSystemNodeMap(), "ActionCommandExecuteTime");
-                OverlayColorOnto3DAndSave(pDeviceTRI, pDeviceHLT, actionCommandExecuteTime, i);
-            }
+        // run example, every rig streams on its own thread
+        {
+            ActionCommandSender sender(pSystem);
+            WorkerPool workerPool(g_worker_threads);
+            std::cout << TAB1 << "Processing on " << workerPool.Threads() << " threads\n";
+
+            if (g_continuous_mode)
+                std::signal(SIGINT, HandleStopSignal);
+            std::vector<std::future<void>> runs;
+            for (Rig& rig : rigs)
+                runs.push_back(std::async(std::launch::async, RunRig, std::ref(rig), std::ref(workerPool), std::ref(sender)));
+            for (std::future<void>& run : runs)
+                run.wait();
+            std::signal(SIGINT, SIG_DFL);
+            for (std::future<void>& run : runs)
+                run.get();
 
             std::cout << "\nExample complete\n";
         }
 
-        pDeviceHLT->StopStream();
-        pDeviceTRI->StopStream();
-
-        // return nodes to their initial values
-        Arena::SetNodeValue<GenICam::gcstring>(pDeviceTRI->GetNodeMap(), "PixelFormat", pixelFormatInitialTRI);
-        Arena::SetNodeValue<GenICam::gcstring>(pDeviceHLT->GetNodeMap(), "PixelFormat", pixelFormatInitialHLT);
+        // the settings stay on the devices, so the next start finds them in place and writes nothing
+        for (Rig& rig : rigs) {
+            if (g_restore_pixel_format) {
+                Arena::SetNodeValue<GenICam::gcstring>(rig.pDeviceTRI->GetNodeMap(), "PixelFormat", rig.pixelFormatInitialTRI);
+                Arena::SetNodeValue<GenICam::gcstring>(rig.pDeviceHLT->GetNodeMap(), "PixelFormat", rig.pixelFormatInitialHLT);
+            }
 
-        if (pDeviceTRI)
-            pSystem->DestroyDevice(pDeviceTRI);
-        if (pDeviceHLT)
-            pSystem->DestroyDevice(pDeviceHLT);
+            pSystem->DestroyDevice(rig.pDeviceTRI);
+            pSystem->DestroyDevice(rig.pDeviceHLT);
+        }
 
-        Arena::CloseSystem(pSystem);
+        if (g_simulate)
+            delete pSystem;
+        else
+            Arena::CloseSystem(pSystem);
     } catch (GenICam::GenericException& ge) {
         std::cout << "\nGenICam exception thrown: " << ge.what() << "\n";
         exceptionThrown = true;
@@ -532,8 +1006,10 @@ int main() {
         exceptionThrown = true;
     }
 
-    std::cout << "Press enter to complete\n";
-    std::getchar();
+    if (g_wait_for_enter) {
+        std::cout << "Press enter to complete\n";
+        std::getchar();
+    }
 
     if (exceptionThrown)
         return -1;
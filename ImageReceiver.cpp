@@ -0,0 +1,78 @@
+#include "ImageReceiver.h"
+
+#include <chrono>
+
+ImageReceiver::ImageReceiver(Arena::IDevice* pDevice, const std::string& name, size_t queueCapacity)
+    : m_pDevice(pDevice),
+      m_name(name),
+      m_queue(queueCapacity),
+      m_received(0),
+      m_incomplete(0),
+      m_overflow(0),
+      m_max_hold_ns(0) {
+    m_pDevice->RegisterImageCallback(this);
+}
+
+ImageReceiver::~ImageReceiver() {
+    m_pDevice->DeregisterImageCallback(this);
+    Drain();
+}
+
+void ImageReceiver::OnImage(Arena::IImage* pImage) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if (pImage->IsIncomplete()) {
+        m_incomplete++;
+        return;
+    }
+
+    // processing fell behind: only the consumer can drop the older queued frames, so the incoming one is dropped, before it is copied
+    if (m_queue.Full()) {
+        m_overflow++;
+        return;
+    }
+
+    ReceivedImage image;
+    image.timestampNs = pImage->GetTimestampNs();
+    image.frameId = pImage->GetFrameId();
+    // copied from the raw data so that images of any IImage implementation can be held
+    image.pImage = Arena::ImageFactory::Create(pImage->GetData(), pImage->GetSizeFilled(), pImage->GetWidth(), pImage->GetHeight(), pImage->GetPixelFormat());
+
+    // the engine gets the buffer back when this returns
+    int64_t hold_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    int64_t max_hold_ns = m_max_hold_ns.load();
+    while (hold_ns > max_hold_ns && !m_max_hold_ns.compare_exchange_weak(max_hold_ns, hold_ns)) {
+    }
+
+    // the producer is the only one filling the queue, so the room found above is still there
+    m_queue.TryPush(image);
+    m_received++;
+    m_wait_cv.notify_one();
+}
+
+bool ImageReceiver::Pop(ReceivedImage& image, uint64_t timeoutMs) {
+    if (m_queue.TryPop(image))
+        return true;
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::unique_lock<std::mutex> lock(m_wait_mutex);
+    while (!m_queue.TryPop(image)) {
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        // short waits cover a notify that lands between TryPop and wait
+        m_wait_cv.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void ImageReceiver::Release(ReceivedImage& image) {
+    if (image.pImage)
+        Arena::ImageFactory::Destroy(image.pImage);
+    image.pImage = nullptr;
+}
+
+void ImageReceiver::Drain() {
+    ReceivedImage image;
+    while (m_queue.TryPop(image))
+        Release(image);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include "ArenaApi.h"
+#include "SpscQueue.h"
+
+// An image copied out of the acquisition engine together with the metadata
+// read while the original buffer was still valid
+struct ReceivedImage {
+    Arena::IImage* pImage = nullptr;
+    uint64_t timestampNs = 0;
+    uint64_t frameId = 0;
+};
+
+// Receive path of one device. Arena calls OnImage() from the device's own grab
+// thread; the image is copied so the buffer goes straight back to the engine,
+// and the copy is handed to the processing thread through a lock-free queue.
+// The hand-off never waits on the consumer, but the copy is a full memcpy on
+// the grab thread, about 9 MB for a 2048x1536 RGB8 TRI frame, and shows in
+// TakeMaxHoldTimeNs(). Frames arriving while the queue is full are dropped
+// before the copy. Images taken with Pop() must be given back with Release().
+class ImageReceiver : public Arena::IImageCallback {
+   public:
+    ImageReceiver(Arena::IDevice* pDevice, const std::string& name, size_t queueCapacity);
+    ~ImageReceiver();
+
+    void OnImage(Arena::IImage* pImage) override;
+
+    // Waits up to timeoutMs for the next image, false on timeout
+    bool Pop(ReceivedImage& image, uint64_t timeoutMs);
+    static void Release(ReceivedImage& image);
+
+    // Destroys every image still waiting in the queue
+    void Drain();
+
+    const std::string& Name() const { return m_name; }
+    uint64_t ReceivedCount() const { return m_received; }
+    uint64_t IncompleteCount() const { return m_incomplete; }
+    uint64_t OverflowCount() const { return m_overflow; }
+
+    // Longest time an acquisition buffer was held in OnImage() since the last
+    // call, in ns. The buffer pool sizes itself from this.
+    int64_t TakeMaxHoldTimeNs() { return m_max_hold_ns.exchange(0); }
+
+   private:
+    Arena::IDevice* m_pDevice;
+    std::string m_name;
+    SpscQueue<ReceivedImage> m_queue;
+
+    // only used to sleep the consumer, the producer never takes the mutex
+    std::mutex m_wait_mutex;
+    std::condition_variable m_wait_cv;
+
+    std::atomic<uint64_t> m_received;
+    std::atomic<uint64_t> m_incomplete;
+    std::atomic<uint64_t> m_overflow;
+    std::atomic<int64_t> m_max_hold_ns;
+};
@@ -0,0 +1,47 @@
+#include "ImageRectifier.h"
+
+#include <algorithm>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+
+namespace {
+// rows of the rectified image remapped at a time, a few bands per thread
+// even out the borders, which cost less
+const int kBandRows = 32;
+
+// the pinhole model of the rectified image, same pose
+OverlayCalibration RectifiedCalibration(const OverlayCalibration& calibration, int width, int height, double alpha) {
+    if (calibration.cameraMatrix.total() != 9)
+        throw std::runtime_error("camera matrix missing from the calibration");
+    if (width <= 0 || height <= 0)
+        throw std::logic_error("rectifier for an empty image");
+
+    cv::Size size(width, height);
+    OverlayCalibration rectified;
+    rectified.cameraMatrix = cv::getOptimalNewCameraMatrix(calibration.cameraMatrix, calibration.distCoeffs, size, std::min(std::max(alpha, 0.0), 1.0), size);
+    rectified.distCoeffs = cv::Mat::zeros(1, 4, CV_64FC1);
+    rectified.rotationVector = calibration.rotationVector.clone();
+    rectified.translationVector = calibration.translationVector.clone();
+    return rectified;
+}
+}  // namespace
+
+ImageRectifier::ImageRectifier(const OverlayCalibration& calibration, int width, int height, double alpha)
+    : m_rectified(RectifiedCalibration(calibration, width, height, alpha)), m_projector(m_rectified) {
+    cv::initUndistortRectifyMap(calibration.cameraMatrix, calibration.distCoeffs, cv::Mat(), m_rectified.cameraMatrix, cv::Size(width, height), CV_16SC2, m_map, m_interpolation);
+}
+
+void ImageRectifier::Rectify(const cv::Mat& imageRGB, cv::Mat& rectified, WorkerPool& pool) const {
+    if (imageRGB.cols != m_map.cols || imageRGB.rows != m_map.rows)
+        throw std::logic_error("TRI image size differs from the rectifier");
+    rectified.create(m_map.rows, m_map.cols, imageRGB.type());
+
+    // each band reads the whole source but writes only its own rows
+    size_t bands = (static_cast<size_t>(m_map.rows) + kBandRows - 1) / kBandRows;
+    pool.ParallelFor(bands, std::min(bands, 4 * pool.Threads()), [&](size_t begin, size_t end) {
+        cv::Range rows(static_cast<int>(begin) * kBandRows, std::min(static_cast<int>(end) * kBandRows, m_map.rows));
+        cv::Mat band = rectified.rowRange(rows);
+        cv::remap(imageRGB, band, m_map.rowRange(rows), m_interpolation.rowRange(rows), cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    });
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <opencv2/core.hpp>
+
+#include "PointProjector.h"
+#include "WorkerPool.h"
+
+// Undistorts TRI images with remap tables built once from cameraMatrix and
+// distCoeffs. The HLT points are then projected onto the rectified image
+// with Projector(), built on Calibration() which has no distortion
+// coefficients, so it runs the pinhole kernel: one remap per image in place
+// of the distortion polynomial per point.
+class ImageRectifier {
+   public:
+    // alpha as in cv::getOptimalNewCameraMatrix: 0 keeps only rectified
+    // pixels that have a source pixel, 1 keeps every source pixel and leaves
+    // black borders
+    ImageRectifier(const OverlayCalibration& calibration, int width, int height, double alpha);
+
+    // Remaps imageRGB into rectified, which is allocated at the TRI size, in
+    // row bands over pool
+    void Rectify(const cv::Mat& imageRGB, cv::Mat& rectified, WorkerPool& pool) const;
+
+    // The calibration for projecting onto rectified images, pinhole
+    const OverlayCalibration& Calibration() const { return m_rectified; }
+    const PointProjector& Projector() const { return m_projector; }
+
+    size_t Bytes() const { return m_map.total() * m_map.elemSize() + m_interpolation.total() * m_interpolation.elemSize(); }
+
+   private:
+    OverlayCalibration m_rectified;
+    PointProjector m_projector;
+    cv::Mat m_map;            // CV_16SC2 source pixel of each rectified pixel
+    cv::Mat m_interpolation;  // CV_16UC1 bilinear weights, the fixed point maps cv::remap is fastest with
+};
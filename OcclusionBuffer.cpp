@@ -0,0 +1,76 @@
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// fewer points than this per part are not worth another grid to clear and merge
+const size_t kMinPartPoints = 16384;
+
+// cell of a projected point with the rounding of SampleNearestColor, or -1 off the image
+inline ptrdiff_t Cell(const cv::Point2f& projected, int width, int height, int shift, size_t gridCols) {
+    float col = std::round(projected.x);
+    float row = std::round(projected.y);
+    if (!(col >= 0.0f && col < width && row >= 0.0f && row < height))
+        return -1;
+    return static_cast<ptrdiff_t>((static_cast<size_t>(row) >> shift) * gridCols + (static_cast<size_t>(col) >> shift));
+}
+}  // namespace
+
+size_t OcclusionBuffer::Resolve(cv::Point2f* pProjected, const float* pDepth, size_t count, int width, int height, WorkerPool& pool) {
+    m_occluded.assign(count, 0);
+    m_occludedCount = 0;
+    if (count == 0)
+        return 0;
+
+    const int shift = std::max(m_settings.shift, 0);
+    const size_t gridCols = (static_cast<size_t>(width) + (size_t(1) << shift) - 1) >> shift;
+    const size_t gridRows = (static_cast<size_t>(height) + (size_t(1) << shift) - 1) >> shift;
+    const size_t cells = gridCols * gridRows;
+    const size_t parts = std::max<size_t>(1, std::min(pool.Threads(), count / kMinPartPoints));
+    m_partial.resize(parts * cells);
+    m_nearest.resize(cells);
+
+    // each part splats its own range of points into its own grid, no locking
+    pool.ParallelFor(parts, parts, [&](size_t partBegin, size_t partEnd) {
+        for (size_t part = partBegin; part < partEnd; part++) {
+            float* pNearest = &m_partial[part * cells];
+            std::fill_n(pNearest, cells, std::numeric_limits<float>::infinity());
+            for (size_t i = count * part / parts; i < count * (part + 1) / parts; i++) {
+                ptrdiff_t cell = Cell(pProjected[i], width, height, shift, gridCols);
+                if (cell >= 0 && pDepth[i] < pNearest[cell])
+                    pNearest[cell] = pDepth[i];
+            }
+        }
+    });
+
+    pool.ParallelFor(cells, [&](size_t begin, size_t end) {
+        std::copy(m_partial.data() + begin, m_partial.data() + end, m_nearest.data() + begin);
+        for (size_t part = 1; part < parts; part++) {
+            const float* pNearest = &m_partial[part * cells];
+            for (size_t cell = begin; cell < end; cell++)
+                m_nearest[cell] = std::min(m_nearest[cell], pNearest[cell]);
+        }
+    });
+
+    // a point with a NaN depth cannot be tested and stays visible
+    std::vector<size_t> partOccluded(parts);
+    const float tolerance = m_settings.toleranceMm;
+    pool.ParallelFor(parts, parts, [&](size_t partBegin, size_t partEnd) {
+        for (size_t part = partBegin; part < partEnd; part++) {
+            for (size_t i = count * part / parts; i < count * (part + 1) / parts; i++) {
+                ptrdiff_t cell = Cell(pProjected[i], width, height, shift, gridCols);
+                if (cell < 0 || !(pDepth[i] > m_nearest[cell] + tolerance))
+                    continue;
+                m_occluded[i] = 1;
+                pProjected[i] = cv::Point2f(std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN());
+                partOccluded[part]++;
+            }
+        }
+    });
+
+    for (size_t n : partOccluded)
+        m_occludedCount += n;
+    return m_occludedCount;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "WorkerPool.h"
+
+// Grid and depth tolerance of an OcclusionBuffer
+struct OcclusionSettings {
+    int shift = 2;             // a cell covers 1 << shift TRI pixels each way, so the few TRI pixels between HLT points leave no holes
+    float toleranceMm = 20.0f; // points this far behind the nearest surface of their cell still count as on it
+};
+
+// TRI space z-buffer for coloring only the points the TRI actually sees. The
+// projected points are splatted with their TRI depth into one buffer per
+// thread, the buffers are merged into the nearest depth per cell, and every
+// point further behind it than the tolerance is marked occluded. Points
+// hidden behind nearer geometry would otherwise take the color of what
+// hides them.
+class OcclusionBuffer {
+   public:
+    explicit OcclusionBuffer(const OcclusionSettings& settings) : m_settings(settings) {}
+
+    // Tests count points projected onto a width x height TRI image, NaN
+    // depths being skipped. Occluded points are marked in Occluded() and
+    // their projection is set to NaN, so the color sampling treats them like
+    // points off the image. Returns the number of occluded points.
+    size_t Resolve(cv::Point2f* pProjected, const float* pDepth, size_t count, int width, int height, WorkerPool& pool);
+
+    // 1 for each occluded point of the last Resolve
+    const std::vector<uint8_t>& Occluded() const { return m_occluded; }
+    size_t OccludedCount() const { return m_occludedCount; }
+
+    const OcclusionSettings& Settings() const { return m_settings; }
+
+    // projection and depth of a whole frame, gathered by the overlay before
+    // Resolve and reused between frames
+    std::vector<cv::Point2f> projected;
+    std::vector<float> depth;
+
+   private:
+    OcclusionSettings m_settings;
+    std::vector<float> m_partial;  // one grid per part, part by part
+    std::vector<float> m_nearest;
+    std::vector<uint8_t> m_occluded;
+    size_t m_occludedCount = 0;
+};
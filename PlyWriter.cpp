@@ -0,0 +1,132 @@
+#include "PlyWriter.h"
+
+#include <sys/stat.h>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+bool IsValidPoint(const float* pXYZ) {
+    return pXYZ[0] != 0.0f || pXYZ[1] != 0.0f || pXYZ[2] != 0.0f;
+}
+
+// the Arena writer used before created the output directory, keep doing so
+void CreateParentDirectory(const std::string& fileName) {
+    size_t slash = fileName.find_last_of('/');
+    if (slash != std::string::npos && slash > 0)
+        mkdir(fileName.substr(0, slash).c_str(), 0755);
+}
+
+// PLY header for count points, with or without intensity, the coordinates
+// being of coordinateType
+std::string PlyHeader(size_t count, bool intensity, const char* coordinateType = "float", const std::string& comment = "") {
+    std::ostringstream header;
+    header << "ply\n"
+           << "format binary_little_endian 1.0\n";
+    if (!comment.empty())
+        header << "comment " << comment << "\n";
+    header << "element vertex " << count << "\n"
+           << "property " << coordinateType << " x\n"
+           << "property " << coordinateType << " y\n"
+           << "property " << coordinateType << " z\n"
+           << "property uchar red\n"
+           << "property uchar green\n"
+           << "property uchar blue\n";
+    if (intensity)
+        header << "property ushort intensity\n";
+    header << "end_header\n";
+    return header.str();
+}
+
+// the hosts this runs on are little endian, so the values are copied as they are
+char* WriteRecord(char* pRecord, float x, float y, float z, const uint8_t* pColor, const uint16_t* pIntensity) {
+    std::memcpy(pRecord, &x, sizeof(float));
+    std::memcpy(pRecord + 4, &y, sizeof(float));
+    std::memcpy(pRecord + 8, &z, sizeof(float));
+    pRecord[12] = static_cast<char>(pColor[2]);
+    pRecord[13] = static_cast<char>(pColor[1]);
+    pRecord[14] = static_cast<char>(pColor[0]);
+    if (!pIntensity)
+        return pRecord + 15;
+    std::memcpy(pRecord + 15, pIntensity, sizeof(uint16_t));
+    return pRecord + 17;
+}
+
+// Scaled16 record: the coordinates as they are, 11 bytes instead of 17
+char* WriteScaledRecord(char* pRecord, uint16_t x, uint16_t y, uint16_t z, const uint8_t* pColor, uint16_t intensity) {
+    std::memcpy(pRecord, &x, sizeof(uint16_t));
+    std::memcpy(pRecord + 2, &y, sizeof(uint16_t));
+    std::memcpy(pRecord + 4, &z, sizeof(uint16_t));
+    pRecord[6] = static_cast<char>(pColor[2]);
+    pRecord[7] = static_cast<char>(pColor[1]);
+    pRecord[8] = static_cast<char>(pColor[0]);
+    std::memcpy(pRecord + 9, &intensity, sizeof(uint16_t));
+    return pRecord + 11;
+}
+
+void WriteFile(const std::string& fileName, const std::string& header, const std::vector<char>& body) {
+    CreateParentDirectory(fileName);
+    std::ofstream file(fileName, std::ios::binary);
+    file.write(header.data(), header.size());
+    file.write(body.data(), body.size());
+    if (!file)
+        throw std::runtime_error("failed to write " + fileName);
+}
+}  // namespace
+
+size_t WritePointCloudPly(const std::string& fileName, const float* pXYZ, const uint8_t* pColor, const uint16_t* pIntensity, size_t count) {
+    size_t valid = 0;
+    for (size_t i = 0; i < count; i++)
+        valid += IsValidPoint(pXYZ + 3 * i) ? 1 : 0;
+
+    std::vector<char> body(valid * (pIntensity ? 17 : 15));
+    char* pRecord = body.data();
+    for (size_t i = 0; i < count; i++) {
+        if (IsValidPoint(pXYZ + 3 * i))
+            pRecord = WriteRecord(pRecord, pXYZ[3 * i], pXYZ[3 * i + 1], pXYZ[3 * i + 2], pColor + 3 * i, pIntensity ? pIntensity + i : NULL);
+    }
+
+    WriteFile(fileName, PlyHeader(valid, pIntensity != NULL), body);
+    return valid;
+}
+
+size_t WritePointCloudPly(const std::string& fileName, const PointList& points, const uint8_t* pColor) {
+    if (points.format == PointFormat::Scaled16) {
+        std::vector<char> body(points.size * 11);
+        char* pRecord = body.data();
+        for (size_t i = 0; i < points.size; i++)
+            pRecord = WriteScaledRecord(pRecord, points.x16[i], points.y16[i], points.z16[i], pColor + 3 * i, points.intensity[i]);
+
+        std::ostringstream comment;
+        comment << "scaled16 mm = value * " << points.scale << " + offset, offset " << points.offset[0] << " " << points.offset[1] << " " << points.offset[2];
+        WriteFile(fileName, PlyHeader(points.size, true, "ushort", comment.str()), body);
+        return points.size;
+    }
+
+    // PLY has no half type, float16 lists are written as float
+    const float* pX = points.x.data();
+    const float* pY = points.y.data();
+    const float* pZ = points.z.data();
+    std::vector<float> unpacked;
+    if (points.format == PointFormat::Float16) {
+        unpacked.resize(3 * points.size);
+        SimdLevel level = DetectSimdLevel();
+        UnpackCoordinates(points.x16.data(), unpacked.data(), points.size, points.format, points.scale, points.offset[0], level);
+        UnpackCoordinates(points.y16.data(), unpacked.data() + points.size, points.size, points.format, points.scale, points.offset[1], level);
+        UnpackCoordinates(points.z16.data(), unpacked.data() + 2 * points.size, points.size, points.format, points.scale, points.offset[2], level);
+        pX = unpacked.data();
+        pY = pX + points.size;
+        pZ = pY + points.size;
+    }
+
+    std::vector<char> body(points.size * 17);
+    char* pRecord = body.data();
+    for (size_t i = 0; i < points.size; i++)
+        pRecord = WriteRecord(pRecord, pX[i], pY[i], pZ[i], pColor + 3 * i, &points.intensity[i]);
+
+    WriteFile(fileName, PlyHeader(points.size, true), body);
+    return points.size;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "PointCloudDecoder.h"
+
+// Writes a binary little endian PLY with x, y, z in mm, red, green, blue and,
+// when pIntensity is not null, the HLT intensity of each point. pColor holds
+// 3 bytes per point in reverse order (blue, green, red), as the overlay fills
+// it. Points at (0, 0, 0) are invalid or dropped and left out. The directory
+// of fileName is created if missing. Returns the number of points written;
+// throws std::runtime_error if the file cannot be written.
+size_t WritePointCloudPly(const std::string& fileName, const float* pXYZ, const uint8_t* pColor, const uint16_t* pIntensity, size_t count);
+
+// Same for a list of valid points, pColor holding the colors of the points.
+// Float16 lists are written as float. Scaled16 lists keep their 16 bit
+// values as ushort x, y, z, 11 instead of 17 bytes per point, with the scale
+// and offsets to mm in a header comment.
+size_t WritePointCloudPly(const std::string& fileName, const PointList& points, const uint8_t* pColor);
@@ -0,0 +1,726 @@
+#include "PointCloudDecoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POINT_CLOUD_DECODER_X86
+#endif
+
+namespace {
+const uint16_t kInvalid = 0xFFFF;
+
+struct DecodeConstants {
+    float scale;
+    float offset[3];
+    uint16_t threshold;
+};
+
+DecodeConstants ToConstants(const Scan3dCoefficients& coefficients, uint16_t intensityThreshold) {
+    DecodeConstants constants;
+    constants.threshold = intensityThreshold;
+    constants.scale = static_cast<float>(coefficients.scale);
+    constants.offset[0] = static_cast<float>(coefficients.offsetX);
+    constants.offset[1] = static_cast<float>(coefficients.offsetY);
+    constants.offset[2] = static_cast<float>(coefficients.offsetZ);
+    return constants;
+}
+
+void DecodeScalar(const uint16_t* pInput, float* pXYZ, uint16_t* pIntensity, size_t count, const DecodeConstants& c) {
+    for (size_t i = 0; i < count; i++, pInput += 4, pXYZ += 3) {
+        if (pIntensity)
+            pIntensity[i] = pInput[3];
+        if (pInput[0] == kInvalid || pInput[1] == kInvalid || pInput[2] == kInvalid || pInput[3] < c.threshold) {
+            pXYZ[0] = 0.0f;
+            pXYZ[1] = 0.0f;
+            pXYZ[2] = 0.0f;
+        } else {
+            pXYZ[0] = static_cast<float>(pInput[0]) * c.scale + c.offset[0];
+            pXYZ[1] = static_cast<float>(pInput[1]) * c.scale + c.offset[1];
+            pXYZ[2] = static_cast<float>(pInput[2]) * c.scale + c.offset[2];
+        }
+    }
+}
+
+// Destination of the compacting kernels, already moved to the first free entry
+struct CompactOutput {
+    float* pX;
+    float* pY;
+    float* pZ;
+    uint16_t* pIntensity;
+    uint32_t* pPixel;
+
+    void Advance(size_t n) {
+        pX += n;
+        pY += n;
+        pZ += n;
+        pIntensity += n;
+        pPixel += n;
+    }
+};
+
+size_t CompactScalar(const uint16_t* pInput, size_t count, uint32_t pixel, const DecodeConstants& c, CompactOutput out) {
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++, pInput += 4) {
+        if (pInput[0] == kInvalid || pInput[1] == kInvalid || pInput[2] == kInvalid || pInput[3] < c.threshold)
+            continue;
+        out.pX[n] = static_cast<float>(pInput[0]) * c.scale + c.offset[0];
+        out.pY[n] = static_cast<float>(pInput[1]) * c.scale + c.offset[1];
+        out.pZ[n] = static_cast<float>(pInput[2]) * c.scale + c.offset[2];
+        out.pIntensity[n] = pInput[3];
+        out.pPixel[n] = pixel + static_cast<uint32_t>(i);
+        n++;
+    }
+    return n;
+}
+
+// Coord3D_C16: one C per pixel, X and Y come from the ray of the pixel.
+// pRayX and pRayY point at the rays of the first pixel.
+size_t CompactC16Scalar(const uint16_t* pInput, size_t count, const float* pRayX, const float* pRayY, uint32_t pixel, const DecodeConstants& c, CompactOutput out) {
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (pInput[i] == kInvalid || std::isnan(pRayX[i]))
+            continue;
+        float z = static_cast<float>(pInput[i]) * c.scale + c.offset[2];
+        out.pX[n] = z * pRayX[i];
+        out.pY[n] = z * pRayY[i];
+        out.pZ[n] = z;
+        out.pIntensity[n] = 0;
+        out.pPixel[n] = pixel + static_cast<uint32_t>(i);
+        n++;
+    }
+    return n;
+}
+
+// float to half rounding to nearest even, the way F16C does, and back.
+// Subnormal halves are rounded by a float add of a magic number.
+float BitsToFloat(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+uint32_t FloatToBits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+uint16_t FloatToHalf(float value) {
+    const uint32_t infinity = 255u << 23;
+    const uint32_t overflow = (127u + 16u) << 23;
+    const uint32_t subnormalMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t bits = FloatToBits(value);
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint32_t half;
+    if (bits >= overflow) {
+        half = bits > infinity ? 0x7E00 : 0x7C00;
+    } else if (bits < (113u << 23)) {
+        half = FloatToBits(BitsToFloat(bits) + BitsToFloat(subnormalMagic)) - subnormalMagic;
+    } else {
+        uint32_t odd = (bits >> 13) & 1;
+        bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFF + odd;
+        half = bits >> 13;
+    }
+    return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+float HalfToFloat(uint16_t half) {
+    const uint32_t exponentMask = 0x7C00u << 13;
+    uint32_t bits = (half & 0x7FFFu) << 13;
+    uint32_t exponent = bits & exponentMask;
+    bits += (127u - 15u) << 23;
+    if (exponent == exponentMask)
+        bits += (128u - 16u) << 23;  // infinity or NaN
+    else if (exponent == 0)
+        bits = FloatToBits(BitsToFloat(bits + (1u << 23)) - BitsToFloat(113u << 23));  // zero or subnormal
+    return BitsToFloat(bits | (static_cast<uint32_t>(half & 0x8000u) << 16));
+}
+
+void PackScalar(const float* pInput, uint16_t* pOutput, size_t count, PointFormat format, float scale, float offset) {
+    if (format == PointFormat::Float16) {
+        for (size_t i = 0; i < count; i++)
+            pOutput[i] = FloatToHalf(pInput[i]);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        float value = std::min(std::max((pInput[i] - offset) / scale, 0.0f), 65535.0f);
+        pOutput[i] = static_cast<uint16_t>(std::nearbyint(value));
+    }
+}
+
+void UnpackScalar(const uint16_t* pInput, float* pOutput, size_t count, PointFormat format, float scale, float offset) {
+    if (format == PointFormat::Float16) {
+        for (size_t i = 0; i < count; i++)
+            pOutput[i] = HalfToFloat(pInput[i]);
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+        pOutput[i] = static_cast<float>(pInput[i]) * scale + offset;
+}
+
+#ifdef POINT_CLOUD_DECODER_X86
+// One pixel per 128 bit lane: A, B, C, Y as four floats. The store writes a
+// fourth float past the pixel, which the next pixel overwrites, so the vector
+// loops stop one pixel early and leave the last ones to the scalar tail.
+//
+// A pixel is dropped when A, B or C equal 0xFFFF or Y is below the threshold.
+// The per-lane compare results are ORed over all four lanes by swapping
+// neighbouring lanes and then halves.
+
+__attribute__((target("sse4.1"))) void DecodeSSE41(const uint16_t* pInput, float* pXYZ, uint16_t* pIntensity, size_t count, const DecodeConstants& c) {
+    const __m128 scale = _mm_setr_ps(c.scale, c.scale, c.scale, 0.0f);
+    const __m128 offset = _mm_setr_ps(c.offset[0], c.offset[1], c.offset[2], 0.0f);
+    const __m128i invalid = _mm_setr_epi32(kInvalid, kInvalid, kInvalid, -1);
+    const __m128i threshold = _mm_setr_epi32(0, 0, 0, c.threshold);
+
+    size_t i = 0;
+    for (; i + 1 < count; i++) {
+        __m128i abcy = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pInput + 4 * i)));
+        __m128 xyz = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(abcy), scale), offset);
+
+        __m128 mask = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(abcy, invalid), _mm_cmpgt_epi32(threshold, abcy)));
+        mask = _mm_or_ps(mask, _mm_shuffle_ps(mask, mask, _MM_SHUFFLE(2, 3, 0, 1)));
+        mask = _mm_or_ps(mask, _mm_shuffle_ps(mask, mask, _MM_SHUFFLE(1, 0, 3, 2)));
+        _mm_storeu_ps(pXYZ + 3 * i, _mm_andnot_ps(mask, xyz));
+        if (pIntensity)
+            pIntensity[i] = pInput[4 * i + 3];
+    }
+    DecodeScalar(pInput + 4 * i, pXYZ + 3 * i, pIntensity ? pIntensity + i : NULL, count - i, c);
+}
+
+// Four pixels per iteration, two per 256 bit register
+__attribute__((target("avx2"))) void DecodeAVX2(const uint16_t* pInput, float* pXYZ, uint16_t* pIntensity, size_t count, const DecodeConstants& c) {
+    const __m256 scale = _mm256_setr_ps(c.scale, c.scale, c.scale, 0.0f, c.scale, c.scale, c.scale, 0.0f);
+    const __m256 offset = _mm256_setr_ps(c.offset[0], c.offset[1], c.offset[2], 0.0f, c.offset[0], c.offset[1], c.offset[2], 0.0f);
+    const __m256i invalid = _mm256_setr_epi32(kInvalid, kInvalid, kInvalid, -1, kInvalid, kInvalid, kInvalid, -1);
+    const __m256i threshold = _mm256_setr_epi32(0, 0, 0, c.threshold, 0, 0, 0, c.threshold);
+
+    size_t i = 0;
+    for (; i + 4 < count; i += 4) {
+        __m256i raw = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pInput + 4 * i));
+        __m256i halves[2] = {_mm256_cvtepu16_epi32(_mm256_castsi256_si128(raw)), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(raw, 1))};
+
+        for (int h = 0; h < 2; h++) {
+            __m256 xyz = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(halves[h]), scale), offset);
+            __m256 mask = _mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpeq_epi32(halves[h], invalid), _mm256_cmpgt_epi32(threshold, halves[h])));
+            mask = _mm256_or_ps(mask, _mm256_permute_ps(mask, _MM_SHUFFLE(2, 3, 0, 1)));
+            mask = _mm256_or_ps(mask, _mm256_permute_ps(mask, _MM_SHUFFLE(1, 0, 3, 2)));
+            xyz = _mm256_andnot_ps(mask, xyz);
+
+            float* pOut = pXYZ + 3 * (i + 2 * h);
+            _mm_storeu_ps(pOut, _mm256_castps256_ps128(xyz));
+            _mm_storeu_ps(pOut + 3, _mm256_extractf128_ps(xyz, 1));
+        }
+        if (pIntensity) {
+            for (int k = 0; k < 4; k++)
+                pIntensity[i + k] = pInput[4 * (i + k) + 3];
+        }
+    }
+    DecodeScalar(pInput + 4 * i, pXYZ + 3 * i, pIntensity ? pIntensity + i : NULL, count - i, c);
+}
+
+// The compacting kernels first deinterleave the pixels into A, B, C and Y
+// vectors. A byte shuffle turns two pixels a0 b0 c0 y0 a1 b1 c1 y1 into
+// a0 a1 b0 b1 c0 c1 y0 y1, and 32 and 64 bit unpacks then gather the pairs.
+// The valid lanes are packed to the front with a permutation picked from the
+// valid mask, and the full vector is stored; the entries past the valid ones
+// are overwritten by the next store. Since no more points than pixels are
+// written, the stores never reach past offset + count.
+
+__attribute__((target("sse4.1"))) __m128i DeinterleavePair(const uint16_t* pInput) {
+    const __m128i pairs = _mm_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+    return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pInput)), pairs);
+}
+
+// byte shuffles moving the 32 bit lanes set in a 4 bit mask to the front
+struct CompactShuffles4 {
+    CompactShuffles4() {
+        for (int mask = 0; mask < 16; mask++) {
+            int lane = 0;
+            for (int bit = 0; bit < 4; bit++) {
+                if (mask & (1 << bit)) {
+                    for (int b = 0; b < 4; b++)
+                        bytes[mask][4 * lane + b] = static_cast<uint8_t>(4 * bit + b);
+                    lane++;
+                }
+            }
+            for (; lane < 4; lane++) {
+                for (int b = 0; b < 4; b++)
+                    bytes[mask][4 * lane + b] = 0x80;
+            }
+        }
+    }
+    alignas(16) uint8_t bytes[16][16];
+};
+
+// lane indices moving the 32 bit lanes set in an 8 bit mask to the front
+struct CompactPermutations8 {
+    CompactPermutations8() {
+        for (int mask = 0; mask < 256; mask++) {
+            int lane = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                if (mask & (1 << bit))
+                    indices[mask][lane++] = bit;
+            }
+            for (; lane < 8; lane++)
+                indices[mask][lane] = 0;
+        }
+    }
+    alignas(32) int32_t indices[256][8];
+};
+
+const CompactShuffles4 kCompactShuffles4;
+const CompactPermutations8 kCompactPermutations8;
+
+// Four pixels per iteration
+__attribute__((target("sse4.1"))) size_t CompactSSE41(const uint16_t* pInput, size_t count, uint32_t pixel, const DecodeConstants& c, CompactOutput out) {
+    const __m128 scale = _mm_set1_ps(c.scale);
+    const __m128 offsetX = _mm_set1_ps(c.offset[0]);
+    const __m128 offsetY = _mm_set1_ps(c.offset[1]);
+    const __m128 offsetZ = _mm_set1_ps(c.offset[2]);
+    const __m128i invalid = _mm_set1_epi32(kInvalid);
+    const __m128i threshold = _mm_set1_epi32(c.threshold);
+    const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i first = DeinterleavePair(pInput + 4 * i);
+        __m128i second = DeinterleavePair(pInput + 4 * i + 8);
+        __m128i ab = _mm_unpacklo_epi32(first, second);
+        __m128i cy = _mm_unpackhi_epi32(first, second);
+        __m128i a = _mm_cvtepu16_epi32(ab);
+        __m128i b = _mm_cvtepu16_epi32(_mm_srli_si128(ab, 8));
+        __m128i cc = _mm_cvtepu16_epi32(cy);
+        __m128i y = _mm_cvtepu16_epi32(_mm_srli_si128(cy, 8));
+
+        __m128i dropped = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(a, invalid), _mm_cmpeq_epi32(b, invalid)), _mm_or_si128(_mm_cmpeq_epi32(cc, invalid), _mm_cmpgt_epi32(threshold, y)));
+        int mask = ~_mm_movemask_ps(_mm_castsi128_ps(dropped)) & 0xF;
+        if (mask == 0)
+            continue;
+        __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(kCompactShuffles4.bytes[mask]));
+
+        __m128 x = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), scale), offsetX);
+        __m128 yy = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), scale), offsetY);
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(cc), scale), offsetZ);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.pX + n), _mm_shuffle_epi8(_mm_castps_si128(x), shuffle));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.pY + n), _mm_shuffle_epi8(_mm_castps_si128(yy), shuffle));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.pZ + n), _mm_shuffle_epi8(_mm_castps_si128(z), shuffle));
+        __m128i intensity = _mm_shuffle_epi8(y, shuffle);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out.pIntensity + n), _mm_packus_epi32(intensity, intensity));
+        __m128i pixels = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(pixel + i)), laneIndex);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.pPixel + n), _mm_shuffle_epi8(pixels, shuffle));
+
+        n += __builtin_popcount(mask);
+    }
+    out.Advance(n);
+    return n + CompactScalar(pInput + 4 * i, count - i, pixel + static_cast<uint32_t>(i), c, out);
+}
+
+// Eight pixels per iteration. The masks are computed on the 16 bit values,
+// an unsigned max tells which intensities reach the threshold.
+__attribute__((target("avx2"))) size_t CompactAVX2(const uint16_t* pInput, size_t count, uint32_t pixel, const DecodeConstants& c, CompactOutput out) {
+    const __m256 scale = _mm256_set1_ps(c.scale);
+    const __m256 offsetX = _mm256_set1_ps(c.offset[0]);
+    const __m256 offsetY = _mm256_set1_ps(c.offset[1]);
+    const __m256 offsetZ = _mm256_set1_ps(c.offset[2]);
+    const __m128i invalid = _mm_set1_epi16(static_cast<short>(kInvalid));
+    const __m128i threshold = _mm_set1_epi16(static_cast<short>(c.threshold));
+    const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i pairs[4];
+        for (int p = 0; p < 4; p++)
+            pairs[p] = DeinterleavePair(pInput + 4 * i + 8 * p);
+        __m128i abLow = _mm_unpacklo_epi32(pairs[0], pairs[1]);
+        __m128i cyLow = _mm_unpackhi_epi32(pairs[0], pairs[1]);
+        __m128i abHigh = _mm_unpacklo_epi32(pairs[2], pairs[3]);
+        __m128i cyHigh = _mm_unpackhi_epi32(pairs[2], pairs[3]);
+        __m128i a = _mm_unpacklo_epi64(abLow, abHigh);
+        __m128i b = _mm_unpackhi_epi64(abLow, abHigh);
+        __m128i cc = _mm_unpacklo_epi64(cyLow, cyHigh);
+        __m128i y = _mm_unpackhi_epi64(cyLow, cyHigh);
+
+        __m128i broken = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(a, invalid), _mm_cmpeq_epi16(b, invalid)), _mm_cmpeq_epi16(cc, invalid));
+        __m128i bright = _mm_cmpeq_epi16(_mm_max_epu16(y, threshold), y);
+        __m128i kept = _mm_andnot_si128(broken, bright);
+        int mask = _mm_movemask_epi8(_mm_packs_epi16(kept, _mm_setzero_si128())) & 0xFF;
+        if (mask == 0)
+            continue;
+        __m256i permutation = _mm256_load_si256(reinterpret_cast<const __m256i*>(kCompactPermutations8.indices[mask]));
+
+        __m256 x = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(a)), scale), offsetX);
+        __m256 yy = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(b)), scale), offsetY);
+        __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(cc)), scale), offsetZ);
+        _mm256_storeu_ps(out.pX + n, _mm256_permutevar8x32_ps(x, permutation));
+        _mm256_storeu_ps(out.pY + n, _mm256_permutevar8x32_ps(yy, permutation));
+        _mm256_storeu_ps(out.pZ + n, _mm256_permutevar8x32_ps(z, permutation));
+
+        // back to 16 bit: packus works per 128 bit half, the qword permute joins the halves
+        __m256i intensity = _mm256_permutevar8x32_epi32(_mm256_cvtepu16_epi32(y), permutation);
+        intensity = _mm256_permute4x64_epi64(_mm256_packus_epi32(intensity, intensity), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.pIntensity + n), _mm256_castsi256_si128(intensity));
+        __m256i pixels = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(pixel + i)), laneIndex);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.pPixel + n), _mm256_permutevar8x32_epi32(pixels, permutation));
+
+        n += __builtin_popcount(mask);
+    }
+    out.Advance(n);
+    return n + CompactScalar(pInput + 4 * i, count - i, pixel + static_cast<uint32_t>(i), c, out);
+}
+
+// The C16 kernels drop a pixel when C is 0xFFFF or its ray is NaN, an
+// ordered compare of the ray with itself tells the latter.
+
+// Four pixels per iteration
+__attribute__((target("sse4.1"))) size_t CompactC16SSE41(const uint16_t* pInput, size_t count, const float* pRayX, const float* pRayY, uint32_t pixel, const DecodeConstants& c, CompactOutput out) {
+    const __m128 scale = _mm_set1_ps(c.scale);
+    const __m128 offsetZ = _mm_set1_ps(c.offset[2]);
+    const __m128i invalid = _mm_set1_epi32(kInvalid);
+    const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i cc = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pInput + i)));
+        __m128 rayX = _mm_loadu_ps(pRayX + i);
+        __m128 kept = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(cc, invalid)), _mm_cmpord_ps(rayX, rayX));
+        int mask = _mm_movemask_ps(kept);
+        if (mask == 0)
+            continue;
+        __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(kCompactShuffles4.bytes[mask]));
+
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(cc), scale), offsetZ);
+        __m128 x = _mm_mul_ps(z, rayX);
+        __m128 y = _mm_mul_ps(z, _mm_loadu_ps(pRayY + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.pX + n), _mm_shuffle_epi8(_mm_castps_si128(x), shuffle));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.pY + n), _mm_shuffle_epi8(_mm_castps_si128(y), shuffle));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.pZ + n), _mm_shuffle_epi8(_mm_castps_si128(z), shuffle));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out.pIntensity + n), _mm_setzero_si128());
+        __m128i pixels = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(pixel + i)), laneIndex);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.pPixel + n), _mm_shuffle_epi8(pixels, shuffle));
+
+        n += __builtin_popcount(mask);
+    }
+    out.Advance(n);
+    return n + CompactC16Scalar(pInput + i, count - i, pRayX + i, pRayY + i, pixel + static_cast<uint32_t>(i), c, out);
+}
+
+// Eight pixels per iteration
+__attribute__((target("avx2"))) size_t CompactC16AVX2(const uint16_t* pInput, size_t count, const float* pRayX, const float* pRayY, uint32_t pixel, const DecodeConstants& c, CompactOutput out) {
+    const __m256 scale = _mm256_set1_ps(c.scale);
+    const __m256 offsetZ = _mm256_set1_ps(c.offset[2]);
+    const __m128i invalid = _mm_set1_epi16(static_cast<short>(kInvalid));
+    const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i cc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pInput + i));
+        __m256 rayX = _mm256_loadu_ps(pRayX + i);
+        __m256 broken = _mm256_castsi256_ps(_mm256_cvtepi16_epi32(_mm_cmpeq_epi16(cc, invalid)));
+        int mask = _mm256_movemask_ps(_mm256_andnot_ps(broken, _mm256_cmp_ps(rayX, rayX, _CMP_ORD_Q)));
+        if (mask == 0)
+            continue;
+        __m256i permutation = _mm256_load_si256(reinterpret_cast<const __m256i*>(kCompactPermutations8.indices[mask]));
+
+        __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(cc)), scale), offsetZ);
+        __m256 x = _mm256_mul_ps(z, rayX);
+        __m256 y = _mm256_mul_ps(z, _mm256_loadu_ps(pRayY + i));
+        _mm256_storeu_ps(out.pX + n, _mm256_permutevar8x32_ps(x, permutation));
+        _mm256_storeu_ps(out.pY + n, _mm256_permutevar8x32_ps(y, permutation));
+        _mm256_storeu_ps(out.pZ + n, _mm256_permutevar8x32_ps(z, permutation));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.pIntensity + n), _mm_setzero_si128());
+        __m256i pixels = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(pixel + i)), laneIndex);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.pPixel + n), _mm256_permutevar8x32_epi32(pixels, permutation));
+
+        n += __builtin_popcount(mask);
+    }
+    out.Advance(n);
+    return n + CompactC16Scalar(pInput + i, count - i, pRayX + i, pRayY + i, pixel + static_cast<uint32_t>(i), c, out);
+}
+
+// Eight coordinates per iteration. Every CPU with AVX2 also has F16C, so
+// the halves are converted by the AVX2 level; the rounding of the float to
+// int conversion is the default round to nearest even, like nearbyint.
+__attribute__((target("avx2,f16c"))) void PackAVX2(const float* pInput, uint16_t* pOutput, size_t count, PointFormat format, float scale, float offset) {
+    size_t i = 0;
+    if (format == PointFormat::Float16) {
+        for (; i + 8 <= count; i += 8)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pOutput + i), _mm256_cvtps_ph(_mm256_loadu_ps(pInput + i), _MM_FROUND_TO_NEAREST_INT));
+    } else {
+        const __m256 scaleVector = _mm256_set1_ps(scale);
+        const __m256 offsetVector = _mm256_set1_ps(offset);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 maximum = _mm256_set1_ps(65535.0f);
+        for (; i + 8 <= count; i += 8) {
+            __m256 value = _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(pInput + i), offsetVector), scaleVector);
+            __m256i code = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(value, zero), maximum));
+            code = _mm256_permute4x64_epi64(_mm256_packus_epi32(code, code), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pOutput + i), _mm256_castsi256_si128(code));
+        }
+    }
+    PackScalar(pInput + i, pOutput + i, count - i, format, scale, offset);
+}
+
+__attribute__((target("avx2,f16c"))) void UnpackAVX2(const uint16_t* pInput, float* pOutput, size_t count, PointFormat format, float scale, float offset) {
+    size_t i = 0;
+    if (format == PointFormat::Float16) {
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(pOutput + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pInput + i))));
+    } else {
+        const __m256 scaleVector = _mm256_set1_ps(scale);
+        const __m256 offsetVector = _mm256_set1_ps(offset);
+        for (; i + 8 <= count; i += 8) {
+            __m256 value = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pInput + i))));
+            _mm256_storeu_ps(pOutput + i, _mm256_add_ps(_mm256_mul_ps(value, scaleVector), offsetVector));
+        }
+    }
+    UnpackScalar(pInput + i, pOutput + i, count - i, format, scale, offset);
+}
+#endif
+}  // namespace
+
+SimdLevel DetectSimdLevel() {
+#ifdef POINT_CLOUD_DECODER_X86
+    static const SimdLevel level = __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : (__builtin_cpu_supports("sse4.1") ? SimdLevel::SSE41 : SimdLevel::Scalar);
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* SimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2:
+            return "AVX2";
+        case SimdLevel::SSE41:
+            return "SSE4.1";
+        default:
+            return "scalar";
+    }
+}
+
+void DecodeABCY16(const uint16_t* pInput, float* pXYZ, uint16_t* pIntensity, size_t count, const Scan3dCoefficients& coefficients, uint16_t intensityThreshold, SimdLevel level) {
+    DecodeConstants constants = ToConstants(coefficients, intensityThreshold);
+#ifdef POINT_CLOUD_DECODER_X86
+    // never run a level the CPU lacks
+    if (level > DetectSimdLevel())
+        level = DetectSimdLevel();
+    if (level == SimdLevel::AVX2) {
+        DecodeAVX2(pInput, pXYZ, pIntensity, count, constants);
+        return;
+    }
+    if (level == SimdLevel::SSE41) {
+        DecodeSSE41(pInput, pXYZ, pIntensity, count, constants);
+        return;
+    }
+#else
+    (void)level;
+#endif
+    DecodeScalar(pInput, pXYZ, pIntensity, count, constants);
+}
+
+void DecodeABCY16(const uint16_t* pInput, float* pXYZ, size_t count, const Scan3dCoefficients& coefficients, SimdLevel level) {
+    DecodeABCY16(pInput, pXYZ, NULL, count, coefficients, 0, level);
+}
+
+void DecodeABCY16(const uint16_t* pInput, float* pXYZ, size_t count, const Scan3dCoefficients& coefficients) {
+    DecodeABCY16(pInput, pXYZ, NULL, count, coefficients, 0, DetectSimdLevel());
+}
+
+void DecodeABCY16Parallel(const uint16_t* pInput, float* pXYZ, uint16_t* pIntensity, size_t width, size_t height, const Scan3dCoefficients& coefficients, uint16_t intensityThreshold, WorkerPool& pool) {
+    SimdLevel level = DetectSimdLevel();
+    pool.ParallelFor(height, [=, &coefficients](size_t rowBegin, size_t rowEnd) {
+        size_t first = width * rowBegin;
+        DecodeABCY16(pInput + 4 * first, pXYZ + 3 * first, pIntensity ? pIntensity + first : NULL, width * (rowEnd - rowBegin), coefficients, intensityThreshold, level);
+    });
+}
+
+const char* PointFormatName(PointFormat format) {
+    switch (format) {
+        case PointFormat::Float16:
+            return "float16";
+        case PointFormat::Scaled16:
+            return "scaled16";
+        default:
+            return "float32";
+    }
+}
+
+void PointList::Reserve(size_t pixels) {
+    if (format == PointFormat::Float32 && x.size() < pixels) {
+        x.resize(pixels);
+        y.resize(pixels);
+        z.resize(pixels);
+    }
+    if (format != PointFormat::Float32 && x16.size() < pixels) {
+        x16.resize(pixels);
+        y16.resize(pixels);
+        z16.resize(pixels);
+    }
+    if (intensity.size() < pixels) {
+        intensity.resize(pixels);
+        pixel.resize(pixels);
+    }
+}
+
+size_t DecodeABCY16Compact(const uint16_t* pInput, size_t count, uint32_t firstPixel, const Scan3dCoefficients& coefficients, uint16_t intensityThreshold, PointList& points, size_t offset, SimdLevel level) {
+    if (count == 0)
+        return 0;
+    DecodeConstants constants = ToConstants(coefficients, intensityThreshold);
+    CompactOutput out = {&points.x[offset], &points.y[offset], &points.z[offset], &points.intensity[offset], &points.pixel[offset]};
+#ifdef POINT_CLOUD_DECODER_X86
+    if (level > DetectSimdLevel())
+        level = DetectSimdLevel();
+    if (level == SimdLevel::AVX2)
+        return CompactAVX2(pInput, count, firstPixel, constants, out);
+    if (level == SimdLevel::SSE41)
+        return CompactSSE41(pInput, count, firstPixel, constants, out);
+#else
+    (void)level;
+#endif
+    return CompactScalar(pInput, count, firstPixel, constants, out);
+}
+
+RayTable RayTableFromIntrinsics(size_t width, size_t height, double fx, double fy, double cx, double cy) {
+    RayTable rays;
+    rays.width = width;
+    rays.height = height;
+    rays.x.resize(width * height);
+    rays.y.resize(width * height);
+    for (size_t row = 0; row < height; row++) {
+        float rayY = static_cast<float>((static_cast<double>(row) - cy) / fy);
+        for (size_t col = 0; col < width; col++) {
+            rays.x[row * width + col] = static_cast<float>((static_cast<double>(col) - cx) / fx);
+            rays.y[row * width + col] = rayY;
+        }
+    }
+    return rays;
+}
+
+RayTable RayTableFromABCY16(const uint16_t* pInput, size_t width, size_t height, const Scan3dCoefficients& coefficients, const RayTable& fallback) {
+    if (!fallback.Empty() && (fallback.width != width || fallback.height != height))
+        throw std::logic_error("fallback ray table does not match the frame");
+
+    RayTable rays;
+    rays.width = width;
+    rays.height = height;
+    rays.x.assign(width * height, std::numeric_limits<float>::quiet_NaN());
+    rays.y.assign(width * height, std::numeric_limits<float>::quiet_NaN());
+    for (size_t i = 0; i < width * height; i++, pInput += 4) {
+        double z = pInput[2] * coefficients.scale + coefficients.offsetZ;
+        if (pInput[0] != kInvalid && pInput[1] != kInvalid && pInput[2] != kInvalid && z > 0.0) {
+            rays.x[i] = static_cast<float>((pInput[0] * coefficients.scale + coefficients.offsetX) / z);
+            rays.y[i] = static_cast<float>((pInput[1] * coefficients.scale + coefficients.offsetY) / z);
+        } else if (!fallback.Empty()) {
+            rays.x[i] = fallback.x[i];
+            rays.y[i] = fallback.y[i];
+        }
+    }
+    return rays;
+}
+
+void DecodeC16(const uint16_t* pInput, float* pXYZ, size_t count, uint32_t firstPixel, const RayTable& rays, const Scan3dCoefficients& coefficients) {
+    DecodeConstants c = ToConstants(coefficients, 0);
+    const float* pRayX = &rays.x[firstPixel];
+    const float* pRayY = &rays.y[firstPixel];
+    for (size_t i = 0; i < count; i++, pXYZ += 3) {
+        if (pInput[i] == kInvalid || std::isnan(pRayX[i])) {
+            pXYZ[0] = 0.0f;
+            pXYZ[1] = 0.0f;
+            pXYZ[2] = 0.0f;
+        } else {
+            float z = static_cast<float>(pInput[i]) * c.scale + c.offset[2];
+            pXYZ[0] = z * pRayX[i];
+            pXYZ[1] = z * pRayY[i];
+            pXYZ[2] = z;
+        }
+    }
+}
+
+void DecodeC16Parallel(const uint16_t* pInput, float* pXYZ, const RayTable& rays, const Scan3dCoefficients& coefficients, WorkerPool& pool) {
+    size_t width = rays.width;
+    pool.ParallelFor(rays.height, [=, &rays, &coefficients](size_t rowBegin, size_t rowEnd) {
+        size_t first = width * rowBegin;
+        DecodeC16(pInput + first, pXYZ + 3 * first, width * (rowEnd - rowBegin), static_cast<uint32_t>(first), rays, coefficients);
+    });
+}
+
+size_t DecodeC16Compact(const uint16_t* pInput, size_t count, uint32_t firstPixel, const RayTable& rays, const Scan3dCoefficients& coefficients, PointList& points, size_t offset, SimdLevel level) {
+    if (count == 0)
+        return 0;
+    DecodeConstants constants = ToConstants(coefficients, 0);
+    CompactOutput out = {&points.x[offset], &points.y[offset], &points.z[offset], &points.intensity[offset], &points.pixel[offset]};
+    const float* pRayX = &rays.x[firstPixel];
+    const float* pRayY = &rays.y[firstPixel];
+#ifdef POINT_CLOUD_DECODER_X86
+    if (level > DetectSimdLevel())
+        level = DetectSimdLevel();
+    if (level == SimdLevel::AVX2)
+        return CompactC16AVX2(pInput, count, pRayX, pRayY, firstPixel, constants, out);
+    if (level == SimdLevel::SSE41)
+        return CompactC16SSE41(pInput, count, pRayX, pRayY, firstPixel, constants, out);
+#else
+    (void)level;
+#endif
+    return CompactC16Scalar(pInput, count, pRayX, pRayY, firstPixel, constants, out);
+}
+
+void PackCoordinates(const float* pInput, uint16_t* pOutput, size_t count, PointFormat format, float scale, float offset, SimdLevel level) {
+    if (format == PointFormat::Float32)
+        throw std::logic_error("PackCoordinates needs a 16 bit point format");
+#ifdef POINT_CLOUD_DECODER_X86
+    if (level > DetectSimdLevel())
+        level = DetectSimdLevel();
+    if (level == SimdLevel::AVX2) {
+        PackAVX2(pInput, pOutput, count, format, scale, offset);
+        return;
+    }
+#else
+    (void)level;
+#endif
+    PackScalar(pInput, pOutput, count, format, scale, offset);
+}
+
+void UnpackCoordinates(const uint16_t* pInput, float* pOutput, size_t count, PointFormat format, float scale, float offset, SimdLevel level) {
+    if (format == PointFormat::Float32)
+        throw std::logic_error("UnpackCoordinates needs a 16 bit point format");
+#ifdef POINT_CLOUD_DECODER_X86
+    if (level > DetectSimdLevel())
+        level = DetectSimdLevel();
+    if (level == SimdLevel::AVX2) {
+        UnpackAVX2(pInput, pOutput, count, format, scale, offset);
+        return;
+    }
+#else
+    (void)level;
+#endif
+    UnpackScalar(pInput, pOutput, count, format, scale, offset);
+}
+
+void PackPoints(const PointList& source, size_t sourceOffset, PointList& target, size_t targetOffset, size_t count, SimdLevel level) {
+    if (count == 0)
+        return;
+    if (target.format == PointFormat::Float32) {
+        std::copy_n(&source.x[sourceOffset], count, &target.x[targetOffset]);
+        std::copy_n(&source.y[sourceOffset], count, &target.y[targetOffset]);
+        std::copy_n(&source.z[sourceOffset], count, &target.z[targetOffset]);
+    } else {
+        PackCoordinates(&source.x[sourceOffset], &target.x16[targetOffset], count, target.format, target.scale, target.offset[0], level);
+        PackCoordinates(&source.y[sourceOffset], &target.y16[targetOffset], count, target.format, target.scale, target.offset[1], level);
+        PackCoordinates(&source.z[sourceOffset], &target.z16[targetOffset], count, target.format, target.scale, target.offset[2], level);
+    }
+    std::copy_n(&source.intensity[sourceOffset], count, &target.intensity[targetOffset]);
+    std::copy_n(&source.pixel[sourceOffset], count, &target.pixel[targetOffset]);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FeatureCache.h"
+#include "WorkerPool.h"
+
+// Instruction sets the decode kernels are built for, picked at runtime
+enum class SimdLevel {
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+// Best level the CPU supports
+SimdLevel DetectSimdLevel();
+const char* SimdLevelName(SimdLevel level);
+
+// Storage of the point coordinates
+enum class PointFormat {
+    Float32,  // float mm
+    Float16,  // half precision mm: 1 mm steps up to 2 m, 4 mm up to 8 m
+    Scaled16  // unsigned 16 bit, mm = value * scale + offset as streamed by the HLT
+};
+
+const char* PointFormatName(PointFormat format);
+
+// Valid points of a frame as a structure of arrays, in pixel order. The
+// arrays are sized for a full frame by Reserve and reused from frame to
+// frame; the first size entries are in use. The coordinates are in x, y, z
+// for PointFormat::Float32 and in x16, y16, z16 otherwise. The decoders
+// only write Float32 lists.
+struct PointList {
+    PointFormat format = PointFormat::Float32;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<uint16_t> x16;
+    std::vector<uint16_t> y16;
+    std::vector<uint16_t> z16;
+    float scale = 1.0f;                   // Scaled16 only
+    float offset[3] = {0.0f, 0.0f, 0.0f};
+    std::vector<uint16_t> intensity;
+    std::vector<uint32_t> pixel;  // source pixel, row * width + column
+    size_t size = 0;
+
+    // sizes the arrays used by format
+    void Reserve(size_t pixels);
+};
+
+// Decodes count interleaved Coord3D_ABCY16 pixels (A, B, C, Y) into
+// interleaved X, Y, Z floats in mm. A pixel with any coordinate at 0xFFFF, or
+// with an intensity Y below intensityThreshold, is dropped and becomes
+// (0, 0, 0). pIntensity receives Y of every pixel when not null. Every level
+// computes in float with a separate multiply and add, so all levels give
+// bit-identical results.
+void DecodeABCY16(const uint16_t* pInput, float* pXYZ, uint16_t* pIntensity, size_t count, const Scan3dCoefficients& coefficients, uint16_t intensityThreshold, SimdLevel level);
+void DecodeABCY16(const uint16_t* pInput, float* pXYZ, size_t count, const Scan3dCoefficients& coefficients, SimdLevel level);
+void DecodeABCY16(const uint16_t* pInput, float* pXYZ, size_t count, const Scan3dCoefficients& coefficients);
+
+// Decodes a width x height frame in row bands, one per thread of pool. Each
+// pixel goes through the same kernel, so the result does not depend on the
+// number of threads.
+void DecodeABCY16Parallel(const uint16_t* pInput, float* pXYZ, uint16_t* pIntensity, size_t width, size_t height, const Scan3dCoefficients& coefficients, uint16_t intensityThreshold, WorkerPool& pool);
+
+// Decodes like DecodeABCY16 but keeps only the valid points, packed into
+// points from index offset on. The source pixel of the first input is
+// firstPixel. Returns the number of points written; entries up to
+// offset + count may be overwritten. Bit-identical across levels.
+size_t DecodeABCY16Compact(const uint16_t* pInput, size_t count, uint32_t firstPixel, const Scan3dCoefficients& coefficients, uint16_t intensityThreshold, PointList& points, size_t offset, SimdLevel level);
+
+// X / Z and Y / Z of the ray through each HLT pixel, row by row. A
+// Coord3D_C16 frame only carries Z; X and Y are rebuilt as Z times the ray.
+// Pixels with an unknown ray hold NaN and never yield a point.
+struct RayTable {
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<float> x;
+    std::vector<float> y;
+
+    bool Empty() const { return x.empty(); }
+};
+
+// Pinhole rays from the HLT intrinsics, in pixels
+RayTable RayTableFromIntrinsics(size_t width, size_t height, double fx, double fy, double cx, double cy);
+
+// Rays measured on a Coord3D_ABCY16 frame. Pixels without a valid point take
+// the ray of fallback, or NaN when fallback is empty.
+RayTable RayTableFromABCY16(const uint16_t* pInput, size_t width, size_t height, const Scan3dCoefficients& coefficients, const RayTable& fallback);
+
+// Decodes count Coord3D_C16 pixels, the first one being pixel firstPixel of
+// the frame, into interleaved X, Y, Z floats in mm. Z is C * scale + offsetZ.
+// Pixels at 0xFFFF or with an unknown ray become (0, 0, 0). There is no
+// intensity in this format. Used for saving only, so it stays scalar.
+void DecodeC16(const uint16_t* pInput, float* pXYZ, size_t count, uint32_t firstPixel, const RayTable& rays, const Scan3dCoefficients& coefficients);
+
+// Decodes a full frame of the size of rays in row bands over pool
+void DecodeC16Parallel(const uint16_t* pInput, float* pXYZ, const RayTable& rays, const Scan3dCoefficients& coefficients, WorkerPool& pool);
+
+// Decodes like DecodeC16 but keeps only the valid points, packed into points
+// from index offset on, like DecodeABCY16Compact. Their intensity is 0.
+// Bit-identical across levels.
+size_t DecodeC16Compact(const uint16_t* pInput, size_t count, uint32_t firstPixel, const RayTable& rays, const Scan3dCoefficients& coefficients, PointList& points, size_t offset, SimdLevel level);
+
+// Converts float coordinates in mm to the 16 bit ones of format, Float16 or
+// Scaled16. Float16 rounds to nearest even; Scaled16 stores
+// (coordinate - offset) / scale rounded to nearest even and clamped to
+// 0..65535, which is lossless for coordinates decoded with the same scale
+// and offset. Inputs must be finite. Bit-identical across levels.
+void PackCoordinates(const float* pInput, uint16_t* pOutput, size_t count, PointFormat format, float scale, float offset, SimdLevel level);
+
+// Converts 16 bit coordinates of format back to float mm, Scaled16 as
+// value * scale + offset
+void UnpackCoordinates(const uint16_t* pInput, float* pOutput, size_t count, PointFormat format, float scale, float offset, SimdLevel level);
+
+// Converts count Float32 points of source from sourceOffset on into target
+// from targetOffset on, in the format of target, intensity and pixel
+// included. Scaled16 uses the scale and offset of target.
+void PackPoints(const PointList& source, size_t sourceOffset, PointList& target, size_t targetOffset, size_t count, SimdLevel level);
@@ -0,0 +1,299 @@
+#include "PointProjector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <opencv2/calib3d.hpp>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POINT_PROJECTOR_X86
+#endif
+
+namespace {
+// distortion terms, each one a group of the 14 OpenCV coefficients
+// k1 k2 p1 p2 k3 k4 k5 k6 s1 s2 s3 s4 tauX tauY
+const int kRadial = 1;      // k1 k2 k3
+const int kTangential = 2;  // p1 p2
+const int kRational = 4;    // k4 k5 k6
+const int kThinPrism = 8;   // s1 s2 s3 s4
+const int kTilt = 16;       // tauX tauY
+
+typedef PointProjector::Model Model;
+
+double MatValue(const cv::Mat& mat, int index) {
+    if (mat.depth() == CV_32F)
+        return mat.ptr<float>()[index];
+    return mat.ptr<double>()[index];
+}
+
+// the matrix cv::projectPoints applies for the tilt of the sensor
+void TiltMatrix(double tauX, double tauY, double* pTilt) {
+    double cTauX = std::cos(tauX);
+    double sTauX = std::sin(tauX);
+    double cTauY = std::cos(tauY);
+    double sTauY = std::sin(tauY);
+    const double rotX[9] = {1, 0, 0, 0, cTauX, sTauX, 0, -sTauX, cTauX};
+    const double rotY[9] = {cTauY, 0, -sTauY, 0, 1, 0, sTauY, 0, cTauY};
+    double rotXY[9];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++)
+            rotXY[3 * r + c] = rotY[3 * r] * rotX[c] + rotY[3 * r + 1] * rotX[3 + c] + rotY[3 * r + 2] * rotX[6 + c];
+    }
+    const double projZ[9] = {rotXY[8], 0, -rotXY[2], 0, rotXY[8], -rotXY[5], 0, 0, 1};
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++)
+            pTilt[3 * r + c] = projZ[3 * r] * rotXY[c] + projZ[3 * r + 1] * rotXY[3 + c] + projZ[3 * r + 2] * rotXY[6 + c];
+    }
+}
+
+// One point, the terms not in Terms left out. Each step keeps the operand
+// order of cv::projectPoints, and the left out terms add zero or multiply
+// by one there, so the result is the same.
+template <int Terms>
+inline void ProjectPoint(const Model& m, double X, double Y, double Z, cv::Point2f& projected) {
+    double x = m.rotation[0] * X + m.rotation[1] * Y + m.rotation[2] * Z + m.translation[0];
+    double y = m.rotation[3] * X + m.rotation[4] * Y + m.rotation[5] * Z + m.translation[1];
+    double z = m.rotation[6] * X + m.rotation[7] * Y + m.rotation[8] * Z + m.translation[2];
+    z = z ? 1.0 / z : 1.0;
+    x *= z;
+    y *= z;
+
+    double xd = x;
+    double yd = y;
+    if (Terms != 0) {
+        double r2 = x * x + y * y;
+        double r4 = r2 * r2;
+        if (Terms & (kRadial | kRational)) {
+            double r6 = r4 * r2;
+            if (Terms & kRadial) {
+                double cdist = 1.0 + m.k[0] * r2 + m.k[1] * r4 + m.k[4] * r6;
+                xd = xd * cdist;
+                yd = yd * cdist;
+            }
+            if (Terms & kRational) {
+                double icdist2 = 1.0 / (1.0 + m.k[5] * r2 + m.k[6] * r4 + m.k[7] * r6);
+                xd = xd * icdist2;
+                yd = yd * icdist2;
+            }
+        }
+        if (Terms & kTangential) {
+            double a1 = 2.0 * x * y;
+            double a2 = r2 + 2.0 * x * x;
+            double a3 = r2 + 2.0 * y * y;
+            xd = xd + m.k[2] * a1 + m.k[3] * a2;
+            yd = yd + m.k[2] * a3 + m.k[3] * a1;
+        }
+        if (Terms & kThinPrism) {
+            xd = xd + m.k[8] * r2 + m.k[9] * r4;
+            yd = yd + m.k[10] * r2 + m.k[11] * r4;
+        }
+        if (Terms & kTilt) {
+            double tiltX = m.tilt[0] * xd + m.tilt[1] * yd + m.tilt[2];
+            double tiltY = m.tilt[3] * xd + m.tilt[4] * yd + m.tilt[5];
+            double tiltZ = m.tilt[6] * xd + m.tilt[7] * yd + m.tilt[8];
+            double invProj = tiltZ ? 1.0 / tiltZ : 1.0;
+            xd = invProj * tiltX;
+            yd = invProj * tiltY;
+        }
+    }
+    projected.x = static_cast<float>(xd * m.fx + m.cx);
+    projected.y = static_cast<float>(yd * m.fy + m.cy);
+}
+
+template <int Terms>
+void ProjectScalar(const Model& m, const float* pX, const float* pY, const float* pZ, size_t count, cv::Point2f* pProjected) {
+    for (size_t i = 0; i < count; i++)
+        ProjectPoint<Terms>(m, pX[i], pY[i], pZ[i], pProjected[i]);
+}
+
+#ifdef POINT_PROJECTOR_X86
+// Four points per iteration, the same steps as ProjectPoint in double lanes
+
+__attribute__((target("avx2"))) inline __m256d Row(const double* pRow, double translation, __m256d X, __m256d Y, __m256d Z) {
+    __m256d sum = _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(pRow[0]), X), _mm256_mul_pd(_mm256_set1_pd(pRow[1]), Y));
+    sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_set1_pd(pRow[2]), Z));
+    return _mm256_add_pd(sum, _mm256_set1_pd(translation));
+}
+
+// 1 / value, or 1 where value is 0
+__attribute__((target("avx2"))) inline __m256d SafeReciprocal(__m256d value) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    return _mm256_blendv_pd(_mm256_div_pd(one, value), one, _mm256_cmp_pd(value, _mm256_setzero_pd(), _CMP_EQ_OQ));
+}
+
+// a + b * c, rounded after the multiply and after the add
+__attribute__((target("avx2"))) inline __m256d AddProduct(__m256d a, double b, __m256d c) {
+    return _mm256_add_pd(a, _mm256_mul_pd(_mm256_set1_pd(b), c));
+}
+
+template <int Terms>
+__attribute__((target("avx2"))) void ProjectAVX2(const Model& m, const float* pX, const float* pY, const float* pZ, size_t count, cv::Point2f* pProjected) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    float* pOut = reinterpret_cast<float*>(pProjected);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d X = _mm256_cvtps_pd(_mm_loadu_ps(pX + i));
+        __m256d Y = _mm256_cvtps_pd(_mm_loadu_ps(pY + i));
+        __m256d Z = _mm256_cvtps_pd(_mm_loadu_ps(pZ + i));
+        __m256d x = Row(m.rotation, m.translation[0], X, Y, Z);
+        __m256d y = Row(m.rotation + 3, m.translation[1], X, Y, Z);
+        __m256d z = SafeReciprocal(Row(m.rotation + 6, m.translation[2], X, Y, Z));
+        x = _mm256_mul_pd(x, z);
+        y = _mm256_mul_pd(y, z);
+
+        __m256d xd = x;
+        __m256d yd = y;
+        if (Terms != 0) {
+            __m256d r2 = _mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y));
+            __m256d r4 = _mm256_mul_pd(r2, r2);
+            if (Terms & (kRadial | kRational)) {
+                __m256d r6 = _mm256_mul_pd(r4, r2);
+                if (Terms & kRadial) {
+                    __m256d cdist = AddProduct(AddProduct(AddProduct(one, m.k[0], r2), m.k[1], r4), m.k[4], r6);
+                    xd = _mm256_mul_pd(xd, cdist);
+                    yd = _mm256_mul_pd(yd, cdist);
+                }
+                if (Terms & kRational) {
+                    __m256d icdist2 = _mm256_div_pd(one, AddProduct(AddProduct(AddProduct(one, m.k[5], r2), m.k[6], r4), m.k[7], r6));
+                    xd = _mm256_mul_pd(xd, icdist2);
+                    yd = _mm256_mul_pd(yd, icdist2);
+                }
+            }
+            if (Terms & kTangential) {
+                __m256d a1 = _mm256_mul_pd(_mm256_mul_pd(two, x), y);
+                __m256d a2 = _mm256_add_pd(r2, _mm256_mul_pd(_mm256_mul_pd(two, x), x));
+                __m256d a3 = _mm256_add_pd(r2, _mm256_mul_pd(_mm256_mul_pd(two, y), y));
+                xd = AddProduct(AddProduct(xd, m.k[2], a1), m.k[3], a2);
+                yd = AddProduct(AddProduct(yd, m.k[2], a3), m.k[3], a1);
+            }
+            if (Terms & kThinPrism) {
+                xd = AddProduct(AddProduct(xd, m.k[8], r2), m.k[9], r4);
+                yd = AddProduct(AddProduct(yd, m.k[10], r2), m.k[11], r4);
+            }
+            if (Terms & kTilt) {
+                __m256d tiltX = _mm256_add_pd(AddProduct(_mm256_mul_pd(_mm256_set1_pd(m.tilt[0]), xd), m.tilt[1], yd), _mm256_set1_pd(m.tilt[2]));
+                __m256d tiltY = _mm256_add_pd(AddProduct(_mm256_mul_pd(_mm256_set1_pd(m.tilt[3]), xd), m.tilt[4], yd), _mm256_set1_pd(m.tilt[5]));
+                __m256d tiltZ = _mm256_add_pd(AddProduct(_mm256_mul_pd(_mm256_set1_pd(m.tilt[6]), xd), m.tilt[7], yd), _mm256_set1_pd(m.tilt[8]));
+                __m256d invProj = SafeReciprocal(tiltZ);
+                xd = _mm256_mul_pd(invProj, tiltX);
+                yd = _mm256_mul_pd(invProj, tiltY);
+            }
+        }
+
+        __m128 u = _mm256_cvtpd_ps(_mm256_add_pd(_mm256_mul_pd(xd, _mm256_set1_pd(m.fx)), _mm256_set1_pd(m.cx)));
+        __m128 v = _mm256_cvtpd_ps(_mm256_add_pd(_mm256_mul_pd(yd, _mm256_set1_pd(m.fy)), _mm256_set1_pd(m.cy)));
+        _mm_storeu_ps(pOut + 2 * i, _mm_unpacklo_ps(u, v));
+        _mm_storeu_ps(pOut + 2 * i + 4, _mm_unpackhi_ps(u, v));
+    }
+    ProjectScalar<Terms>(m, pX + i, pY + i, pZ + i, count - i, pProjected + i);
+}
+#endif
+
+typedef void (*ProjectKernel)(const Model&, const float*, const float*, const float*, size_t, cv::Point2f*);
+
+// a kernel for each of the 32 term sets
+#define PROJECT_KERNELS_8(Kernel, first) Kernel<first>, Kernel<first + 1>, Kernel<first + 2>, Kernel<first + 3>, Kernel<first + 4>, Kernel<first + 5>, Kernel<first + 6>, Kernel<first + 7>
+#define PROJECT_KERNELS(Kernel) {PROJECT_KERNELS_8(Kernel, 0), PROJECT_KERNELS_8(Kernel, 8), PROJECT_KERNELS_8(Kernel, 16), PROJECT_KERNELS_8(Kernel, 24)}
+
+const ProjectKernel kScalarKernels[32] = PROJECT_KERNELS(ProjectScalar);
+#ifdef POINT_PROJECTOR_X86
+const ProjectKernel kAVX2Kernels[32] = PROJECT_KERNELS(ProjectAVX2);
+#endif
+
+// interleaved points are split in blocks of this many
+const size_t kBlockPoints = 256;
+}  // namespace
+
+PointProjector::PointProjector(const OverlayCalibration& calibration) : m_terms(0) {
+    if (calibration.cameraMatrix.total() != 9 || calibration.rotationVector.total() != 3 || calibration.translationVector.total() != 3)
+        throw std::runtime_error("camera matrix, rotation or translation vector missing from the calibration");
+    if (calibration.distCoeffs.total() > 14)
+        throw std::runtime_error("more than 14 distortion coefficients");
+
+    cv::Mat rotation;
+    cv::Rodrigues(calibration.rotationVector, rotation);
+    for (int i = 0; i < 9; i++)
+        m_model.rotation[i] = MatValue(rotation, i);
+    for (int i = 0; i < 3; i++)
+        m_model.translation[i] = MatValue(calibration.translationVector, i);
+    m_model.fx = MatValue(calibration.cameraMatrix, 0);
+    m_model.fy = MatValue(calibration.cameraMatrix, 4);
+    m_model.cx = MatValue(calibration.cameraMatrix, 2);
+    m_model.cy = MatValue(calibration.cameraMatrix, 5);
+
+    const double* k = m_model.k;
+    for (int i = 0; i < 14; i++)
+        m_model.k[i] = i < static_cast<int>(calibration.distCoeffs.total()) ? MatValue(calibration.distCoeffs, i) : 0.0;
+    TiltMatrix(k[12], k[13], m_model.tilt);
+
+    if (k[0] != 0.0 || k[1] != 0.0 || k[4] != 0.0)
+        m_terms |= kRadial;
+    if (k[2] != 0.0 || k[3] != 0.0)
+        m_terms |= kTangential;
+    if (k[5] != 0.0 || k[6] != 0.0 || k[7] != 0.0)
+        m_terms |= kRational;
+    if (k[8] != 0.0 || k[9] != 0.0 || k[10] != 0.0 || k[11] != 0.0)
+        m_terms |= kThinPrism;
+    if (k[12] != 0.0 || k[13] != 0.0)
+        m_terms |= kTilt;
+}
+
+void PointProjector::Project(const float* pX, const float* pY, const float* pZ, size_t count, cv::Point2f* pProjected, SimdLevel level) const {
+#ifdef POINT_PROJECTOR_X86
+    // double lanes need AVX2 to pay off, SSE4.1 runs the scalar kernels
+    if (level >= SimdLevel::AVX2 && DetectSimdLevel() >= SimdLevel::AVX2) {
+        kAVX2Kernels[m_terms](m_model, pX, pY, pZ, count, pProjected);
+        return;
+    }
+#else
+    (void)level;
+#endif
+    kScalarKernels[m_terms](m_model, pX, pY, pZ, count, pProjected);
+}
+
+void PointProjector::Project(const float* pX, const float* pY, const float* pZ, size_t count, cv::Point2f* pProjected) const {
+    Project(pX, pY, pZ, count, pProjected, DetectSimdLevel());
+}
+
+void PointProjector::Project(const cv::Point3f* pPoints, size_t count, cv::Point2f* pProjected) const {
+    float x[kBlockPoints];
+    float y[kBlockPoints];
+    float z[kBlockPoints];
+    for (size_t first = 0; first < count; first += kBlockPoints) {
+        size_t n = std::min(kBlockPoints, count - first);
+        for (size_t i = 0; i < n; i++) {
+            x[i] = pPoints[first + i].x;
+            y[i] = pPoints[first + i].y;
+            z[i] = pPoints[first + i].z;
+        }
+        Project(x, y, z, n, pProjected + first);
+    }
+}
+
+void PointProjector::Depth(const float* pX, const float* pY, const float* pZ, size_t count, float* pDepth) const {
+    const double* r = m_model.rotation + 6;
+    for (size_t i = 0; i < count; i++)
+        pDepth[i] = pZ[i] > 0.0f ? static_cast<float>(r[0] * pX[i] + r[1] * pY[i] + r[2] * pZ[i] + m_model.translation[2]) : std::numeric_limits<float>::quiet_NaN();
+}
+
+void PointProjector::Depth(const cv::Point3f* pPoints, size_t count, float* pDepth) const {
+    const double* r = m_model.rotation + 6;
+    for (size_t i = 0; i < count; i++) {
+        const cv::Point3f& point = pPoints[i];
+        pDepth[i] = point.z > 0.0f ? static_cast<float>(r[0] * point.x + r[1] * point.y + r[2] * point.z + m_model.translation[2]) : std::numeric_limits<float>::quiet_NaN();
+    }
+}
+
+std::string PointProjector::TermNames() const {
+    const char* names[5] = {"radial", "tangential", "rational", "thin prism", "tilt"};
+    std::string terms;
+    for (int bit = 0; bit < 5; bit++) {
+        if (m_terms & (1 << bit))
+            terms += (terms.empty() ? "" : "+") + std::string(names[bit]);
+    }
+    return terms.empty() ? "none" : terms;
+}
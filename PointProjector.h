@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <opencv2/core.hpp>
+#include <string>
+
+#include "PointCloudDecoder.h"
+
+// TRI camera model and the HLT to TRI transform, as stored in orientation.yml
+struct OverlayCalibration {
+    cv::Mat cameraMatrix;
+    cv::Mat distCoeffs;
+    cv::Mat rotationVector;
+    cv::Mat translationVector;
+};
+
+// Projects HLT points onto the TRI image with the camera model of
+// cv::projectPoints: rotation and translation, then radial, tangential,
+// rational, thin prism and tilt distortion from up to 14 coefficients. The
+// terms whose coefficients are all zero are found once at construction and
+// the points go through a kernel compiled without them. Computes in double
+// with the operations in the order OpenCV uses, so a dropped term changes
+// nothing; rgbd_bench checks every kernel against cv::projectPoints.
+class PointProjector {
+   public:
+    explicit PointProjector(const OverlayCalibration& calibration);
+
+    // Projects count points given as separate X, Y, Z arrays in mm
+    void Project(const float* pX, const float* pY, const float* pZ, size_t count, cv::Point2f* pProjected, SimdLevel level) const;
+    void Project(const float* pX, const float* pY, const float* pZ, size_t count, cv::Point2f* pProjected) const;
+
+    // Same for interleaved points
+    void Project(const cv::Point3f* pPoints, size_t count, cv::Point2f* pProjected) const;
+
+    // Depth of count points in front of the TRI, in mm, for the occlusion
+    // test. Points at Z <= 0, which the decoder writes for invalid pixels,
+    // get NaN.
+    void Depth(const float* pX, const float* pY, const float* pZ, size_t count, float* pDepth) const;
+    void Depth(const cv::Point3f* pPoints, size_t count, float* pDepth) const;
+
+    // Active distortion terms, like "radial+tangential", "none" for a pinhole
+    std::string TermNames() const;
+
+    // mean of fx and fy of the TRI, in pixels
+    double FocalLength() const { return 0.5 * (m_model.fx + m_model.fy); }
+
+    // Camera model in the order of cv::projectPoints
+    struct Model {
+        double rotation[9];
+        double translation[3];
+        double fx, fy, cx, cy;
+        double k[14];
+        double tilt[9];
+    };
+
+   private:
+    Model m_model;
+    int m_terms;
+};
@@ -0,0 +1,114 @@
+#include "Rig.h"
+
+#include <fstream>
+#include <opencv2/core.hpp>
+#include <stdexcept>
+
+#include "SimulatedArena.h"
+
+namespace {
+DiscoveredDevice TakeDevice(std::vector<DiscoveredDevice>& devices, const std::string& serial, const char* kind) {
+    for (auto it = devices.begin(); it != devices.end(); ++it) {
+        if (it->serialNumber == serial) {
+            DiscoveredDevice device = *it;
+            devices.erase(it);
+            return device;
+        }
+    }
+    throw std::logic_error(std::string(kind) + " " + serial + " from the rig map is not connected or already used by another rig");
+}
+}  // namespace
+
+std::vector<DiscoveredDevice> DiscoverDevices(Arena::ISystem* pSystem, uint64_t timeout) {
+    std::vector<DiscoveredDevice> devices;
+
+    SimulatedSystem* pSimulatedSystem = dynamic_cast<SimulatedSystem*>(pSystem);
+    if (pSimulatedSystem) {
+        for (const SimulatedDeviceInfo& info : pSimulatedSystem->Devices())
+            devices.push_back({info.modelName, info.serialNumber, Arena::DeviceInfo()});
+        return devices;
+    }
+
+    pSystem->UpdateDevices(timeout);
+    for (Arena::DeviceInfo& deviceInfo : pSystem->GetDevices())
+        devices.push_back({deviceInfo.ModelName().c_str(), deviceInfo.SerialNumber().c_str(), deviceInfo});
+    return devices;
+}
+
+Arena::IDevice* CreateDiscoveredDevice(Arena::ISystem* pSystem, const DiscoveredDevice& device) {
+    SimulatedSystem* pSimulatedSystem = dynamic_cast<SimulatedSystem*>(pSystem);
+    if (pSimulatedSystem)
+        return pSimulatedSystem->CreateDevice(device.serialNumber);
+    return pSystem->CreateDevice(device.deviceInfo);
+}
+
+std::vector<Rig> PairDevicesIntoRigs(std::vector<DiscoveredDevice>& heliosDevices, std::vector<DiscoveredDevice>& tritonDevices,
+                                     const std::string& rigMapFile, const std::string& defaultCalibrationFile, int64_t baseGroupMask) {
+    std::vector<Rig> rigs;
+
+    if (std::ifstream(rigMapFile)) {
+        cv::FileStorage fs(rigMapFile, cv::FileStorage::READ);
+        cv::FileNode rigNodes = fs["rigs"];
+        for (cv::FileNodeIterator it = rigNodes.begin(); it != rigNodes.end(); ++it) {
+            cv::FileNode rigNode = *it;
+            std::string serialHLT;
+            std::string serialTRI;
+            Rig rig;
+            rigNode["helios"] >> serialHLT;
+            rigNode["triton"] >> serialTRI;
+            rigNode["calibration"] >> rig.calibrationFile;
+            if (rig.calibrationFile.empty())
+                rig.calibrationFile = defaultCalibrationFile;
+
+            rig.deviceHLT = TakeDevice(heliosDevices, serialHLT, "Helios2");
+            rig.deviceTRI = TakeDevice(tritonDevices, serialTRI, "Triton");
+            rigs.push_back(rig);
+        }
+        fs.release();
+
+        if (rigs.empty())
+            throw std::logic_error("no rigs listed in " + rigMapFile);
+    } else {
+        if (heliosDevices.size() > 1)
+            throw std::logic_error("too many Helios2 devices connected, list the pairs in " + rigMapFile);
+        if (tritonDevices.size() > 1)
+            throw std::logic_error("too many Triton devices connected, list the pairs in " + rigMapFile);
+        if (tritonDevices.empty())
+            throw std::logic_error("No applicable Triton devices");
+        if (heliosDevices.empty())
+            throw std::logic_error("No applicable Helios 2 devices");
+
+        Rig rig;
+        rig.deviceHLT = heliosDevices[0];
+        rig.deviceTRI = tritonDevices[0];
+        rig.calibrationFile = defaultCalibrationFile;
+        rigs.push_back(rig);
+    }
+
+    // the action group mask is 32 bits wide, one bit per rig
+    if (rigs.size() > 32)
+        throw std::logic_error("at most 32 rigs can be triggered independently");
+
+    for (size_t i = 0; i < rigs.size(); i++) {
+        rigs[i].name = "rig" + std::to_string(i);
+        rigs[i].actionGroupMask = (baseGroupMask << i) & 0xFFFFFFFF;
+        if (rigs[i].actionGroupMask == 0)
+            throw std::logic_error("action group mask " + std::to_string(baseGroupMask) + " leaves no bit for " + rigs[i].name);
+        if (rigs.size() > 1)
+            rigs[i].outputSuffix = "_" + rigs[i].name;
+    }
+    return rigs;
+}
+
+RigPipeline::RigPipeline(Rig& rig, WorkerPool& workerPool, size_t queueCapacity, size_t minBuffers, size_t maxBuffers)
+    : receiverHLT(rig.pDeviceHLT, rig.name + " HLT", queueCapacity),
+      receiverTRI(rig.pDeviceTRI, rig.name + " TRI", queueCapacity),
+      poolHLT(rig.pDeviceHLT, rig.name + " HLT", minBuffers, maxBuffers),
+      poolTRI(rig.pDeviceTRI, rig.name + " TRI", minBuffers, maxBuffers),
+      scan3dCache(rig.pDeviceHLT->GetNodeMap()),
+      workerPool(workerPool),
+      calibration(rig.calibrationFile, rig.name) {
+    GenApi::CFloatPtr pFocalLength = rig.pDeviceHLT->GetNodeMap()->GetNode("Scan3dFocalLength");
+    if (GenApi::IsReadable(pFocalLength))
+        focalLengthHLT = pFocalLength->GetValue();
+}
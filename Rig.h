@@ -0,0 +1,109 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AlignedDepth.h"
+#include "ArenaApi.h"
+#include "CalibrationStore.h"
+#include "ColorOverlay.h"
+#include "DepthProjectionTable.h"
+#include "FeatureCache.h"
+#include "ImageRectifier.h"
+#include "ImageReceiver.h"
+#include "OcclusionBuffer.h"
+#include "PointCloudDecoder.h"
+#include "StreamBufferPool.h"
+#include "WorkerPool.h"
+
+// A device found on the system. Simulated devices have no Arena::DeviceInfo,
+// they are created by serial number instead.
+struct DiscoveredDevice {
+    std::string modelName;
+    std::string serialNumber;
+    Arena::DeviceInfo deviceInfo;
+};
+
+// Lists the devices of an Arena or simulated system
+std::vector<DiscoveredDevice> DiscoverDevices(Arena::ISystem* pSystem, uint64_t timeout);
+
+Arena::IDevice* CreateDiscoveredDevice(Arena::ISystem* pSystem, const DiscoveredDevice& device);
+
+// One Helios2 + Triton pair with its own calibration and action group. Every
+// rig on the host shares the action device and group keys; the group mask
+// selects which rig a scheduled action command triggers.
+struct Rig {
+    std::string name;
+    DiscoveredDevice deviceHLT;
+    DiscoveredDevice deviceTRI;
+    std::string calibrationFile;
+    int64_t actionGroupMask = 1;
+    // appended to output file names, empty when there is only one rig
+    std::string outputSuffix;
+
+    Arena::IDevice* pDeviceHLT = nullptr;
+    Arena::IDevice* pDeviceTRI = nullptr;
+    GenICam::gcstring pixelFormatInitialHLT;
+    GenICam::gcstring pixelFormatInitialTRI;
+};
+
+// Pairs the detected devices into rigs. With rigMapFile present, each entry of
+// its "rigs" sequence names the serial numbers of a Helios and a Triton and
+// optionally a calibration file:
+//
+//   rigs:
+//      - { helios: "221400001", triton: "220600001", calibration: "orientation_0.yml" }
+//
+// Without the file exactly one Helios and one Triton must be connected and
+// form a single rig using defaultCalibrationFile. Rig i gets the action group
+// mask baseGroupMask << i.
+std::vector<Rig> PairDevicesIntoRigs(std::vector<DiscoveredDevice>& heliosDevices, std::vector<DiscoveredDevice>& tritonDevices,
+                                     const std::string& rigMapFile, const std::string& defaultCalibrationFile, int64_t baseGroupMask);
+
+// Acquisition and processing objects of one rig, alive while the rig
+// streams. The worker pool is shared by all rigs.
+struct RigPipeline {
+    RigPipeline(Rig& rig, WorkerPool& workerPool, size_t queueCapacity, size_t minBuffers, size_t maxBuffers);
+
+    ImageReceiver receiverHLT;
+    ImageReceiver receiverTRI;
+    StreamBufferPool poolHLT;
+    StreamBufferPool poolTRI;
+    Scan3dCache scan3dCache;
+    WorkerPool& workerPool;
+
+    // Scan3dFocalLength of the HLT in pixels, 0 if it does not report one
+    double focalLengthHLT = 0.0;
+
+    // orientation file of the rig, loaded once, and the load the rectifier
+    // and depth table below were built on
+    CalibrationStore calibration;
+    uint64_t calibrationVersion = 0;
+
+    // valid points of the last frame and their colors, reused between frames
+    PointList points;
+    std::vector<uint8_t> colors;
+
+    // rebuilds X and Y of Coord3D_C16 frames and carries the depth table,
+    // empty unless streaming depth only or projecting through the table
+    RayTable rays;
+
+    // built on the first frame when projecting through the depth table
+    std::unique_ptr<DepthProjectionTable> depthTable;
+
+    // built on the first frame when rectifying the TRI images, with the
+    // rectified image of the last frame
+    std::unique_ptr<ImageRectifier> rectifier;
+    cv::Mat imageRectified;
+
+    // z-buffer of the occlusion test, reused between frames
+    std::unique_ptr<OcclusionBuffer> occlusion;
+
+    // TRI image of the frame prepared for color sampling, buffers reused
+    ColorSampler sampler;
+
+    // depth map aligned with the TRI image of the last frame, built on the
+    // first frame when rendering it
+    std::unique_ptr<AlignedDepthRenderer> alignedDepth;
+};
@@ -0,0 +1,961 @@
+#include "SimulatedArena.h"
+
+#include <GenApi/PortImpl.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+namespace {
+// HLT coordinate encoding, value_mm = u16 * scale + offset
+const double kScan3dScale = 0.25;
+const double kScan3dOffsets[3] = {-8192.0, -8192.0, 0.0};
+const uint16_t kInvalidCoordinate = 0xFFFF;
+
+// Scene in HLT coordinates, mm: a plane tilted about the Y axis behind a sphere
+const double kPlaneDistance = 1500.0;
+const double kPlaneSlope = 0.2;
+const double kSphereCenter[3] = {0.0, 0.0, 1200.0};
+const double kSphereRadius = 300.0;
+const double kCheckerSize = 100.0;
+
+// Triton optical center on the HLT X axis, both cameras look along Z
+const double kBaselineTRI = 60.0;
+
+double FocalLengthHLT(size_t width) {
+    return 0.75 * static_cast<double>(width);
+}
+
+double FocalLengthTRI(size_t width) {
+    return 0.9 * static_cast<double>(width);
+}
+
+struct SceneHit {
+    double point[3];
+    double shade;
+    bool sphere;
+};
+
+double Dot(const double* a, const double* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+bool IntersectScene(const double* origin, const double* direction, SceneHit& hit) {
+    double nearest = -1.0;
+
+    // sphere
+    double oc[3] = {origin[0] - kSphereCenter[0], origin[1] - kSphereCenter[1], origin[2] - kSphereCenter[2]};
+    double a = Dot(direction, direction);
+    double b = Dot(direction, oc);
+    double c = Dot(oc, oc) - kSphereRadius * kSphereRadius;
+    double discriminant = b * b - a * c;
+    if (discriminant >= 0.0) {
+        double s = (-b - std::sqrt(discriminant)) / a;
+        if (s > 0.0) {
+            nearest = s;
+            hit.sphere = true;
+        }
+    }
+
+    // plane, z - slope * x = distance
+    double normal[3] = {-kPlaneSlope, 0.0, 1.0};
+    double nd = Dot(normal, direction);
+    if (nd > 1e-9) {
+        double s = (kPlaneDistance - Dot(normal, origin)) / nd;
+        if (s > 0.0 && (nearest < 0.0 || s < nearest)) {
+            nearest = s;
+            hit.sphere = false;
+        }
+    }
+
+    if (nearest < 0.0)
+        return false;
+
+    for (int i = 0; i < 3; i++)
+        hit.point[i] = origin[i] + nearest * direction[i];
+
+    // Lambert shading with the light at the HLT
+    double surfaceNormal[3] = {-kPlaneSlope, 0.0, 1.0};
+    if (hit.sphere) {
+        for (int i = 0; i < 3; i++)
+            surfaceNormal[i] = (hit.point[i] - kSphereCenter[i]) / kSphereRadius;
+    }
+    double view[3] = {-hit.point[0], -hit.point[1], -hit.point[2]};
+    double shade = Dot(surfaceNormal, view) / std::sqrt(Dot(surfaceNormal, surfaceNormal) * Dot(view, view));
+    hit.shade = std::max(0.0, std::min(1.0, std::fabs(shade)));
+    return true;
+}
+
+void SceneColor(const SceneHit& hit, uint8_t rgb[3]) {
+    if (hit.sphere) {
+        rgb[0] = static_cast<uint8_t>(40 + 200 * hit.shade);
+        rgb[1] = static_cast<uint8_t>(20 + 40 * hit.shade);
+        rgb[2] = static_cast<uint8_t>(20 + 40 * hit.shade);
+        return;
+    }
+    bool light = (static_cast<int64_t>(std::floor(hit.point[0] / kCheckerSize)) + static_cast<int64_t>(std::floor(hit.point[1] / kCheckerSize))) % 2 == 0;
+    rgb[0] = static_cast<uint8_t>((light ? 200 : 60) * hit.shade);
+    rgb[1] = static_cast<uint8_t>((light ? 200 : 90) * hit.shade);
+    rgb[2] = static_cast<uint8_t>((light ? 200 : 160) * hit.shade);
+}
+
+uint16_t EncodeCoordinate(double valueMm, int axis) {
+    double encoded = std::round((valueMm - kScan3dOffsets[axis]) / kScan3dScale);
+    return static_cast<uint16_t>(std::max(0.0, std::min(65534.0, encoded)));
+}
+
+size_t BitsPerPixel(uint64_t pixelFormat) {
+    switch (pixelFormat) {
+        case LUCID_Coord3D_ABCY16:
+            return 64;
+        case PFNC_Coord3D_C16:
+            return 16;
+        case PFNC_RGB8:
+            return 24;
+        default:
+            return 8;
+    }
+}
+
+int64_t SecondsToNs(double seconds) {
+    return static_cast<int64_t>(seconds * 1000000000.0);
+}
+
+const char* kXmlHeader =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<RegisterDescription ModelName=\"%s\" VendorName=\"Simulated\" ToolTip=\"Simulated device\" StandardNameSpace=\"None\" "
+    "SchemaMajorVersion=\"1\" SchemaMinorVersion=\"1\" SchemaSubMinorVersion=\"0\" MajorVersion=\"1\" MinorVersion=\"0\" SubMinorVersion=\"0\" "
+    "ProductGuid=\"5B0A3A5E-6C1E-4F57-9C6B-2D7F1E0B5A10\" VersionGuid=\"5B0A3A5E-6C1E-4F57-9C6B-2D7F1E0B5A11\" "
+    "xmlns=\"http://www.genicam.org/GenApi/Version_1_1\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+    "xsi:schemaLocation=\"http://www.genicam.org/GenApi/Version_1_1 http://www.genicam.org/GenApi/GenApiSchema_Version_1_1.xsd\">\n";
+}  // namespace
+
+//
+// SimulatedNodeMap
+//
+
+class SimulatedNodeMap::Port : public GenApi::CPortImpl {
+   public:
+    explicit Port(SimulatedNodeMap& owner)
+        : m_owner(owner) {
+    }
+
+    GenApi::EAccessMode GetAccessMode() const override {
+        return GenApi::RW;
+    }
+
+    void Read(void* pBuffer, int64_t address, int64_t length) override {
+        m_owner.OnRead(address);
+        std::unique_lock<std::mutex> lock(m_owner.m_registers_mutex);
+        CheckRange(address, length);
+        std::memcpy(pBuffer, &m_owner.m_registers[static_cast<size_t>(address)], static_cast<size_t>(length));
+    }
+
+    void Write(const void* pBuffer, int64_t address, int64_t length) override {
+        {
+            std::unique_lock<std::mutex> lock(m_owner.m_registers_mutex);
+            CheckRange(address, length);
+            std::memcpy(&m_owner.m_registers[static_cast<size_t>(address)], pBuffer, static_cast<size_t>(length));
+        }
+        m_owner.OnWrite(address);
+    }
+
+   private:
+    void CheckRange(int64_t address, int64_t length) const {
+        if (address < 0 || length < 0 || static_cast<size_t>(address + length) > m_owner.m_registers.size())
+            throw OUT_OF_RANGE_EXCEPTION("register access at 0x%llx outside the simulated register file", static_cast<unsigned long long>(address));
+    }
+
+    SimulatedNodeMap& m_owner;
+};
+
+SimulatedNodeMap::SimulatedNodeMap(const std::string& modelName)
+    : m_model_name(modelName) {
+}
+
+SimulatedNodeMap::~SimulatedNodeMap() {
+    m_node_map._Destroy();
+}
+
+SimulatedNodeMap::Feature& SimulatedNodeMap::Add(Kind kind, const std::string& name, Access access, bool streamable, size_t length) {
+    if (m_port)
+        throw std::logic_error("feature " + name + " added after the node map was loaded");
+
+    Feature feature;
+    feature.kind = kind;
+    feature.name = name;
+    feature.access = access;
+    feature.streamable = streamable && access == RW;
+    feature.address = static_cast<int64_t>(m_registers.size());
+    feature.length = length;
+    feature.max = 0.0;
+    m_features.push_back(feature);
+
+    m_names_by_address[feature.address] = name;
+    m_registers.resize(m_registers.size() + length, 0);
+    return m_features.back();
+}
+
+void SimulatedNodeMap::AddInteger(const std::string& name, int64_t value, Access access, bool streamable) {
+    Add(KindInteger, name, access, streamable, 8);
+    SetInt(name, value);
+}
+
+void SimulatedNodeMap::AddFloat(const std::string& name, double value, Access access, double max) {
+    Add(KindFloat, name, access, false, 8).max = max;
+    SetFloat(name, value);
+}
+
+void SimulatedNodeMap::AddSelectedFloat(const std::string& name, const std::string& selector, const std::vector<double>& values, Access access) {
+    Add(KindFloat, name, access, false, 8 * values.size()).selector = selector;
+    for (size_t i = 0; i < values.size(); i++)
+        SetFloat(name, values[i], i);
+}
+
+void SimulatedNodeMap::AddBoolean(const std::string& name, bool value, Access access, bool streamable) {
+    Add(KindBoolean, name, access, streamable, 8);
+    SetInt(name, value ? 1 : 0);
+}
+
+void SimulatedNodeMap::AddEnumeration(const std::string& name, const EnumEntries& entries, const std::string& value, Access access, bool streamable, const std::vector<std::string>& selected) {
+    Feature& feature = Add(KindEnumeration, name, access, streamable, 8);
+    feature.entries = entries;
+    feature.selected = selected;
+    SetEntry(name, value);
+}
+
+void SimulatedNodeMap::AddCommand(const std::string& name) {
+    Add(KindCommand, name, RW, false, 8);
+}
+
+void SimulatedNodeMap::AddString(const std::string& name, const std::string& value) {
+    Feature& feature = Add(KindString, name, RO, false, std::max<size_t>(16, value.size() + 1));
+    std::memcpy(&m_registers[static_cast<size_t>(feature.address)], value.c_str(), value.size());
+}
+
+void SimulatedNodeMap::Load() {
+    m_port.reset(new Port(*this));
+    m_node_map._LoadXMLFromString(BuildXml().c_str());
+    m_node_map._Connect(m_port.get(), "Device");
+}
+
+const SimulatedNodeMap::Feature& SimulatedNodeMap::Find(const std::string& name) const {
+    for (const Feature& feature : m_features) {
+        if (feature.name == name)
+            return feature;
+    }
+    throw std::logic_error("simulated feature " + name + " not found");
+}
+
+int64_t SimulatedNodeMap::GetInt(const std::string& name, size_t index) const {
+    const Feature& feature = Find(name);
+    int64_t value = 0;
+    std::unique_lock<std::mutex> lock(m_registers_mutex);
+    std::memcpy(&value, &m_registers[static_cast<size_t>(feature.address) + 8 * index], 8);
+    return value;
+}
+
+void SimulatedNodeMap::SetInt(const std::string& name, int64_t value, size_t index) {
+    const Feature& feature = Find(name);
+    std::unique_lock<std::mutex> lock(m_registers_mutex);
+    std::memcpy(&m_registers[static_cast<size_t>(feature.address) + 8 * index], &value, 8);
+}
+
+double SimulatedNodeMap::GetFloat(const std::string& name, size_t index) const {
+    const Feature& feature = Find(name);
+    double value = 0.0;
+    std::unique_lock<std::mutex> lock(m_registers_mutex);
+    std::memcpy(&value, &m_registers[static_cast<size_t>(feature.address) + 8 * index], 8);
+    return value;
+}
+
+void SimulatedNodeMap::SetFloat(const std::string& name, double value, size_t index) {
+    const Feature& feature = Find(name);
+    std::unique_lock<std::mutex> lock(m_registers_mutex);
+    std::memcpy(&m_registers[static_cast<size_t>(feature.address) + 8 * index], &value, 8);
+}
+
+std::string SimulatedNodeMap::GetEntry(const std::string& name) const {
+    int64_t value = GetInt(name);
+    for (const auto& entry : Find(name).entries) {
+        if (entry.second == value)
+            return entry.first;
+    }
+    return std::string();
+}
+
+void SimulatedNodeMap::SetEntry(const std::string& name, const std::string& entry) {
+    for (const auto& candidate : Find(name).entries) {
+        if (candidate.first == entry) {
+            SetInt(name, candidate.second);
+            return;
+        }
+    }
+    throw std::logic_error("simulated enumeration " + name + " has no entry " + entry);
+}
+
+void SimulatedNodeMap::OnRead(int64_t address) {
+    if (!m_read_hook)
+        return;
+    auto it = m_names_by_address.upper_bound(address);
+    if (it != m_names_by_address.begin())
+        m_read_hook(std::prev(it)->second);
+}
+
+void SimulatedNodeMap::OnWrite(int64_t address) {
+    if (!m_write_hook)
+        return;
+    auto it = m_names_by_address.upper_bound(address);
+    if (it != m_names_by_address.begin())
+        m_write_hook(std::prev(it)->second);
+}
+
+std::string SimulatedNodeMap::BuildXml() const {
+    std::ostringstream xml;
+    std::vector<char> header(std::strlen(kXmlHeader) + m_model_name.size() + 1);
+    std::snprintf(header.data(), header.size(), kXmlHeader, m_model_name.c_str());
+    xml << header.data();
+
+    xml << "<Category Name=\"Root\" NameSpace=\"Standard\">\n";
+    for (const Feature& feature : m_features)
+        xml << "  <pFeature>" << feature.name << "</pFeature>\n";
+    xml << "</Category>\n";
+
+    // every value lives in an uncached little endian register of the "Device" port
+    auto registerXml = [&xml](const char* type, const std::string& name, const Feature& feature, const std::string& streamable, const std::string& extra) {
+        xml << "<" << type << " Name=\"" << name << "\">\n"
+            << streamable
+            << "  <Address>0x" << std::hex << feature.address << std::dec << "</Address>\n"
+            << extra
+            << "  <Length>" << (feature.kind == KindString ? feature.length : 8) << "</Length>\n"
+            << "  <AccessMode>" << (feature.access == RW ? "RW" : "RO") << "</AccessMode>\n"
+            << "  <pPort>Device</pPort>\n"
+            << "  <Cachable>NoCache</Cachable>\n";
+        if (feature.kind == KindInteger || feature.kind == KindBoolean || feature.kind == KindEnumeration || feature.kind == KindCommand)
+            xml << "  <Sign>Signed</Sign>\n";
+        if (feature.kind != KindString)
+            xml << "  <Endianess>LittleEndian</Endianess>\n";
+        xml << "</" << type << ">\n";
+    };
+
+    for (const Feature& feature : m_features) {
+        std::string streamable = feature.streamable ? "  <Streamable>Yes</Streamable>\n" : "";
+        std::string backing = feature.name + "Reg";
+        switch (feature.kind) {
+            case KindInteger:
+                registerXml("IntReg", feature.name, feature, streamable, "");
+                break;
+            case KindFloat:
+                if (!feature.selector.empty()) {
+                    registerXml("FloatReg", feature.name, feature, streamable, "  <pIndex Offset=\"8\">" + feature.selector + "Reg</pIndex>\n");
+                } else {
+                    xml << "<Float Name=\"" << feature.name << "\">\n"
+                        << streamable
+                        << "  <pValue>" << backing << "</pValue>\n";
+                    if (feature.max > 0.0)
+                        xml << "  <Min>0</Min>\n  <Max>" << feature.max << "</Max>\n";
+                    xml << "</Float>\n";
+                    registerXml("FloatReg", backing, feature, "", "");
+                }
+                break;
+            case KindBoolean:
+                xml << "<Boolean Name=\"" << feature.name << "\">\n"
+                    << streamable
+                    << "  <pValue>" << backing << "</pValue>\n"
+                    << "  <OnValue>1</OnValue>\n  <OffValue>0</OffValue>\n"
+                    << "</Boolean>\n";
+                registerXml("IntReg", backing, feature, "", "");
+                break;
+            case KindEnumeration:
+                xml << "<Enumeration Name=\"" << feature.name << "\">\n" << streamable;
+                for (const auto& entry : feature.entries)
+                    xml << "  <EnumEntry Name=\"" << entry.first << "\">\n    <Value>" << entry.second << "</Value>\n  </EnumEntry>\n";
+                xml << "  <pValue>" << backing << "</pValue>\n";
+                for (const std::string& selected : feature.selected)
+                    xml << "  <pSelected>" << selected << "</pSelected>\n";
+                xml << "</Enumeration>\n";
+                registerXml("IntReg", backing, feature, "", "");
+                break;
+            case KindCommand:
+                xml << "<Command Name=\"" << feature.name << "\">\n"
+                    << "  <pValue>" << backing << "</pValue>\n"
+                    << "  <CommandValue>1</CommandValue>\n"
+                    << "</Command>\n";
+                registerXml("IntReg", backing, feature, "", "");
+                break;
+            case KindString:
+                registerXml("StringReg", feature.name, feature, streamable, "");
+                break;
+        }
+    }
+
+    xml << "<Port Name=\"Device\" NameSpace=\"Standard\"/>\n"
+        << "</RegisterDescription>\n";
+    return xml.str();
+}
+
+//
+// SimulatedImage
+//
+
+SimulatedImage::SimulatedImage(size_t width, size_t height, uint64_t pixelFormat, const std::vector<uint8_t>& data, uint64_t timestampNs, uint64_t frameId, bool incomplete)
+    : m_width(width),
+      m_height(height),
+      m_pixel_format(pixelFormat),
+      m_data(data),
+      m_timestamp_ns(timestampNs),
+      m_frame_id(frameId),
+      m_incomplete(incomplete) {
+}
+
+size_t SimulatedImage::GetBitsPerPixel() {
+    return BitsPerPixel(m_pixel_format);
+}
+
+//
+// SimulatedDevice
+//
+
+SimulatedDevice::SimulatedDevice(SimulatedSystem& system, const SimulationParams& params, const std::string& modelName, const std::string& serialNumber, bool helios, uint32_t seed)
+    : m_system(system),
+      m_params(params),
+      m_model_name(modelName),
+      m_serial_number(serialNumber),
+      m_helios(helios),
+      m_width(helios ? params.widthHLT : params.widthTRI),
+      m_height(helios ? params.heightHLT : params.heightTRI),
+      m_device_map(modelName),
+      m_tl_device_map(modelName),
+      m_tl_stream_map(modelName),
+      m_tl_interface_map(modelName),
+      m_clock_offset_ns(0),
+      m_ptp_enabled_at(std::chrono::steady_clock::now()),
+      m_rng(seed),
+      m_lost_frames(0),
+      m_incomplete_frames(0) {
+    if (m_params.ptpClockOffsetNs > 0)
+        m_clock_offset_ns = std::uniform_int_distribution<int64_t>(-m_params.ptpClockOffsetNs, m_params.ptpClockOffsetNs)(m_rng);
+
+    double maxFrameRate = m_helios ? m_params.maxFrameRateHLT : m_params.maxFrameRateTRI;
+
+    SimulatedNodeMap& device = m_device_map;
+    device.AddInteger("Width", static_cast<int64_t>(m_width), SimulatedNodeMap::RO);
+    device.AddInteger("Height", static_cast<int64_t>(m_height), SimulatedNodeMap::RO);
+    if (m_helios)
+        device.AddEnumeration("PixelFormat", {{"Coord3D_ABCY16", LUCID_Coord3D_ABCY16}, {"Coord3D_C16", PFNC_Coord3D_C16}}, "Coord3D_C16", SimulatedNodeMap::RW, true);
+    else
+        device.AddEnumeration("PixelFormat", {{"BayerRG8", PFNC_BayerRG8}, {"RGB8", PFNC_RGB8}}, "BayerRG8", SimulatedNodeMap::RW, true);
+    device.AddFloat("AcquisitionFrameRate", maxFrameRate, SimulatedNodeMap::RW, maxFrameRate);
+    device.AddEnumeration("TriggerSelector", {{"FrameStart", 0}}, "FrameStart", SimulatedNodeMap::RW, true, {"TriggerMode", "TriggerSource"});
+    device.AddEnumeration("TriggerMode", {{"Off", 0}, {"On", 1}}, "Off", SimulatedNodeMap::RW, true);
+    device.AddEnumeration("TriggerSource", {{"Software", 0}, {"Action0", 1}}, "Software", SimulatedNodeMap::RW, true);
+    device.AddEnumeration("ActionUnconditionalMode", {{"Off", 0}, {"On", 1}}, "Off", SimulatedNodeMap::RW, true);
+    device.AddInteger("ActionSelector", 0, SimulatedNodeMap::RW, true);
+    device.AddInteger("ActionDeviceKey", 0, SimulatedNodeMap::RW, true);
+    device.AddInteger("ActionGroupKey", 0, SimulatedNodeMap::RW, true);
+    device.AddInteger("ActionGroupMask", 0, SimulatedNodeMap::RW, true);
+    device.AddInteger("ActionQueueSize", m_params.actionQueueSize, SimulatedNodeMap::RO);
+    device.AddBoolean("PtpEnable", false, SimulatedNodeMap::RW, true);
+    device.AddBoolean("PtpSlaveOnly", false, SimulatedNodeMap::RW, true);
+    device.AddEnumeration("PtpStatus", {{"Disabled", 0}, {"Initializing", 1}, {"Listening", 2}, {"Master", 3}, {"Slave", 4}}, "Disabled", SimulatedNodeMap::RO);
+    device.AddCommand("PtpDataSetLatch");
+    device.AddInteger("PtpDataSetLatchValue", 0, SimulatedNodeMap::RO);
+    if (m_helios) {
+        device.AddEnumeration("Scan3dOperatingMode",
+                              {{"Distance1250mmSingleFreq", 0}, {"Distance3000mmSingleFreq", 1}, {"Distance4000mmSingleFreq", 2},
+                               {"Distance5000mmMultiFreq", 3}, {"Distance6000mmSingleFreq", 4}, {"Distance8333mmMultiFreq", 5}},
+                              "Distance6000mmSingleFreq", SimulatedNodeMap::RW, true);
+        device.AddEnumeration("ExposureTimeSelector", {{"Exp62_5Us", 0}, {"Exp250Us", 1}, {"Exp1000Us", 2}}, "Exp250Us", SimulatedNodeMap::RW, true);
+        device.AddFloat("Scan3dCoordinateScale", kScan3dScale, SimulatedNodeMap::RO);
+        device.AddEnumeration("Scan3dCoordinateSelector", {{"CoordinateA", 0}, {"CoordinateB", 1}, {"CoordinateC", 2}}, "CoordinateA", SimulatedNodeMap::RW, false, {"Scan3dCoordinateOffset"});
+        device.AddSelectedFloat("Scan3dCoordinateOffset", "Scan3dCoordinateSelector", {kScan3dOffsets[0], kScan3dOffsets[1], kScan3dOffsets[2]});
+        // pinhole model of the rendering, in pixels
+        device.AddFloat("Scan3dFocalLength", FocalLengthHLT(m_width), SimulatedNodeMap::RO);
+        device.AddFloat("Scan3dPrincipalPointU", (static_cast<double>(m_width) - 1.0) / 2.0, SimulatedNodeMap::RO);
+        device.AddFloat("Scan3dPrincipalPointV", (static_cast<double>(m_height) - 1.0) / 2.0, SimulatedNodeMap::RO);
+    } else {
+        device.AddEnumeration("ExposureAuto", {{"Off", 0}, {"Once", 1}, {"Continuous", 2}}, "Off", SimulatedNodeMap::RW, true);
+    }
+    device.SetReadHook([this](const std::string& feature) { OnDeviceRead(feature); });
+    device.SetWriteHook([this](const std::string& feature) { OnDeviceWrite(feature); });
+    device.Load();
+
+    m_tl_device_map.AddString("DeviceModelName", m_model_name);
+    m_tl_device_map.AddString("DeviceSerialNumber", m_serial_number);
+    m_tl_device_map.AddString("DeviceVendorName", "Simulated");
+    m_tl_device_map.Load();
+
+    m_tl_stream_map.AddBoolean("StreamAutoNegotiatePacketSize", false);
+    m_tl_stream_map.AddBoolean("StreamPacketResendEnable", false);
+    m_tl_stream_map.AddInteger("StreamLostFrameCount", 0, SimulatedNodeMap::RO);
+    m_tl_stream_map.AddInteger("StreamIncompleteFrameCount", 0, SimulatedNodeMap::RO);
+    m_tl_stream_map.AddInteger("StreamMissedPacketCount", 0, SimulatedNodeMap::RO);
+    m_tl_stream_map.AddInteger("StreamResendRequestCount", 0, SimulatedNodeMap::RO);
+    m_tl_stream_map.AddInteger("StreamInputBufferCount", 0, SimulatedNodeMap::RO);
+    m_tl_stream_map.SetReadHook([this](const std::string& feature) { OnStreamRead(feature); });
+    m_tl_stream_map.Load();
+
+    m_tl_interface_map.AddString("InterfaceID", "Simulated");
+    m_tl_interface_map.Load();
+}
+
+SimulatedDevice::~SimulatedDevice() {
+    StopStream();
+    DeregisterAllImageCallbacks();
+}
+
+bool SimulatedDevice::IsPtpEnabled() const {
+    return m_device_map.GetBool("PtpEnable");
+}
+
+bool SimulatedDevice::IsPtpSlaveOnly() const {
+    return m_device_map.GetBool("PtpSlaveOnly");
+}
+
+int64_t SimulatedDevice::Now() const {
+    // the grandmaster defines the time, slaves stay within their offset of it
+    bool master = m_system.IsPtpMaster(this);
+    return m_system.PtpNow() + (master ? 0 : m_clock_offset_ns);
+}
+
+int64_t SimulatedDevice::MinFramePeriodNs() const {
+    double maxFrameRate = m_helios ? m_params.maxFrameRateHLT : m_params.maxFrameRateTRI;
+    double frameRate = std::min(m_device_map.GetFloat("AcquisitionFrameRate"), maxFrameRate);
+    return frameRate > 0.0 ? SecondsToNs(1.0 / frameRate) : 0;
+}
+
+void SimulatedDevice::OnDeviceRead(const std::string& feature) {
+    if (feature != "PtpStatus")
+        return;
+
+    std::chrono::steady_clock::time_point enabledAt;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        enabledAt = m_ptp_enabled_at;
+    }
+    std::string status;
+    if (!IsPtpEnabled())
+        status = "Disabled";
+    else if (std::chrono::steady_clock::now() - enabledAt < std::chrono::milliseconds(m_params.ptpConvergenceMs))
+        status = "Listening";
+    else
+        status = m_system.IsPtpMaster(this) ? "Master" : "Slave";
+    m_device_map.SetEntry("PtpStatus", status);
+}
+
+void SimulatedDevice::OnDeviceWrite(const std::string& feature) {
+    if (feature == "PtpEnable" || feature == "PtpSlaveOnly") {
+        // any change restarts the negotiation
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_ptp_enabled_at = std::chrono::steady_clock::now();
+    } else if (feature == "PtpDataSetLatch") {
+        m_device_map.SetInt("PtpDataSetLatchValue", Now());
+        m_device_map.SetInt("PtpDataSetLatch", 0);
+    }
+}
+
+void SimulatedDevice::OnStreamRead(const std::string& feature) {
+    if (feature == "StreamLostFrameCount") {
+        m_tl_stream_map.SetInt(feature, m_lost_frames);
+    } else if (feature == "StreamIncompleteFrameCount") {
+        m_tl_stream_map.SetInt(feature, m_incomplete_frames);
+    } else if (feature == "StreamInputBufferCount") {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_tl_stream_map.SetInt(feature, static_cast<int64_t>(m_free_buffers));
+    }
+}
+
+void SimulatedDevice::SendActionCommand(uint32_t deviceKey, uint32_t groupKey, uint32_t groupMask, uint64_t actionTime) {
+    OnActionCommand(deviceKey, groupKey, groupMask, static_cast<int64_t>(actionTime));
+}
+
+void SimulatedDevice::OnActionCommand(int64_t deviceKey, int64_t groupKey, int64_t groupMask, int64_t actionTime) {
+    if (deviceKey != m_device_map.GetInt("ActionDeviceKey") || groupKey != m_device_map.GetInt("ActionGroupKey") || (groupMask & m_device_map.GetInt("ActionGroupMask")) == 0)
+        return;
+    if (m_device_map.GetEntry("TriggerMode") != "On" || m_device_map.GetEntry("TriggerSource") != "Action0")
+        return;
+    if (actionTime == 0)
+        actionTime = Now();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_streaming && m_device_map.GetEntry("ActionUnconditionalMode") != "On")
+        return;
+    // the device keeps a limited number of scheduled actions
+    if (m_actions.size() >= static_cast<size_t>(m_device_map.GetInt("ActionQueueSize")))
+        return;
+    m_actions.insert(std::upper_bound(m_actions.begin(), m_actions.end(), actionTime), actionTime);
+    m_action_cv.notify_all();
+}
+
+void SimulatedDevice::StartStream(size_t numBuffers) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_streaming)
+        throw LOGICAL_ERROR_EXCEPTION("stream of %s already started", m_serial_number.c_str());
+    if (numBuffers == 0)
+        throw INVALID_ARGUMENT_EXCEPTION("stream of %s needs at least one buffer", m_serial_number.c_str());
+
+    // actions that came due while stopped are gone
+    int64_t now = Now();
+    while (!m_actions.empty() && m_actions.front() < now)
+        m_actions.pop_front();
+
+    m_num_buffers = numBuffers;
+    m_free_buffers = numBuffers;
+    m_last_exposure = 0;
+    m_streaming = true;
+    m_acquisition_thread = std::thread(&SimulatedDevice::AcquisitionLoop, this);
+    m_delivery_thread = std::thread(&SimulatedDevice::DeliveryLoop, this);
+}
+
+void SimulatedDevice::StopStream() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_streaming)
+            return;
+        m_streaming = false;
+    }
+    m_action_cv.notify_all();
+    m_filled_cv.notify_all();
+    m_acquisition_thread.join();
+    m_delivery_thread.join();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (SimulatedImage* pImage : m_filled)
+        delete pImage;
+    m_filled.clear();
+    m_free_buffers = 0;
+}
+
+Arena::IImage* SimulatedDevice::GetImage(uint64_t timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_streaming)
+        throw LOGICAL_ERROR_EXCEPTION("stream of %s not started", m_serial_number.c_str());
+    if (!m_filled_cv.wait_for(lock, std::chrono::milliseconds(timeout), [this] { return !m_filled.empty() || !m_streaming; }) || m_filled.empty())
+        throw TIMEOUT_EXCEPTION("no image from %s within %llu ms", m_serial_number.c_str(), static_cast<unsigned long long>(timeout));
+
+    SimulatedImage* pImage = m_filled.front();
+    m_filled.pop_front();
+    return pImage;
+}
+
+void SimulatedDevice::RequeueBuffer(Arena::IBuffer* pBuffer) {
+    SimulatedImage* pImage = dynamic_cast<SimulatedImage*>(pBuffer);
+    if (!pImage)
+        throw INVALID_ARGUMENT_EXCEPTION("buffer does not belong to %s", m_serial_number.c_str());
+    delete pImage;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_free_buffers < m_num_buffers)
+        m_free_buffers++;
+}
+
+void SimulatedDevice::WaitForNextLeader(uint64_t) {
+    throw LOGICAL_ERROR_EXCEPTION("WaitForNextLeader is not supported by the simulated device");
+}
+
+void SimulatedDevice::InitializeEvents() {
+    throw LOGICAL_ERROR_EXCEPTION("events are not supported by the simulated device");
+}
+
+void SimulatedDevice::WaitOnEvent(uint64_t) {
+    throw LOGICAL_ERROR_EXCEPTION("events are not supported by the simulated device");
+}
+
+void SimulatedDevice::RegisterImageCallback(Arena::IImageCallback* callback) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_callbacks.push_back(callback);
+    m_filled_cv.notify_all();
+}
+
+bool SimulatedDevice::DeregisterImageCallback(Arena::IImageCallback* callback) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // the callback may be running on the delivery thread
+    m_filled_cv.wait(lock, [this] { return !m_delivering; });
+    auto it = std::find(m_callbacks.begin(), m_callbacks.end(), callback);
+    if (it == m_callbacks.end())
+        return false;
+    m_callbacks.erase(it);
+    return true;
+}
+
+bool SimulatedDevice::DeregisterAllImageCallbacks() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_filled_cv.wait(lock, [this] { return !m_delivering; });
+    bool any = !m_callbacks.empty();
+    m_callbacks.clear();
+    return any;
+}
+
+void SimulatedDevice::AcquisitionLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    int64_t nextFreeRun = Now();
+    while (m_streaming) {
+        bool triggered = m_device_map.GetEntry("TriggerMode") == "On";
+        if (triggered && m_actions.empty()) {
+            m_action_cv.wait(lock);
+            continue;
+        }
+
+        int64_t due = triggered ? m_actions.front() : nextFreeRun;
+        if (due > Now()) {
+            // an earlier action or a stop may come in while waiting
+            m_action_cv.wait_until(lock, m_system.SteadyAt(due - (m_system.IsPtpMaster(this) ? 0 : m_clock_offset_ns)));
+            continue;
+        }
+        if (triggered)
+            m_actions.pop_front();
+
+        // triggers during the previous exposure and readout are ignored
+        int64_t period = MinFramePeriodNs();
+        if (m_last_exposure != 0 && due < m_last_exposure + period)
+            continue;
+        m_last_exposure = due;
+        nextFreeRun = due + period;
+
+        lock.unlock();
+        ProduceFrame(due);
+        lock.lock();
+    }
+}
+
+void SimulatedDevice::ProduceFrame(int64_t exposureTime) {
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    int64_t jitter = m_params.timestampJitterNs > 0 ? std::uniform_int_distribution<int64_t>(-m_params.timestampJitterNs, m_params.timestampJitterNs)(m_rng) : 0;
+    bool lost = chance(m_rng) < m_params.dropRate;
+    bool incomplete = chance(m_rng) < m_params.incompleteRate;
+
+    uint64_t pixelFormat = static_cast<uint64_t>(m_device_map.GetInt("PixelFormat"));
+    uint64_t frameId = 0;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        frameId = ++m_frame_id;
+    }
+    if (lost) {
+        m_lost_frames++;
+        return;
+    }
+
+    SimulatedImage* pImage = new SimulatedImage(m_width, m_height, pixelFormat, Frame(pixelFormat), static_cast<uint64_t>(exposureTime + jitter), frameId, incomplete);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_free_buffers == 0) {
+        // every buffer is still queued or held by the application
+        lock.unlock();
+        delete pImage;
+        m_lost_frames++;
+        return;
+    }
+    m_free_buffers--;
+    if (incomplete)
+        m_incomplete_frames++;
+    m_filled.push_back(pImage);
+    m_filled_cv.notify_all();
+}
+
+void SimulatedDevice::DeliveryLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_filled_cv.wait(lock, [this] { return !m_streaming || (!m_filled.empty() && !m_callbacks.empty()); });
+        if (!m_streaming)
+            break;
+
+        SimulatedImage* pImage = m_filled.front();
+        m_filled.pop_front();
+        std::vector<Arena::IImageCallback*> callbacks = m_callbacks;
+        m_delivering = true;
+        lock.unlock();
+
+        for (Arena::IImageCallback* pCallback : callbacks)
+            pCallback->OnImage(pImage);
+        delete pImage;
+
+        lock.lock();
+        m_delivering = false;
+        m_free_buffers++;
+        m_filled_cv.notify_all();
+    }
+}
+
+const std::vector<uint8_t>& SimulatedDevice::Frame(uint64_t pixelFormat) {
+    auto it = m_frames.find(pixelFormat);
+    if (it != m_frames.end())
+        return it->second;
+
+    // the scene is static, each format is rendered once
+    std::vector<uint8_t>& frame = m_frames[pixelFormat];
+    frame.assign(m_width * m_height * BitsPerPixel(pixelFormat) / 8, 0);
+
+    double cx = (static_cast<double>(m_width) - 1.0) / 2.0;
+    double cy = (static_cast<double>(m_height) - 1.0) / 2.0;
+    double focal = m_helios ? FocalLengthHLT(m_width) : FocalLengthTRI(m_width);
+    double origin[3] = {m_helios ? 0.0 : kBaselineTRI, 0.0, 0.0};
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    for (size_t row = 0; row < m_height; row++) {
+        for (size_t col = 0; col < m_width; col++) {
+            double direction[3] = {(static_cast<double>(col) - cx) / focal, (static_cast<double>(row) - cy) / focal, 1.0};
+            SceneHit hit;
+            bool valid = IntersectScene(origin, direction, hit);
+            size_t pixel = row * m_width + col;
+
+            if (pixelFormat == LUCID_Coord3D_ABCY16 || pixelFormat == PFNC_Coord3D_C16) {
+                uint16_t abcy[4] = {kInvalidCoordinate, kInvalidCoordinate, kInvalidCoordinate, 0};
+                if (valid && chance(m_rng) >= m_params.invalidPixelRatio) {
+                    for (int axis = 0; axis < 3; axis++)
+                        abcy[axis] = EncodeCoordinate(hit.point[axis], axis);
+                    abcy[3] = static_cast<uint16_t>(100 + 900 * hit.shade);
+                }
+                if (pixelFormat == LUCID_Coord3D_ABCY16)
+                    std::memcpy(&frame[pixel * 8], abcy, 8);
+                else
+                    std::memcpy(&frame[pixel * 2], &abcy[2], 2);
+            } else if (pixelFormat == PFNC_RGB8 || pixelFormat == PFNC_BayerRG8) {
+                uint8_t rgb[3] = {0, 0, 0};
+                if (valid)
+                    SceneColor(hit, rgb);
+                if (pixelFormat == PFNC_RGB8) {
+                    std::memcpy(&frame[pixel * 3], rgb, 3);
+                } else {
+                    // RG/GB tiles
+                    int channel = (row % 2 == 0) ? (col % 2 == 0 ? 0 : 1) : (col % 2 == 0 ? 1 : 2);
+                    frame[pixel] = rgb[channel];
+                }
+            }
+        }
+    }
+    return frame;
+}
+
+//
+// SimulatedSystem
+//
+
+SimulatedSystem::SimulatedSystem(const SimulationParams& params)
+    : m_params(params),
+      m_system_map("Simulated System"),
+      m_interface_map("Simulated Interface"),
+      m_epoch(std::chrono::steady_clock::now()),
+      m_ptp_epoch_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()) {
+    for (size_t i = 0; i < m_params.rigCount; i++) {
+        m_infos.push_back({"HLT003S-001", "SIM-HLT-" + std::to_string(i)});
+        m_infos.push_back({"TRI032S-C", "SIM-TRI-" + std::to_string(i)});
+    }
+
+    m_system_map.AddInteger("ActionCommandDeviceKey", 0);
+    m_system_map.AddInteger("ActionCommandGroupKey", 0);
+    m_system_map.AddInteger("ActionCommandGroupMask", 0);
+    m_system_map.AddInteger("ActionCommandTargetIP", 0xFFFFFFFF);
+    m_system_map.AddInteger("ActionCommandExecuteTime", 0);
+    m_system_map.AddCommand("ActionCommandFireCommand");
+    m_system_map.SetWriteHook([this](const std::string& feature) { OnSystemWrite(feature); });
+    m_system_map.Load();
+
+    m_interface_map.AddString("InterfaceID", "Simulated");
+    m_interface_map.Load();
+}
+
+SimulatedSystem::~SimulatedSystem() {
+    std::vector<SimulatedDevice*> devices;
+    {
+        std::unique_lock<std::mutex> lock(m_devices_mutex);
+        devices.swap(m_devices);
+    }
+    for (SimulatedDevice* pDevice : devices)
+        delete pDevice;
+}
+
+Arena::IDevice* SimulatedSystem::CreateDevice(Arena::DeviceInfo) {
+    throw LOGICAL_ERROR_EXCEPTION("simulated devices are created by serial number");
+}
+
+Arena::IDevice* SimulatedSystem::CreateDevice(const std::string& serialNumber) {
+    for (size_t i = 0; i < m_infos.size(); i++) {
+        if (m_infos[i].serialNumber != serialNumber)
+            continue;
+
+        bool helios = m_infos[i].modelName.find("HLT") != std::string::npos;
+        SimulatedDevice* pDevice = new SimulatedDevice(*this, m_params, m_infos[i].modelName, serialNumber, helios, m_params.seed + static_cast<uint32_t>(i));
+        std::unique_lock<std::mutex> lock(m_devices_mutex);
+        m_devices.push_back(pDevice);
+        return pDevice;
+    }
+    throw INVALID_ARGUMENT_EXCEPTION("no simulated device with serial number %s", serialNumber.c_str());
+}
+
+void SimulatedSystem::DestroyDevice(Arena::IDevice* pDevice) {
+    {
+        std::unique_lock<std::mutex> lock(m_devices_mutex);
+        auto it = std::find(m_devices.begin(), m_devices.end(), pDevice);
+        if (it == m_devices.end())
+            throw INVALID_ARGUMENT_EXCEPTION("device does not belong to the simulated system");
+        m_devices.erase(it);
+    }
+    delete pDevice;
+}
+
+int64_t SimulatedSystem::PtpNow() const {
+    return m_ptp_epoch_ns + std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+std::chrono::steady_clock::time_point SimulatedSystem::SteadyAt(int64_t ptpTime) const {
+    return m_epoch + std::chrono::nanoseconds(ptpTime - m_ptp_epoch_ns);
+}
+
+bool SimulatedSystem::IsPtpMaster(const SimulatedDevice* pDevice) {
+    std::unique_lock<std::mutex> lock(m_devices_mutex);
+    for (SimulatedDevice* pCandidate : m_devices) {
+        if (pCandidate->IsPtpEnabled() && !pCandidate->IsPtpSlaveOnly())
+            return pCandidate == pDevice;
+    }
+    return false;
+}
+
+void SimulatedSystem::OnSystemWrite(const std::string& feature) {
+    if (feature != "ActionCommandFireCommand")
+        return;
+    m_system_map.SetInt(feature, 0);
+
+    int64_t deviceKey = m_system_map.GetInt("ActionCommandDeviceKey");
+    int64_t groupKey = m_system_map.GetInt("ActionCommandGroupKey");
+    int64_t groupMask = m_system_map.GetInt("ActionCommandGroupMask");
+    int64_t executeTime = m_system_map.GetInt("ActionCommandExecuteTime");
+
+    // devices take their own lock, so deliver outside of the device list lock
+    std::vector<SimulatedDevice*> devices;
+    {
+        std::unique_lock<std::mutex> lock(m_devices_mutex);
+        devices = m_devices;
+    }
+    for (SimulatedDevice* pDevice : devices)
+        pDevice->OnActionCommand(deviceKey, groupKey, groupMask, executeTime);
+}
+
+void WriteSimulatedCalibration(const std::string& fileName, const SimulationParams& params) {
+    double focal = FocalLengthTRI(params.widthTRI);
+    double cx = (static_cast<double>(params.widthTRI) - 1.0) / 2.0;
+    double cy = (static_cast<double>(params.heightTRI) - 1.0) / 2.0;
+
+    std::ofstream file(fileName);
+    if (!file)
+        throw std::runtime_error("cannot write " + fileName);
+
+    auto matrix = [&file](const char* name, int rows, int cols, const std::vector<double>& data) {
+        file << name << ": !!opencv-matrix\n   rows: " << rows << "\n   cols: " << cols << "\n   dt: d\n   data: [ ";
+        for (size_t i = 0; i < data.size(); i++)
+            file << (i ? ", " : "") << data[i];
+        file << " ]\n";
+    };
+
+    file << std::fixed << std::setprecision(6);
+    file << "%YAML:1.0\n---\n";
+    matrix("cameraMatrix", 3, 3, {focal, 0.0, cx, 0.0, focal, cy, 0.0, 0.0, 1.0});
+    matrix("distCoeffs", 1, 5, {0.0, 0.0, 0.0, 0.0, 0.0});
+    matrix("rotationVector", 3, 1, {0.0, 0.0, 0.0});
+    // HLT points in Triton coordinates are shifted by the Triton position
+    matrix("translationVector", 3, 1, {-kBaselineTRI, 0.0, 0.0});
+}
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ArenaApi.h"
+
+// Knobs of the simulated Helios2 + Triton rigs
+struct SimulationParams {
+    size_t rigCount = 1;
+    size_t widthHLT = 640;
+    size_t heightHLT = 480;
+    size_t widthTRI = 2048;
+    size_t heightTRI = 1536;
+    double maxFrameRateHLT = 30.0;     // reported as AcquisitionFrameRate max, triggers while busy are ignored
+    double maxFrameRateTRI = 30.0;
+    double invalidPixelRatio = 0.1;    // share of HLT pixels without a depth value
+    double dropRate = 0.0;             // share of frames lost on the way to the host
+    double incompleteRate = 0.0;       // share of frames delivered incomplete
+    int64_t ptpClockOffsetNs = 2000;   // max offset of a slave clock from the master after convergence
+    int64_t timestampJitterNs = 500;   // exposure start jitter around the action time
+    uint32_t ptpConvergenceMs = 300;   // time from PtpEnable until the device reports Master or Slave
+    int64_t actionQueueSize = 8;       // scheduled action commands a device keeps, later ones are dropped
+    uint32_t seed = 1;
+};
+
+// GenApi node map over an in-memory register file. Features are declared with
+// the Add* calls and become nodes on Load(). Every feature is backed by an
+// uncached register, so the owning device sees each access: the write hook is
+// called after a feature was written, the read hook before it is read.
+class SimulatedNodeMap {
+   public:
+    enum Access {
+        RO,
+        RW
+    };
+    typedef std::vector<std::pair<std::string, int64_t>> EnumEntries;
+    typedef std::function<void(const std::string& feature)> Hook;
+
+    explicit SimulatedNodeMap(const std::string& modelName);
+    ~SimulatedNodeMap();
+
+    void AddInteger(const std::string& name, int64_t value, Access access = RW, bool streamable = false);
+    void AddFloat(const std::string& name, double value, Access access = RW, double max = 0.0);
+    // one value per entry of the selector enumeration
+    void AddSelectedFloat(const std::string& name, const std::string& selector, const std::vector<double>& values, Access access = RO);
+    void AddBoolean(const std::string& name, bool value, Access access = RW, bool streamable = false);
+    void AddEnumeration(const std::string& name, const EnumEntries& entries, const std::string& value, Access access = RW, bool streamable = false, const std::vector<std::string>& selected = {});
+    void AddCommand(const std::string& name);
+    void AddString(const std::string& name, const std::string& value);
+
+    void SetWriteHook(Hook hook) { m_write_hook = hook; }
+    void SetReadHook(Hook hook) { m_read_hook = hook; }
+
+    // Builds the nodes, no features can be added afterwards
+    void Load();
+    GenApi::INodeMap* Get() { return m_node_map._Ptr; }
+
+    // Register access for the simulation, bypasses GenApi and the hooks
+    int64_t GetInt(const std::string& name, size_t index = 0) const;
+    void SetInt(const std::string& name, int64_t value, size_t index = 0);
+    double GetFloat(const std::string& name, size_t index = 0) const;
+    void SetFloat(const std::string& name, double value, size_t index = 0);
+    bool GetBool(const std::string& name) const { return GetInt(name) != 0; }
+    // name of the current entry of an enumeration
+    std::string GetEntry(const std::string& name) const;
+    void SetEntry(const std::string& name, const std::string& entry);
+
+   private:
+    enum Kind {
+        KindInteger,
+        KindFloat,
+        KindBoolean,
+        KindEnumeration,
+        KindCommand,
+        KindString
+    };
+
+    struct Feature {
+        Kind kind;
+        std::string name;
+        Access access;
+        bool streamable;
+        int64_t address;
+        size_t length;
+        EnumEntries entries;
+        std::vector<std::string> selected;
+        std::string selector;
+        double max;
+    };
+
+    class Port;
+    friend class Port;
+
+    Feature& Add(Kind kind, const std::string& name, Access access, bool streamable, size_t length);
+    const Feature& Find(const std::string& name) const;
+    std::string BuildXml() const;
+    void OnRead(int64_t address);
+    void OnWrite(int64_t address);
+
+    std::string m_model_name;
+    std::vector<Feature> m_features;
+    std::map<int64_t, std::string> m_names_by_address;
+    std::vector<uint8_t> m_registers;
+    mutable std::mutex m_registers_mutex;
+    std::unique_ptr<Port> m_port;
+    GenApi::CNodeMapRef m_node_map;
+    Hook m_write_hook;
+    Hook m_read_hook;
+};
+
+// Image produced by a simulated device, owns its pixel data
+class SimulatedImage : public Arena::IImage {
+   public:
+    SimulatedImage(size_t width, size_t height, uint64_t pixelFormat, const std::vector<uint8_t>& data, uint64_t timestampNs, uint64_t frameId, bool incomplete);
+
+    size_t GetWidth() override { return m_width; }
+    size_t GetHeight() override { return m_height; }
+    size_t GetOffsetX() override { return 0; }
+    size_t GetOffsetY() override { return 0; }
+    size_t GetPaddingX() override { return 0; }
+    size_t GetPaddingY() override { return 0; }
+    uint64_t GetPixelFormat() override { return m_pixel_format; }
+    size_t GetBitsPerPixel() override;
+    int32_t GetPixelEndianness() override { return Arena::PixelEndiannessLittle; }
+    uint64_t GetTimestamp() override { return m_timestamp_ns; }
+    uint64_t GetTimestampNs() override { return m_timestamp_ns; }
+    const uint8_t* GetData() override { return m_data.data(); }
+    size_t GetSizeFilled() override { return m_data.size(); }
+    size_t GetPayloadSize() override { return m_data.size(); }
+    size_t GetSizeOfBuffer() override { return m_data.size(); }
+    uint64_t GetFrameId() override { return m_frame_id; }
+    size_t GetPayloadType() override { return Arena::BufferPayloadTypeImage; }
+    bool HasImageData() override { return true; }
+    bool HasChunkData() override { return false; }
+    Arena::IChunkData* AsChunkData() override { return nullptr; }
+    bool IsIncomplete() override { return m_incomplete; }
+    bool DataLargerThanBuffer() override { return false; }
+    bool VerifyCRC() override { return true; }
+    Arena::IImage* AsImage() override { return this; }
+
+   private:
+    size_t m_width;
+    size_t m_height;
+    uint64_t m_pixel_format;
+    std::vector<uint8_t> m_data;
+    uint64_t m_timestamp_ns;
+    uint64_t m_frame_id;
+    bool m_incomplete;
+};
+
+class SimulatedSystem;
+
+// Helios2 or Triton without hardware. Exposures start on scheduled action
+// commands (or free-run with TriggerMode Off) at the device's PTP time, frames
+// go through a pool of numBuffers stream buffers and reach the image
+// callbacks on a separate delivery thread, like the Arena acquisition engine.
+class SimulatedDevice : public Arena::IDevice {
+   public:
+    SimulatedDevice(SimulatedSystem& system, const SimulationParams& params, const std::string& modelName, const std::string& serialNumber, bool helios, uint32_t seed);
+    ~SimulatedDevice() override;
+
+    bool IsConnected() override { return true; }
+    void StartStream(size_t numBuffers = 10) override;
+    void StopStream() override;
+    Arena::IImage* GetImage(uint64_t timeout) override;
+    Arena::IBuffer* GetBuffer(uint64_t timeout) override { return GetImage(timeout); }
+    void RequeueBuffer(Arena::IBuffer* pBuffer) override;
+    void WaitForNextLeader(uint64_t timeout) override;
+    void ResetWaitForNextLeader() override {}
+    void InitializeEvents() override;
+    void DeinitializeEvents() override {}
+    void WaitOnEvent(uint64_t timeout) override;
+    GenApi::INodeMap* GetNodeMap() override { return m_device_map.Get(); }
+    GenApi::INodeMap* GetTLDeviceNodeMap() override { return m_tl_device_map.Get(); }
+    GenApi::INodeMap* GetTLStreamNodeMap() override { return m_tl_stream_map.Get(); }
+    GenApi::INodeMap* GetTLInterfaceNodeMap() override { return m_tl_interface_map.Get(); }
+    void SendActionCommand(uint32_t deviceKey, uint32_t groupKey, uint32_t groupMask, uint64_t actionTime) override;
+    void RegisterImageCallback(Arena::IImageCallback* callback) override;
+    bool DeregisterImageCallback(Arena::IImageCallback* callback) override;
+    bool DeregisterAllImageCallbacks() override;
+    void DownloadXml() override {}
+
+    const std::string& SerialNumber() const { return m_serial_number; }
+    bool IsPtpEnabled() const;
+    bool IsPtpSlaveOnly() const;
+    // Called for every action command on the network
+    void OnActionCommand(int64_t deviceKey, int64_t groupKey, int64_t groupMask, int64_t actionTime);
+
+   private:
+    void OnDeviceRead(const std::string& feature);
+    void OnDeviceWrite(const std::string& feature);
+    void OnStreamRead(const std::string& feature);
+    int64_t Now() const;
+    int64_t MinFramePeriodNs() const;
+    void AcquisitionLoop();
+    void DeliveryLoop();
+    void ProduceFrame(int64_t exposureTime);
+    const std::vector<uint8_t>& Frame(uint64_t pixelFormat);
+
+    SimulatedSystem& m_system;
+    SimulationParams m_params;
+    std::string m_model_name;
+    std::string m_serial_number;
+    bool m_helios;
+    size_t m_width;
+    size_t m_height;
+
+    SimulatedNodeMap m_device_map;
+    SimulatedNodeMap m_tl_device_map;
+    SimulatedNodeMap m_tl_stream_map;
+    SimulatedNodeMap m_tl_interface_map;
+
+    // PTP
+    int64_t m_clock_offset_ns;
+    std::chrono::steady_clock::time_point m_ptp_enabled_at;
+
+    // acquisition, guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_action_cv;
+    std::condition_variable m_filled_cv;
+    bool m_streaming = false;
+    std::deque<int64_t> m_actions;
+    std::deque<SimulatedImage*> m_filled;
+    size_t m_free_buffers = 0;
+    size_t m_num_buffers = 0;
+    std::vector<Arena::IImageCallback*> m_callbacks;
+    bool m_delivering = false;
+    int64_t m_last_exposure = 0;
+    uint64_t m_frame_id = 0;
+    std::thread m_acquisition_thread;
+    std::thread m_delivery_thread;
+
+    // acquisition thread only
+    std::mt19937 m_rng;
+    std::map<uint64_t, std::vector<uint8_t>> m_frames;
+
+    std::atomic<int64_t> m_lost_frames;
+    std::atomic<int64_t> m_incomplete_frames;
+};
+
+// Model name and serial number of a simulated device, in place of the
+// Arena::DeviceInfo only the Arena system can fill in
+struct SimulatedDeviceInfo {
+    std::string modelName;
+    std::string serialNumber;
+};
+
+// Arena::ISystem with SimulationParams::rigCount simulated HLT003S and
+// TRI032S pairs. The system node map fires action commands at every created
+// device; all devices share one host clock as PTP time base.
+class SimulatedSystem : public Arena::ISystem {
+   public:
+    explicit SimulatedSystem(const SimulationParams& params);
+    ~SimulatedSystem() override;
+
+    std::vector<Arena::InterfaceInfo> GetInterfaces() override { return {}; }
+    bool UpdateDevices(uint64_t) override { return false; }
+    bool UpdateDevices(Arena::InterfaceInfo, uint64_t) override { return false; }
+    // Arena::DeviceInfo cannot be filled in outside the Arena system, the
+    // simulated devices are listed by Devices() and created by serial number
+    std::vector<Arena::DeviceInfo> GetDevices() override { return {}; }
+    Arena::IDevice* CreateDevice(Arena::DeviceInfo info) override;
+    void DestroyDevice(Arena::IDevice* pDevice) override;
+    GenApi::INodeMap* GetTLSystemNodeMap() override { return m_system_map.Get(); }
+    GenApi::INodeMap* GetTLInterfaceNodeMap(Arena::DeviceInfo) override { return m_interface_map.Get(); }
+    void ForceIp(uint64_t, uint64_t, uint64_t, uint64_t) override {}
+    void ForceIp(const char*, const char*, const char*, const char*) override {}
+    void RegisterDeviceDisconnectCallback(Arena::IDevice*, Arena::IDisconnectCallback*) override {}
+    void DeregisterDeviceDisconnectCallback(Arena::IDisconnectCallback*) override {}
+    void DeregisterAllDeviceDisconnectCallbacks() override {}
+
+    const std::vector<SimulatedDeviceInfo>& Devices() const { return m_infos; }
+    Arena::IDevice* CreateDevice(const std::string& serialNumber);
+
+    // PTP time of the grandmaster, ns
+    int64_t PtpNow() const;
+    std::chrono::steady_clock::time_point SteadyAt(int64_t ptpTime) const;
+    // The first created device with PTP enabled and not slave only wins the election
+    bool IsPtpMaster(const SimulatedDevice* pDevice);
+
+   private:
+    void OnSystemWrite(const std::string& feature);
+
+    SimulationParams m_params;
+    std::vector<SimulatedDeviceInfo> m_infos;
+    SimulatedNodeMap m_system_map;
+    SimulatedNodeMap m_interface_map;
+    std::chrono::steady_clock::time_point m_epoch;
+    int64_t m_ptp_epoch_ns;
+    std::mutex m_devices_mutex;
+    std::vector<SimulatedDevice*> m_devices;
+};
+
+// Writes an orientation file in the format of Cpp_HLTRGB_2_Orientation that
+// matches the simulated rig geometry
+void WriteSimulatedCalibration(const std::string& fileName, const SimulationParams& params);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// One slot is kept empty to tell a full ring from an empty one.
+template <typename T>
+class SpscQueue {
+   public:
+    explicit SpscQueue(size_t capacity) : m_slots(capacity + 1), m_head(0), m_tail(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // producer side, false if the queue is full
+    bool TryPush(const T& value) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t next = Next(tail);
+        if (next == m_head.load(std::memory_order_acquire))
+            return false;
+        m_slots[tail] = value;
+        m_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, false if the queue is empty
+    bool TryPop(T& value) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+        value = m_slots[head];
+        m_head.store(Next(head), std::memory_order_release);
+        return true;
+    }
+
+    // producer side, true if TryPush would fail; only the consumer can make room
+    bool Full() const {
+        return Next(m_tail.load(std::memory_order_relaxed)) == m_head.load(std::memory_order_acquire);
+    }
+
+    bool Empty() const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const { return m_slots.size() - 1; }
+
+   private:
+    size_t Next(size_t index) const { return index + 1 == m_slots.size() ? 0 : index + 1; }
+
+    std::vector<T> m_slots;
+    // head and tail are written by different threads, keep them on separate cache lines
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+};
@@ -0,0 +1,114 @@
+#include "StreamBufferPool.h"
+
+#include <algorithm>
+#include <iostream>
+
+#define TAB1 "  "
+
+namespace {
+// free input buffers kept as a margin, and Updates without starvation before shrinking to it
+const int64_t kSpareBuffers = 2;
+const size_t kShrinkAfterUpdates = 10;
+
+int64_t ReadCounter(GenApi::INodeMap* pNodeMap, const char* name) {
+    GenApi::CIntegerPtr pCounter = pNodeMap->GetNode(name);
+    if (!GenApi::IsReadable(pCounter))
+        return -1;
+    return pCounter->GetValue();
+}
+}  // namespace
+
+StreamBufferPool::StreamBufferPool(Arena::IDevice* pDevice, const std::string& name, size_t minBuffers, size_t maxBuffers)
+    : m_pDevice(pDevice),
+      m_name(name),
+      m_min_buffers(std::max<size_t>(minBuffers, 1)),
+      m_max_buffers(std::max(maxBuffers, minBuffers)),
+      m_pInputBuffers(pDevice->GetTLStreamNodeMap()->GetNode("StreamInputBufferCount")) {
+}
+
+size_t StreamBufferPool::Recommend(int64_t periodNs, int64_t holdNs, size_t framesAhead) const {
+    size_t held = periodNs > 0 ? static_cast<size_t>((holdNs + periodNs - 1) / periodNs) : 0;
+    // two spare buffers cover a frame in transfer and one being handed over
+    size_t needed = held + framesAhead + 2;
+    return std::min(std::max(needed, m_min_buffers), m_max_buffers);
+}
+
+void StreamBufferPool::Start(size_t numBuffers) {
+    m_num_buffers = std::min(std::max(numBuffers, m_min_buffers), m_max_buffers);
+    m_pDevice->StartStream(m_num_buffers);
+    m_streaming = true;
+    m_target = m_num_buffers;
+    m_min_free = -1;
+    m_idle_updates = 0;
+}
+
+void StreamBufferPool::Stop() {
+    if (m_streaming)
+        m_pDevice->StopStream();
+    m_streaming = false;
+}
+
+void StreamBufferPool::Sample() {
+    if (!m_streaming || !GenApi::IsReadable(m_pInputBuffers))
+        return;
+    int64_t free = m_pInputBuffers->GetValue();
+    if (m_min_free < 0 || free < m_min_free)
+        m_min_free = free;
+}
+
+bool StreamBufferPool::Update(int64_t periodNs, int64_t holdNs, size_t framesAhead) {
+    int64_t minFree = m_min_free;
+    m_min_free = -1;
+
+    size_t target = std::max(m_target, Recommend(periodNs, holdNs, framesAhead));
+    if (minFree == 0) {
+        // the engine had no buffer to fill, the frames arriving then were lost to starvation
+        target = std::max(target, m_num_buffers + m_num_buffers / 2 + 1);
+        m_idle_updates = 0;
+    } else if (minFree > kSpareBuffers) {
+        // buffers that stayed free for kShrinkAfterUpdates in a row are not needed, down to the recommendation
+        if (++m_idle_updates >= kShrinkAfterUpdates) {
+            size_t idle = static_cast<size_t>(minFree - kSpareBuffers);
+            target = std::max(target > idle ? target - idle : 0, Recommend(periodNs, holdNs, framesAhead));
+            m_idle_updates = 0;
+        }
+    } else if (minFree > 0) {
+        m_idle_updates = 0;
+    }
+    target = std::min(std::max(target, m_min_buffers), m_max_buffers);
+    if (target == m_target)
+        return false;
+
+    std::cout << TAB1 << m_name << (minFree == 0 ? " starved" : "") << ": resizing from " << m_num_buffers << " to " << target << " buffers" << std::endl;
+    m_target = target;
+    return true;
+}
+
+bool StreamBufferPool::ApplyTarget() {
+    if (!m_streaming || m_target == m_num_buffers)
+        return false;
+    size_t target = m_target;
+    Stop();
+    Start(target);
+    m_resizes++;
+    return true;
+}
+
+StreamStats StreamBufferPool::ReadStats() const {
+    GenApi::INodeMap* pStreamNodeMap = m_pDevice->GetTLStreamNodeMap();
+
+    StreamStats stats;
+    stats.lostFrames = ReadCounter(pStreamNodeMap, "StreamLostFrameCount");
+    stats.incompleteFrames = ReadCounter(pStreamNodeMap, "StreamIncompleteFrameCount");
+    stats.missedPackets = ReadCounter(pStreamNodeMap, "StreamMissedPacketCount");
+    stats.resendRequests = ReadCounter(pStreamNodeMap, "StreamResendRequestCount");
+    stats.inputBuffers = ReadCounter(pStreamNodeMap, "StreamInputBufferCount");
+    return stats;
+}
+
+void StreamBufferPool::PrintStats() const {
+    StreamStats stats = ReadStats();
+    std::cout << TAB1 << m_name << " stream: " << m_num_buffers << " buffers (" << m_resizes << " resizes), "
+              << stats.lostFrames << " lost frames, " << stats.incompleteFrames << " incomplete frames, "
+              << stats.missedPackets << " missed packets, " << stats.resendRequests << " resend requests" << std::endl;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+
+#include "ArenaApi.h"
+
+// Stream statistics read from the TL stream node map, -1 where the device
+// does not provide the counter
+struct StreamStats {
+    int64_t lostFrames = -1;
+    int64_t incompleteFrames = -1;
+    int64_t missedPackets = -1;
+    int64_t resendRequests = -1;
+    int64_t inputBuffers = -1;
+};
+
+// Owns the acquisition buffer count of one device. The count is derived from
+// the trigger period, the number of actions in flight and how long a buffer is
+// held before it goes back to the engine. The pool learns a target while
+// streaming, grown when the engine ran out of free input buffers and shrunk
+// back when buffers stay idle, and ApplyTarget() restarts the stream with it
+// once the caller has drained the frames in flight. Lost frames alone do not
+// grow it, they also count network and packet loss.
+class StreamBufferPool {
+   public:
+    StreamBufferPool(Arena::IDevice* pDevice, const std::string& name, size_t minBuffers, size_t maxBuffers);
+
+    // Buffers needed to absorb framesAhead triggered frames plus every frame
+    // that arrives while one buffer is held for holdNs
+    size_t Recommend(int64_t periodNs, int64_t holdNs, size_t framesAhead) const;
+
+    void Start(size_t numBuffers);
+    void Stop();
+
+    // Records the free input buffers of the engine, once per frame
+    void Sample();
+
+    // Updates Target() from the samples since the last call and the
+    // recommendation, never touching the stream. Returns true if the target
+    // changed.
+    bool Update(int64_t periodNs, int64_t holdNs, size_t framesAhead);
+
+    // Restarts the stream with Target() buffers if that differs from
+    // BufferCount(). Frames still in the engine are lost, so no action may be
+    // in flight. Returns true if the stream was restarted.
+    bool ApplyTarget();
+
+    size_t Target() const { return m_target; }
+
+    StreamStats ReadStats() const;
+    void PrintStats() const;
+
+    size_t BufferCount() const { return m_num_buffers; }
+    uint64_t ResizeCount() const { return m_resizes; }  // restarts by ApplyTarget()
+
+   private:
+    Arena::IDevice* m_pDevice;
+    std::string m_name;
+    size_t m_min_buffers;
+    size_t m_max_buffers;
+    GenApi::CIntegerPtr m_pInputBuffers;
+    size_t m_num_buffers = 0;
+    size_t m_target = 0;
+    bool m_streaming = false;
+    int64_t m_min_free = -1;     // fewest free input buffers since the last Update, -1 without samples
+    size_t m_idle_updates = 0;   // Updates in a row with spare buffers left
+    uint64_t m_resizes = 0;
+};
@@ -0,0 +1,100 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace {
+// One ParallelFor call. Bands are claimed through an atomic counter by the
+// caller and the helper tasks alike, so a helper that only starts once the
+// caller has finished everything finds nothing left and never touches body.
+struct ParallelForState {
+    ParallelForState(size_t count, size_t bands, const std::function<void(size_t, size_t)>& body) : count(count), bands(bands), body(body), next(0) {}
+
+    void Work() {
+        for (size_t band = next++; band < bands; band = next++) {
+            std::exception_ptr caught;
+            try {
+                body(count * band / bands, count * (band + 1) / bands);
+            } catch (...) {
+                caught = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (caught && !error)
+                error = caught;
+            if (++done == bands)
+                cv.notify_all();
+        }
+    }
+
+    const size_t count;
+    const size_t bands;
+    const std::function<void(size_t, size_t)>& body;
+    std::atomic<size_t> next;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t done = 0;
+    std::exception_ptr error;
+};
+}  // namespace
+
+WorkerPool::WorkerPool(size_t threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 1; i < threads; i++)
+        m_workers.emplace_back(&WorkerPool::Run, this);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    for (std::thread& worker : m_workers)
+        worker.join();
+}
+
+void WorkerPool::ParallelFor(size_t count, size_t bands, const std::function<void(size_t, size_t)>& body) {
+    if (count == 0)
+        return;
+    bands = std::min(std::max<size_t>(bands, 1), count);
+    if (bands == 1 || m_workers.empty()) {
+        body(0, count);
+        return;
+    }
+
+    std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>(count, bands, body);
+    size_t helpers = std::min(bands, Threads()) - 1;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < helpers; i++)
+            m_tasks.push_back([state]() { state->Work(); });
+    }
+    m_cv.notify_all();
+
+    state->Work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&state]() { return state->done == state->bands; });
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
+
+void WorkerPool::Run() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+            if (m_tasks.empty())
+                return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
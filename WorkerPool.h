@@ -0,0 +1,41 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for splitting per-frame work into bands.
+// ParallelFor may be called from several rig threads at once; each call
+// waits only for its own bands and the calling thread works on them too, so
+// a pool with no workers runs everything on the caller.
+class WorkerPool {
+   public:
+    // threads counts the calling thread, 0 uses every core
+    explicit WorkerPool(size_t threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // threads taking part in a ParallelFor, workers plus the caller
+    size_t Threads() const { return m_workers.size() + 1; }
+
+    // Splits [0, count) into at most bands contiguous ranges of nearly equal
+    // size and runs body(begin, end) on each. Returns when all have run; the
+    // first exception thrown by body is rethrown here.
+    void ParallelFor(size_t count, size_t bands, const std::function<void(size_t, size_t)>& body);
+    void ParallelFor(size_t count, const std::function<void(size_t, size_t)>& body) { ParallelFor(count, Threads(), body); }
+
+   private:
+    void Run();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stopping = false;
+};